@@ -19,6 +19,7 @@ gdt_flush:
 
 .reload_segments:
     ; Reload data segment registers (DS, ES, FS, GS, SS)
+    ; GS is switched to the per-CPU segment by the caller (gdt_load_cpu)
     mov ax, KERNEL_DATA_SELECTOR
     mov ds, ax
     mov es, ax
@@ -3,15 +3,19 @@
 ; Declare C handler functions used by the stubs
 extern isr_handler ; C handler for exceptions
 extern irq_handler ; C handler for hardware interrupts
+extern irq_fast_entry ; int: non-zero lets kernel-mode IRQs skip the segment reloads
+extern irq_timing     ; int: non-zero records the entry TSC for per-vector accounting
+
+; offsetof(struct cpu, irq_entry_tsc): TSC at stub entry of the IRQ being
+; handled, kept per CPU in the %gs block (percpu.h checks the offset)
+%define CPU_IRQ_ENTRY_TSC 24
 
 ; Declare the functions we provide
 global idt_load     ; Function to load IDT register (lidt)
-; Declare ISR/IRQ stubs so they are globally visible to C (in idt.c)
-global isr0         ; Example: Divide by zero
-; Add 'global isrN' for other exceptions you handle
-global irq0         ; Timer
-global irq1         ; Keyboard
-; Add 'global irqN' for other IRQs you handle
+global isr_stub_table ; Addresses of isr0..isr31, indexed by vector (used by idt.c)
+global irq_stub_table ; Addresses of irq0..irq25, indexed by IRQ slot (used by idt.c)
+global apic_spurious_stub ; Local APIC spurious vector: no EOI, just return
+global irq_return     ; Pops a registers_t frame and irets (first run of a new thread)
 
 section .text
 
@@ -45,8 +49,8 @@ isr%1:
 %endmacro
 
 ; Common IRQ stub macro
-; %1: IRQ number (0-15)
-; %2: Interrupt number (IRQ number + 32, due to PIC remapping)
+; %1: IRQ slot (0-25)
+; %2: Interrupt number (IRQ slot + 32)
 %macro IRQ 2
 irq%1:
     cli             ; Disable interrupts immediately
@@ -56,33 +60,107 @@ irq%1:
 %endmacro
 
 ; --- Define the actual ISR stubs using the macros ---
-ISR_NOERRCODE 0     ; ISR 0: Divide by zero exception
-; ISR_NOERRCODE 1   ; ISR 1: Debug exception
-; ... Add more ISR stubs for exceptions 2-31 as needed
-; Note: Some exceptions push an error code (e.g., 8, 10-14, 17, 30), use ISR_ERRCODE for those
+; The CPU pushes an error code for vectors 8, 10-14, 17, 21, 29 and 30 only
+ISR_NOERRCODE 0     ; Divide error
+ISR_NOERRCODE 1     ; Debug
+ISR_NOERRCODE 2     ; Non-maskable interrupt
+ISR_NOERRCODE 3     ; Breakpoint
+ISR_NOERRCODE 4     ; Overflow
+ISR_NOERRCODE 5     ; BOUND range exceeded
+ISR_NOERRCODE 6     ; Invalid opcode
+ISR_NOERRCODE 7     ; Device not available
+ISR_ERRCODE 8       ; Double fault (error code is always 0)
+ISR_NOERRCODE 9     ; Coprocessor segment overrun (reserved)
+ISR_ERRCODE 10      ; Invalid TSS
+ISR_ERRCODE 11      ; Segment not present
+ISR_ERRCODE 12      ; Stack-segment fault
+ISR_ERRCODE 13      ; General protection fault
+ISR_ERRCODE 14      ; Page fault (faulting address in CR2)
+ISR_NOERRCODE 15    ; Reserved
+ISR_NOERRCODE 16    ; x87 floating-point error
+ISR_ERRCODE 17      ; Alignment check
+ISR_NOERRCODE 18    ; Machine check
+ISR_NOERRCODE 19    ; SIMD floating-point exception
+ISR_NOERRCODE 20    ; Virtualization exception
+ISR_ERRCODE 21      ; Control protection exception
+ISR_NOERRCODE 22    ; Reserved
+ISR_NOERRCODE 23    ; Reserved
+ISR_NOERRCODE 24    ; Reserved
+ISR_NOERRCODE 25    ; Reserved
+ISR_NOERRCODE 26    ; Reserved
+ISR_NOERRCODE 27    ; Reserved
+ISR_NOERRCODE 28    ; Hypervisor injection exception
+ISR_ERRCODE 29      ; VMM communication exception
+ISR_ERRCODE 30      ; Security exception
+ISR_NOERRCODE 31    ; Reserved
 
 ; --- Define the actual IRQ stubs using the macros ---
 ; Remember the second argument is ISR number (IRQ + 0x20 = IRQ + 32)
 IRQ 0, 32           ; IRQ 0: Programmable Interval Timer (PIT)
 IRQ 1, 33           ; IRQ 1: Keyboard controller
-; IRQ 2, 34         ; IRQ 2: Cascade (used by PICs, usually not handled directly)
-; ... Add more IRQ stubs for 3-15 as needed
+IRQ 2, 34           ; IRQ 2: Cascade (never raised by the PIC itself)
+IRQ 3, 35           ; IRQ 3: COM2
+IRQ 4, 36           ; IRQ 4: COM1 serial port (16550 UART)
+IRQ 5, 37           ; IRQ 5: LPT2 / sound card
+IRQ 6, 38           ; IRQ 6: Floppy controller
+IRQ 7, 39           ; IRQ 7: LPT1 (also the master PIC's spurious IRQ)
+IRQ 8, 40           ; IRQ 8: CMOS real-time clock
+IRQ 9, 41           ; IRQ 9: Free / ACPI
+IRQ 10, 42          ; IRQ 10: Free
+IRQ 11, 43          ; IRQ 11: Free
+IRQ 12, 44          ; IRQ 12: PS/2 mouse
+IRQ 13, 45          ; IRQ 13: FPU
+IRQ 14, 46          ; IRQ 14: Primary ATA
+IRQ 15, 47          ; IRQ 15: Secondary ATA (also the slave PIC's spurious IRQ)
+IRQ 16, 48          ; GSI 16-23: I/O APIC PCI interrupt pins (APIC mode only)
+IRQ 17, 49
+IRQ 18, 50
+IRQ 19, 51
+IRQ 20, 52
+IRQ 21, 53
+IRQ 22, 54
+IRQ 23, 55
+IRQ 24, 56          ; Local APIC timer (APIC mode only)
+IRQ 25, 57          ; Wakeup IPI for halted application processors
+
+; The LAPIC does not set an in-service bit for its spurious vector, so
+; there is nothing to acknowledge and no handler to run
+apic_spurious_stub:
+    iret
+
+; --- Stub address tables ---
+section .data
+isr_stub_table:
+%assign i 0
+%rep 32
+    dd isr%+i
+%assign i i+1
+%endrep
+
+irq_stub_table:
+%assign i 0
+%rep 26
+    dd irq%+i
+%assign i i+1
+%endrep
 
+section .text
 
 ; --- Common stub code (shared by all ISRs) ---
 isr_common_stub:
     pusha           ; Push all general purpose registers (EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI)
+    cld             ; C code expects DF clear (memmove may be mid 'std; rep movsd')
 
     mov ax, ds      ; Get current data segment selector
     push eax        ; Save it onto the stack
 
     ; Load kernel data segment selector into data segment registers
-    ; Make sure 0x10 matches your GDT entry for kernel data
+    ; Make sure 0x10 matches your GDT entry for kernel data.
+    ; GS is the per-CPU segment and is never touched.
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     ; Stack pointer (ESP) now points to the registers_t structure
     ; Pass ESP as the argument (a pointer) to the C handler
@@ -94,7 +172,6 @@ isr_common_stub:
     mov ds, bx      ; Restore data segments
     mov es, bx
     mov fs, bx
-    mov gs, bx
 
     popa            ; Pop all general purpose registers back
     add esp, 8      ; Clean up the pushed error code (or dummy) and interrupt number
@@ -104,28 +181,53 @@ isr_common_stub:
 ; --- Common stub code (shared by all IRQs) ---
 irq_common_stub:
     pusha           ; Push all general purpose registers
+    cld             ; C code expects DF clear (memmove may be mid 'std; rep movsd')
+
+    cmp dword [irq_timing], 0
+    je .no_timing
+    rdtsc                           ; EAX/EDX are already saved by pusha
+    mov [gs:CPU_IRQ_ENTRY_TSC], eax
+    mov [gs:CPU_IRQ_ENTRY_TSC + 4], edx
+.no_timing:
+
+    ; Fast path: the interrupted code is the kernel (CS 0x08), so DS/ES/FS
+    ; already hold the flat 0x10 selector and reloading them is wasted work.
+    ; Stack: 32 bytes of pusha, int_no, err_code, EIP, then CS at [esp + 44].
+    cmp dword [irq_fast_entry], 0
+    je .slow
+    cmp word [esp + 44], 0x08
+    jne .slow
+
+    push dword 0x10 ; registers_t.ds, so handlers see the same frame layout
+    push esp
+    call irq_handler
+    add esp, 8      ; Argument and the ds slot; no segment register is touched
+    popa
+    add esp, 8      ; Clean up the pushed error code (dummy) and interrupt number
+    iret
 
+.slow:
     mov ax, ds      ; Save current data segment selector
     push eax
 
-    ; Load kernel data segment selector
+    ; Load kernel data segment selector (GS keeps the per-CPU segment)
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     ; Pass pointer (ESP) to registers_t structure to C handler
     push esp
     call irq_handler ; Call the main C IRQ handler function
     add esp, 4      ; <<< CORRECTED: Clean up 4-byte pointer argument from stack
 
+; ESP points at a registers_t (ds first). thread.c starts new threads here.
+irq_return:
     pop ebx         ; Restore original data segment selector
     mov ds, bx      ; Restore data segments
     mov es, bx
     mov fs, bx
-    mov gs, bx
 
     popa            ; Pop all general purpose registers back
     add esp, 8      ; Clean up the pushed error code (dummy) and interrupt number
-    iret            ; Return from interrupt
\ No newline at end of file
+    iret            ; Return from interrupt
@@ -20,8 +20,14 @@ section .bss
 align 4         ; Align stack to 4-byte boundary
 kernel_stack_bottom:
     resb KERNEL_STACK_SIZE ; Reserve bytes for the stack
+global kernel_stack_top     ; Boot CPU's TSS ring 0 stack (gdt.c)
 kernel_stack_top:           ; A label pointing to the top of the stack space
 
+align 8
+global boot_loader_tsc      ; First boot timestamp (boottime.c)
+boot_loader_tsc:
+    resq 1
+
 
 ; The code section starts here
 section .text
@@ -35,6 +41,14 @@ align 4
 ; Entry point for the kernel, called by GRUB
 global loader
 loader:
+    ; --- Timestamp the hand-off from GRUB ---
+    ; rdtsc overwrites EAX, which still holds the Multiboot magic
+    mov ecx, eax
+    rdtsc
+    mov [boot_loader_tsc], eax
+    mov [boot_loader_tsc + 4], edx
+    mov eax, ecx
+
     ; --- Set up the stack ---
     ; Point ESP to the top of our reserved stack area
     ; Remember the stack grows downwards in memory
@@ -0,0 +1,95 @@
+; mem_sse2.s - SSE2 inner loops for memcpy/memset (64 bytes per iteration)
+; Only called once string_init has enabled SSE, with interrupts disabled:
+; the interrupt stubs do not save XMM registers.
+
+global sse2_copy_block  ; Make sse2_copy_block visible to string.c
+global sse2_set_block   ; Make sse2_set_block visible to string.c
+
+section .text
+
+; sse2_copy_block - copy a block with unaligned loads and aligned stores
+; Expects:
+;   [esp + 16]: non_temporal (int) - use movntdq and finish with sfence
+;   [esp + 12]: n (size_t) - non-zero multiple of 64
+;   [esp + 8 ]: src (const void *) - any alignment
+;   [esp + 4 ]: dest (void *) - 16-byte aligned
+;   [esp     ]: return address
+sse2_copy_block:
+    push edi
+    push esi
+    mov edi, [esp + 12]         ; dest (arguments are 8 bytes further after the pushes)
+    mov esi, [esp + 16]         ; src
+    mov ecx, [esp + 20]         ; n
+    cmp dword [esp + 24], 0
+    jne .stream
+
+.cached:
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi + 16]
+    movdqu xmm2, [esi + 32]
+    movdqu xmm3, [esi + 48]
+    movdqa [edi], xmm0
+    movdqa [edi + 16], xmm1
+    movdqa [edi + 32], xmm2
+    movdqa [edi + 48], xmm3
+    add esi, 64
+    add edi, 64
+    sub ecx, 64
+    jnz .cached
+    jmp .done
+
+.stream:
+    movdqu xmm0, [esi]
+    movdqu xmm1, [esi + 16]
+    movdqu xmm2, [esi + 32]
+    movdqu xmm3, [esi + 48]
+    movntdq [edi], xmm0
+    movntdq [edi + 16], xmm1
+    movntdq [edi + 32], xmm2
+    movntdq [edi + 48], xmm3
+    add esi, 64
+    add edi, 64
+    sub ecx, 64
+    jnz .stream
+    sfence                      ; Order the weakly-ordered stores before returning
+
+.done:
+    pop esi
+    pop edi
+    ret
+
+; sse2_set_block - fill a block with a repeated 32-bit pattern
+; Expects:
+;   [esp + 16]: non_temporal (int) - use movntdq and finish with sfence
+;   [esp + 12]: n (size_t) - non-zero multiple of 64
+;   [esp + 8 ]: pattern (uint32_t) - the fill byte replicated four times
+;   [esp + 4 ]: dest (void *) - 16-byte aligned
+;   [esp     ]: return address
+sse2_set_block:
+    mov edx, [esp + 4]          ; dest
+    movd xmm0, [esp + 8]        ; pattern in the low dword...
+    pshufd xmm0, xmm0, 0        ; ...broadcast to all four
+    mov ecx, [esp + 12]         ; n
+    cmp dword [esp + 16], 0
+    jne .stream
+
+.cached:
+    movdqa [edx], xmm0
+    movdqa [edx + 16], xmm0
+    movdqa [edx + 32], xmm0
+    movdqa [edx + 48], xmm0
+    add edx, 64
+    sub ecx, 64
+    jnz .cached
+    ret
+
+.stream:
+    movntdq [edx], xmm0
+    movntdq [edx + 16], xmm0
+    movntdq [edx + 32], xmm0
+    movntdq [edx + 48], xmm0
+    add edx, 64
+    sub ecx, 64
+    jnz .stream
+    sfence
+    ret
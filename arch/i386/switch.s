@@ -0,0 +1,25 @@
+; switch.s - Kernel thread context switch
+
+global context_switch ; void context_switch(uint32_t *old_esp, uint32_t new_esp)
+
+section .text
+
+; Save the callee-saved registers on the current stack, store its ESP in
+; *old_esp, then resume the stack at new_esp. EAX/ECX/EDX are caller-saved
+; under cdecl, so nothing else needs preserving. A thread that has never
+; run has a frame here whose return address is irq_return (idt_asm.s),
+; which pops the registers_t prepared by thread_create and irets into it.
+context_switch:
+    mov eax, [esp+4]    ; old_esp
+    mov edx, [esp+8]    ; new_esp
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
@@ -0,0 +1,88 @@
+; trampoline.s - Real-mode startup code for application processors (copied to 0x8000)
+;
+; A SIPI starts the AP in real mode at TRAMPOLINE_BASE (vector 0x08). The code
+; below is position-dependent on that address: smp.c copies trampoline_start..
+; trampoline_end there and fills in trampoline_params before each SIPI.
+
+global trampoline_start
+global trampoline_end
+global trampoline_params
+
+TRAMPOLINE_BASE equ 0x8000
+
+; Address of a trampoline label once the blob sits at TRAMPOLINE_BASE
+%define TRAMP(label) (TRAMPOLINE_BASE + ((label) - trampoline_start))
+
+CODE_SELECTOR equ 0x08
+DATA_SELECTOR equ 0x10
+
+CR0_PE equ 0x1
+CR4_PGE equ 0x80
+
+section .text
+
+bits 16
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TRAMP(tramp_gdt_ptr)]
+
+    mov eax, cr0
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword CODE_SELECTOR:TRAMP(tramp_protected)
+
+bits 32
+tramp_protected:
+    mov ax, DATA_SELECTOR
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Same paging and SSE setup as the boot CPU. Global pages may only be
+    ; enabled once paging is on, so CR4 is written without PGE first.
+    mov eax, [TRAMP(param_cr4)]
+    and eax, ~CR4_PGE
+    mov cr4, eax
+    mov eax, [TRAMP(param_cr3)]
+    mov cr3, eax
+    mov eax, [TRAMP(param_cr0)]
+    mov cr0, eax
+    mov eax, [TRAMP(param_cr4)]
+    mov cr4, eax
+
+    ; Own stack and the C entry point: ap_entry(struct cpu *), which
+    ; replaces this GDT with the CPU's own one
+    mov esp, [TRAMP(param_stack)]
+    push dword [TRAMP(param_cpu)]
+    mov eax, [TRAMP(param_entry)]
+    call eax
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+; Flat 4 GiB code and data, same selectors as the kernel GDT
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF ; Code: base 0, limit 4 GiB, execute/read
+    dq 0x00CF92000000FFFF ; Data: base 0, limit 4 GiB, read/write
+tramp_gdt_ptr:
+    dw tramp_gdt_ptr - tramp_gdt - 1
+    dd TRAMP(tramp_gdt)
+
+; Filled in by smp.c (layout must match struct trampoline_params)
+align 4
+trampoline_params:
+param_cr0:     dd 0
+param_cr3:     dd 0
+param_cr4:     dd 0
+param_stack:   dd 0
+param_entry:   dd 0
+param_cpu:     dd 0
+trampoline_end:
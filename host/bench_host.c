@@ -0,0 +1,257 @@
+// bench_host.c - Console and memory throughput benchmarks, run as an ordinary Linux process
+//
+// Usage: host-bench [filter] [--min-time=SECONDS]
+//
+// Each benchmark runs with a growing iteration count until one batch takes
+// at least the minimum time, then reports time per iteration and throughput
+// (the same scheme as Google Benchmark). Since this is a normal process,
+// 'perf record build/host/host-bench memcpy' profiles the kernel routines
+// with symbols.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Kernel entry points. The kernel headers are freestanding and clash with
+// libc's, so the few that are needed are declared here (host.h renames the
+// kernel's string functions to kernel_*).
+void string_init(void);
+void *kernel_memset(void *s, int c, size_t n);
+void *kernel_memcpy(void *dest, const void *src, size_t n);
+void fb_write_string(const char *str, unsigned char fg, unsigned char bg);
+void fb_clear(void);
+void shell_init(void);
+void run_shell_command(char *command);
+
+extern uint32_t host_tsc_khz; // mock.c
+
+#define FB_WHITE 15
+#define FB_BLACK 0
+
+#define DEFAULT_MIN_TIME 0.5
+#define MAX_ITERATIONS 1000000000ULL
+#define BUFFER_SIZE (4 * 1024 * 1024)
+
+struct host_benchmark
+{
+    const char *name;
+    void (*run)(uint64_t iterations, size_t size);
+    size_t size;      // Argument passed to run, also bytes per iteration if counted
+    int counts_bytes; // Report bytes/s (otherwise iterations/s)
+};
+
+static uint8_t *src_buffer;
+static uint8_t *dst_buffer;
+
+// Keep the compiler from dropping or merging the measured work
+static inline void clobber(void *p)
+{
+    asm volatile("" : : "r"(p) : "memory");
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// tsc_khz for the kernel's clock_ns (klog timestamps)
+static void calibrate_tsc()
+{
+    double start = now_seconds();
+    uint64_t tsc_start = rdtsc();
+    while (now_seconds() - start < 0.05)
+        ;
+    double elapsed = now_seconds() - start;
+    host_tsc_khz = (uint32_t)((rdtsc() - tsc_start) / elapsed / 1000.0);
+    if (host_tsc_khz == 0)
+        host_tsc_khz = 1;
+}
+
+// --- Benchmarks ---
+
+static const char console_line[] = "The quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJ\n";
+
+static void bm_console_line(uint64_t iterations, size_t size)
+{
+    (void)size;
+    for (uint64_t i = 0; i < iterations; i++)
+        fb_write_string(console_line, FB_WHITE, FB_BLACK);
+}
+
+static void bm_console_char(uint64_t iterations, size_t size)
+{
+    (void)size;
+    for (uint64_t i = 0; i < iterations; i++)
+        fb_write_string("x", FB_WHITE, FB_BLACK);
+}
+
+static void bm_console_clear(uint64_t iterations, size_t size)
+{
+    (void)size;
+    for (uint64_t i = 0; i < iterations; i++)
+        fb_clear();
+}
+
+static void bm_shell_echo(uint64_t iterations, size_t size)
+{
+    static const char input[] = "echo hello";
+    char line[sizeof(input)];
+    (void)size;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        memcpy(line, input, sizeof(input)); // The shell tokenizes the line in place
+        run_shell_command(line);
+    }
+}
+
+static void bm_kernel_memset(uint64_t iterations, size_t size)
+{
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        kernel_memset(dst_buffer, (int)i, size);
+        clobber(dst_buffer);
+    }
+}
+
+static void bm_libc_memset(uint64_t iterations, size_t size)
+{
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        memset(dst_buffer, (int)i, size);
+        clobber(dst_buffer);
+    }
+}
+
+static void bm_kernel_memcpy(uint64_t iterations, size_t size)
+{
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        kernel_memcpy(dst_buffer, src_buffer + 4, size); // Misaligned source, as in 'bench mem'
+        clobber(dst_buffer);
+    }
+}
+
+static void bm_libc_memcpy(uint64_t iterations, size_t size)
+{
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        memcpy(dst_buffer, src_buffer + 4, size);
+        clobber(dst_buffer);
+    }
+}
+
+#define MEMORY_SIZES(name, fn)                                                                          \
+    {name "/64", fn, 64, 1}, {name "/4096", fn, 4096, 1}, {name "/65536", fn, 65536, 1},                \
+        {name "/1048576", fn, 1048576, 1}
+
+static const struct host_benchmark benchmarks[] = {
+    {"console_line", bm_console_line, sizeof(console_line) - 1, 1},
+    {"console_char", bm_console_char, 1, 1},
+    {"console_clear", bm_console_clear, 0, 0},
+    {"shell_echo", bm_shell_echo, 0, 0},
+    MEMORY_SIZES("memset", bm_kernel_memset),
+    MEMORY_SIZES("memset_libc", bm_libc_memset),
+    MEMORY_SIZES("memcpy", bm_kernel_memcpy),
+    MEMORY_SIZES("memcpy_libc", bm_libc_memcpy),
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// --- Runner ---
+
+static void print_rate(double per_second, int bytes)
+{
+    const char *units[] = {"", "k", "M", "G"};
+    int u = 0;
+    double divisor = bytes ? 1024.0 : 1000.0;
+    while (per_second >= divisor && u < 3)
+    {
+        per_second /= divisor;
+        u++;
+    }
+    if (bytes)
+        printf("%8.2f %siB/s", per_second, units[u]);
+    else
+        printf("%8.2f %s/s", per_second, units[u]);
+}
+
+static void run_benchmark(const struct host_benchmark *b, double min_time)
+{
+    uint64_t iterations = 1;
+    double elapsed;
+
+    b->run(1, b->size); // Warm-up: caches, page faults on the buffers
+    while (1)
+    {
+        double start = now_seconds();
+        b->run(iterations, b->size);
+        elapsed = now_seconds() - start;
+        if (elapsed >= min_time || iterations >= MAX_ITERATIONS)
+            break;
+
+        // Aim 40% past the target, growing at most tenfold per step
+        double scale = elapsed > 0 ? min_time * 1.4 / elapsed : 10.0;
+        if (scale > 10.0)
+            scale = 10.0;
+        uint64_t next = (uint64_t)(iterations * scale);
+        iterations = next > iterations ? next : iterations + 1;
+    }
+
+    double ns = elapsed * 1e9 / iterations;
+    printf("%-24s %12.1f ns %14llu  ", b->name, ns, (unsigned long long)iterations);
+    if (b->counts_bytes)
+        print_rate((double)b->size * iterations / elapsed, 1);
+    else
+        print_rate(iterations / elapsed, 0);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    double min_time = DEFAULT_MIN_TIME;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--min-time=", 11) == 0)
+            min_time = atof(argv[i] + 11);
+        else
+            filter = argv[i];
+    }
+
+    src_buffer = aligned_alloc(64, BUFFER_SIZE);
+    dst_buffer = aligned_alloc(64, BUFFER_SIZE);
+    if (src_buffer == NULL || dst_buffer == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(src_buffer, 0x5A, BUFFER_SIZE);
+
+    calibrate_tsc();
+    string_init(); // Picks the SSE2 paths from the host's CPUID, as at boot
+    shell_init();  // Registers the shell commands
+
+    printf("%-24s %15s %14s  %s\n", "Benchmark", "Time", "Iterations", "Throughput");
+    printf("----------------------------------------------------------------------------\n");
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++)
+    {
+        if (filter && strstr(benchmarks[i].name, filter) == NULL)
+            continue;
+        run_benchmark(&benchmarks[i], min_time);
+    }
+
+    free(src_buffer);
+    free(dst_buffer);
+    return 0;
+}
@@ -0,0 +1,26 @@
+// host.h - Force-included (-include) into every kernel source of the host build
+#ifndef HOST_H
+#define HOST_H
+
+// The kernel's string functions keep their own names in the host binary, so
+// they neither clash with nor silently replace the C library's
+#define memset kernel_memset
+#define memcpy kernel_memcpy
+#define memmove kernel_memmove
+#define memcmp kernel_memcmp
+#define strlen kernel_strlen
+#define strcmp kernel_strcmp
+#define strncmp kernel_strncmp
+
+// VGA text memory is an ordinary array (mock.c) instead of 0xB8000
+#define FB_MEMORY host_vga_memory
+extern unsigned short host_vga_memory[];
+
+// Mock port I/O and privileged instructions (host/include). Included here,
+// first, because kernel headers such as fb.h include "io.h" from their own
+// directory; once these have pulled in the kernel versions under other
+// names, the kernel headers' include guards keep them from coming back.
+#include "io.h"
+#include "cpu.h"
+
+#endif
@@ -0,0 +1,100 @@
+// cpu.h - Host build: privileged instructions replaced by mocks, CPUID/rdtsc kept
+#ifndef HOST_CPU_H
+#define HOST_CPU_H
+
+// cli/popf, control registers, MSRs and invlpg fault in a user process; the
+// kernel's versions are compiled under other names and replaced below
+#define irq_save kernel_irq_save
+#define irq_restore kernel_irq_restore
+#define read_cr0 kernel_read_cr0
+#define write_cr0 kernel_write_cr0
+#define read_cr2 kernel_read_cr2
+#define read_cr3 kernel_read_cr3
+#define write_cr3 kernel_write_cr3
+#define read_cr4 kernel_read_cr4
+#define write_cr4 kernel_write_cr4
+#define rdmsr kernel_rdmsr
+#define wrmsr kernel_wrmsr
+#define invlpg kernel_invlpg
+#include_next "cpu.h"
+#undef irq_save
+#undef irq_restore
+#undef read_cr0
+#undef write_cr0
+#undef read_cr2
+#undef read_cr3
+#undef write_cr3
+#undef read_cr4
+#undef write_cr4
+#undef rdmsr
+#undef wrmsr
+#undef invlpg
+
+// Shadow control registers (mock.c): string_init's SSE setup lands here
+extern uint32_t host_cr0;
+extern uint32_t host_cr4;
+
+// There is only ever one "CPU" and nothing interrupts it
+static inline uint32_t irq_save()
+{
+    return 0x202;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    (void)flags;
+}
+
+static inline uint32_t read_cr0()
+{
+    return host_cr0;
+}
+
+static inline void write_cr0(uint32_t value)
+{
+    host_cr0 = value;
+}
+
+static inline uint32_t read_cr2()
+{
+    return 0;
+}
+
+static inline uint32_t read_cr3()
+{
+    return 0;
+}
+
+static inline void write_cr3(uint32_t value)
+{
+    (void)value;
+}
+
+static inline uint32_t read_cr4()
+{
+    return host_cr4;
+}
+
+static inline void write_cr4(uint32_t value)
+{
+    host_cr4 = value;
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    (void)msr;
+    return 0;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    (void)msr;
+    (void)value;
+}
+
+static inline void invlpg(uint32_t addr)
+{
+    (void)addr;
+}
+
+#endif
@@ -0,0 +1,94 @@
+// io.h - Host build: port I/O goes to a mock port space instead of in/out instructions
+#ifndef HOST_IO_H
+#define HOST_IO_H
+
+// The kernel's versions are still compiled (under other names), but the
+// ones below are what kernel code calls
+#define outb kernel_outb
+#define outw kernel_outw
+#define outl kernel_outl
+#define inb kernel_inb
+#define inw kernel_inw
+#define inl kernel_inl
+#define insw kernel_insw
+#define outsw kernel_outsw
+#define insl kernel_insl
+#define outsl kernel_outsl
+#define io_wait kernel_io_wait
+#include_next "io.h"
+#undef outb
+#undef outw
+#undef outl
+#undef inb
+#undef inw
+#undef inl
+#undef insw
+#undef outsw
+#undef insl
+#undef outsl
+#undef io_wait
+
+// Mock port space (mock.c): a write stores the value, a read returns the
+// last value written to that port
+void host_port_write(uint16_t port, uint32_t value);
+uint32_t host_port_read(uint16_t port);
+
+static inline void outb(uint16_t port, uint8_t data)
+{
+    host_port_write(port, data);
+}
+
+static inline void outw(uint16_t port, uint16_t data)
+{
+    host_port_write(port, data);
+}
+
+static inline void outl(uint16_t port, uint32_t data)
+{
+    host_port_write(port, data);
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+    return (uint8_t)host_port_read(port);
+}
+
+static inline uint16_t inw(uint16_t port)
+{
+    return (uint16_t)host_port_read(port);
+}
+
+static inline uint32_t inl(uint16_t port)
+{
+    return host_port_read(port);
+}
+
+static inline void insw(uint16_t port, void *buffer, uint32_t count)
+{
+    for (uint16_t *p = buffer; count--; p++)
+        *p = inw(port);
+}
+
+static inline void outsw(uint16_t port, const void *buffer, uint32_t count)
+{
+    for (const uint16_t *p = buffer; count--; p++)
+        outw(port, *p);
+}
+
+static inline void insl(uint16_t port, void *buffer, uint32_t count)
+{
+    for (uint32_t *p = buffer; count--; p++)
+        *p = inl(port);
+}
+
+static inline void outsl(uint16_t port, const void *buffer, uint32_t count)
+{
+    for (const uint32_t *p = buffer; count--; p++)
+        outl(port, *p);
+}
+
+static inline void io_wait()
+{
+}
+
+#endif
@@ -0,0 +1,349 @@
+// mock.c - Host build: mock hardware and stand-ins for the kernel subsystems shell.c calls
+//
+// Compiled like a kernel source (freestanding headers from include/), so the
+// signatures below are checked against the real declarations.
+#include "common.h"
+#include "fb.h"
+#include "io.h"
+#include "cpu.h"
+#include "div64.h"
+#include "string.h"
+#include "timer.h"
+#include "pmm.h"
+#include "kheap.h"
+#include "keyboard.h"
+#include "serial.h"
+#include "interrupts.h"
+#include "klog.h"
+#include "apic.h"
+#include "smp.h"
+#include "thread.h"
+#include "workpool.h"
+#include "bench.h"
+#include "prof.h"
+#include "trace.h"
+#include "boottime.h"
+#include "memmap.h"
+#include "initrd.h"
+
+// From the host C library (its headers cannot be mixed with the kernel's)
+void *malloc(size_t size);
+void free(void *ptr);
+
+// --- Mock hardware ---
+
+uint16_t host_vga_memory[FB_ROWS * FB_COLS] __attribute__((aligned(4)));
+
+static uint32_t ports[65536];
+
+void host_port_write(uint16_t port, uint32_t value)
+{
+    ports[port] = value;
+}
+
+uint32_t host_port_read(uint16_t port)
+{
+    return ports[port];
+}
+
+uint32_t host_cr0 = 0;
+uint32_t host_cr4 = 0;
+
+// Set by the driver after timing rdtsc against the host clock
+uint32_t host_tsc_khz = 1000000;
+
+// --- Time ---
+
+uint32_t tsc_khz()
+{
+    return host_tsc_khz;
+}
+
+uint64_t clock_ns()
+{
+    uint64_t cycles = rdtsc();
+    uint32_t rem;
+    uint64_t ms = div64_u32(cycles, host_tsc_khz, &rem);
+    return ms * 1000000 + div64_u32((uint64_t)rem * 1000000, host_tsc_khz, NULL);
+}
+
+uint64_t ticks()
+{
+    return div64_u32(clock_ns(), 1000000000 / TIMER_DEFAULT_HZ, NULL);
+}
+
+uint32_t timer_hz()
+{
+    return TIMER_DEFAULT_HZ;
+}
+
+// --- Memory ---
+
+void *kmalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *kzalloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+void kfree(void *ptr)
+{
+    free(ptr);
+}
+
+void pmm_get_stats(struct pmm_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void kheap_get_cache_stats(int index, struct kheap_cache_stats *stats)
+{
+    (void)index;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void kheap_get_large_stats(struct kheap_large_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+// --- Input: the driver feeds the shell directly ---
+
+int keyboard_getchar()
+{
+    return -1;
+}
+
+int keyboard_has_input()
+{
+    return 0;
+}
+
+uint32_t keyboard_received_count()
+{
+    return 0;
+}
+
+uint32_t keyboard_dropped_count()
+{
+    return 0;
+}
+
+int serial_getchar()
+{
+    return -1;
+}
+
+int serial_has_input()
+{
+    return 0;
+}
+
+void serial_write(const char *str)
+{
+    (void)str;
+}
+
+// --- Interrupts ---
+
+uint32_t interrupt_hits(uint8_t vector)
+{
+    (void)vector;
+    return 0;
+}
+
+const char *interrupt_name(uint8_t vector)
+{
+    (void)vector;
+    return "host";
+}
+
+void irq_get_timing(uint8_t vector, struct irq_cycle_stats *entry, struct irq_cycle_stats *body)
+{
+    (void)vector;
+    memset(entry, 0, sizeof(*entry));
+    memset(body, 0, sizeof(*body));
+}
+
+int irq_fast_entry_enabled()
+{
+    return 1;
+}
+
+void irq_set_fast_entry(int enable)
+{
+    (void)enable;
+}
+
+int irq_timing_enabled()
+{
+    return 0;
+}
+
+void irq_set_timing(int enable)
+{
+    (void)enable;
+}
+
+void irq_reset_timing()
+{
+}
+
+uint32_t irq_spurious_count()
+{
+    return 0;
+}
+
+uint32_t irq_max_disabled_cycles()
+{
+    return 0;
+}
+
+void irq_reset_max_disabled_cycles()
+{
+}
+
+void thread_wait_interrupt()
+{
+}
+
+// --- Commands that need real hardware ---
+
+static void unavailable()
+{
+    fb_write_string("Not available in the host build.\n", FB_RED, FB_BLACK);
+}
+
+void apic_print_info()
+{
+    unavailable();
+}
+
+void boottime_print()
+{
+    unavailable();
+}
+
+void memmap_print()
+{
+    unavailable();
+}
+
+void smp_print_cpus()
+{
+    unavailable();
+}
+
+void thread_print_list()
+{
+    unavailable();
+}
+
+void pmm_benchmark()
+{
+    unavailable();
+}
+
+void kheap_benchmark()
+{
+    unavailable();
+}
+
+void io_benchmark()
+{
+    unavailable();
+}
+
+void keyboard_benchmark()
+{
+    unavailable();
+}
+
+void irq_benchmark()
+{
+    unavailable();
+}
+
+void thread_benchmark()
+{
+    unavailable();
+}
+
+void initrd_benchmark()
+{
+    unavailable();
+}
+
+void workpool_benchmark()
+{
+    unavailable();
+}
+
+int bench_run(const char *name)
+{
+    (void)name;
+    unavailable();
+    return 0;
+}
+
+void bench_list()
+{
+    unavailable();
+}
+
+int prof_start(uint32_t hz)
+{
+    (void)hz;
+    unavailable();
+    return 0;
+}
+
+void prof_stop()
+{
+}
+
+void prof_report(uint32_t top)
+{
+    (void)top;
+}
+
+void prof_export_folded()
+{
+}
+
+volatile int trace_active = 0;
+
+void trace_record_event(uint32_t event, uint32_t arg)
+{
+    (void)event;
+    (void)arg;
+}
+
+int trace_enable()
+{
+    unavailable();
+    return 0;
+}
+
+void trace_disable()
+{
+}
+
+void trace_clear()
+{
+}
+
+void trace_print_status()
+{
+    unavailable();
+}
+
+void trace_dump()
+{
+}
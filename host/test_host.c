@@ -0,0 +1,193 @@
+// test_host.c - Console and shell unit tests against the mock VGA buffer, run as an ordinary Linux process
+//
+// Usage: host-test
+//
+// Drives the real fb.c and shell.c (compiled as in host-bench) and checks
+// what lands in host_vga_memory after a flush. Prints one line per test and
+// exits non-zero if any check fails.
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Kernel entry points (see bench_host.c for why they are declared here)
+void string_init(void);
+void fb_write_string(const char *str, unsigned char fg, unsigned char bg);
+void fb_clear(void);
+void fb_flush(void);
+unsigned short fb_get_cursor_row(void);
+unsigned short fb_get_cursor_col(void);
+void shell_init(void);
+void shell_input_char(char c);
+void clear_cmd_buffer(void);
+void run_shell_command(char *command);
+int command_tokenize(char *line, char **argv, int max_args);
+
+extern uint16_t host_vga_memory[]; // mock.c
+
+#define FB_ROWS 25
+#define FB_COLS 80
+#define FB_WHITE 15
+#define FB_BLACK 0
+
+static int failures = 0;
+static int test_failed = 0;
+
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failed = 1;                                                   \
+        }                                                                      \
+    } while (0)
+
+// Character shown at a screen position once the console is flushed
+static char screen_char(int row, int col)
+{
+    return (char)(host_vga_memory[row * FB_COLS + col] & 0xFF);
+}
+
+// Non-zero if screen row 'row' starts with 'text' and is blank after it
+static int row_is(int row, const char *text)
+{
+    int len = (int)strlen(text);
+    for (int col = 0; col < FB_COLS; col++)
+    {
+        if (screen_char(row, col) != (col < len ? text[col] : ' '))
+            return 0;
+    }
+    return 1;
+}
+
+static void put(const char *text)
+{
+    fb_write_string(text, FB_WHITE, FB_BLACK);
+}
+
+// --- Tests ---
+
+// A newline on the last row moves every row up one and blanks the bottom
+static void test_scroll()
+{
+    char line[16];
+    fb_clear();
+    for (int i = 0; i < FB_ROWS; i++)
+    {
+        snprintf(line, sizeof(line), "line %d\n", i);
+        put(line);
+    }
+    CHECK(row_is(0, "line 1"));
+    CHECK(row_is(FB_ROWS - 2, "line 24"));
+    CHECK(row_is(FB_ROWS - 1, ""));
+    CHECK(fb_get_cursor_row() == FB_ROWS - 1);
+    CHECK(fb_get_cursor_col() == 0);
+}
+
+// The 81st character of a line lands at the start of the next row
+static void test_wrap()
+{
+    char line[FB_COLS + 2];
+    fb_clear();
+    memset(line, 'a', FB_COLS);
+    line[FB_COLS] = '\0';
+    put(line);
+    CHECK(fb_get_cursor_row() == 1);
+    CHECK(fb_get_cursor_col() == 0);
+
+    put("b");
+    CHECK(screen_char(0, FB_COLS - 1) == 'a');
+    CHECK(row_is(1, "b"));
+    CHECK(fb_get_cursor_row() == 1);
+    CHECK(fb_get_cursor_col() == 1);
+}
+
+// Backspace at column 0 erases the last cell of the row above
+static void test_backspace_at_column_0()
+{
+    fb_clear();
+    clear_cmd_buffer();
+    for (int i = 0; i < FB_COLS; i++)
+        shell_input_char('x');
+    fb_flush(); // The shell loop flushes once per input batch
+    CHECK(fb_get_cursor_row() == 1);
+    CHECK(fb_get_cursor_col() == 0);
+
+    shell_input_char('\b');
+    fb_flush();
+    CHECK(fb_get_cursor_row() == 0);
+    CHECK(fb_get_cursor_col() == FB_COLS - 1);
+    CHECK(screen_char(0, FB_COLS - 1) == ' ');
+    CHECK(screen_char(0, FB_COLS - 2) == 'x');
+
+    // The erased character is gone from the line as well: Enter runs 79 x's
+    shell_input_char('\n');
+    fb_flush();
+    // "Unknown command: '" is 18 characters, so the closing quote wraps to row 2, column 18 + 79 - 80
+    CHECK(screen_char(1, 0) == 'U');
+    CHECK(screen_char(2, 16) == 'x');
+    CHECK(screen_char(2, 17) == '\'');
+    clear_cmd_buffer();
+}
+
+// Words split on runs of spaces, quotes group, the line is cut in place
+static void test_tokenize()
+{
+    char line[] = "  echo   \"hello   world\"  foo  ";
+    char *argv[4];
+    int argc = command_tokenize(line, argv, 4);
+    CHECK(argc == 3);
+    if (argc == 3)
+    {
+        CHECK(strcmp(argv[0], "echo") == 0);
+        CHECK(strcmp(argv[1], "hello   world") == 0);
+        CHECK(strcmp(argv[2], "foo") == 0);
+        CHECK(argv[0] >= line && argv[0] < line + sizeof(line)); // No copies
+    }
+
+    char many[] = "a b c d e";
+    CHECK(command_tokenize(many, argv, 4) == 4); // Words past the limit are ignored
+
+    char blank[] = "    ";
+    CHECK(command_tokenize(blank, argv, 4) == 0);
+}
+
+// A tokenized line reaches the command: echo joins its words with one space
+static void test_run_command()
+{
+    char line[] = "echo   one    two";
+    fb_clear();
+    run_shell_command(line);
+    CHECK(row_is(0, "one two"));
+    CHECK(fb_get_cursor_row() == 1);
+}
+
+static const struct
+{
+    const char *name;
+    void (*run)();
+} tests[] = {
+    {"scroll", test_scroll},
+    {"wrap_at_column_80", test_wrap},
+    {"backspace_at_column_0", test_backspace_at_column_0},
+    {"tokenize", test_tokenize},
+    {"run_command", test_run_command},
+};
+
+#define TEST_COUNT (sizeof(tests) / sizeof(tests[0]))
+
+int main()
+{
+    string_init();
+    shell_init(); // Registers the shell commands
+
+    for (size_t i = 0; i < TEST_COUNT; i++)
+    {
+        test_failed = 0;
+        tests[i].run();
+        printf("%s %s\n", test_failed ? "FAIL" : "ok  ", tests[i].name);
+        failures += test_failed;
+    }
+    printf("%d of %d tests failed\n", failures, (int)TEST_COUNT);
+    return failures != 0;
+}
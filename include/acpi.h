@@ -0,0 +1,62 @@
+// acpi.h - Minimal ACPI table discovery (RSDP, RSDT) and MADT parsing
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "common.h"
+
+// Limits of what the MADT parser records
+#define ACPI_MAX_CPUS 16
+#define ACPI_MAX_IOAPICS 4
+#define ACPI_ISA_IRQS 16
+#define ACPI_GSI_NONE 0xFFFFFFFF // ISA IRQ with no I/O APIC pin
+
+// Interrupt source override flags (MPS INTI flags)
+#define ACPI_POLARITY_MASK 0x3
+#define ACPI_POLARITY_LOW 0x3
+#define ACPI_TRIGGER_MASK 0xC
+#define ACPI_TRIGGER_LEVEL 0xC
+
+// Common header of every system description table
+struct acpi_sdt_header
+{
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_ioapic
+{
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;
+};
+
+// Interrupt routing facts collected from the MADT
+struct acpi_madt_info
+{
+    uint32_t lapic_address;
+    int pcat_compat; // Legacy 8259 pair present (must be masked when using the APIC)
+    int cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS]; // Enabled processors, BSP included
+    int ioapic_count;
+    struct acpi_ioapic ioapics[ACPI_MAX_IOAPICS];
+    uint32_t isa_gsi[ACPI_ISA_IRQS];     // GSI each ISA IRQ is wired to (identity unless overridden)
+    uint16_t isa_flags[ACPI_ISA_IRQS];   // Polarity/trigger from the override, 0 = ISA default
+};
+
+// Locate the RSDP and RSDT. Returns 0 on success, -1 if there is no ACPI.
+int acpi_init();
+
+// Table with the given 4-character signature, or NULL
+struct acpi_sdt_header *acpi_find_table(const char *signature);
+
+// Parse the MADT ("APIC"). Returns 0 on success, -1 if it is missing.
+int acpi_parse_madt(struct acpi_madt_info *info);
+
+#endif
@@ -0,0 +1,61 @@
+// apic.h - Local APIC and I/O APIC interrupt delivery
+#ifndef APIC_H
+#define APIC_H
+
+#include "common.h"
+#include "interrupts.h"
+#include "acpi.h"
+
+// IRQ slot (vector IDT_IRQ_BASE + 24) used by the local APIC timer
+#define APIC_TIMER_IRQ 24
+#define APIC_TIMER_DEFAULT_HZ 100
+
+// IRQ slot (vector IDT_IRQ_BASE + 25) of the IPI that wakes a halted CPU; no handler needed
+#define APIC_WAKE_IRQ 25
+
+// Vector the local APIC raises for spurious interrupts (its low 4 bits must be set)
+#define APIC_SPURIOUS_VECTOR 0xFF
+
+// Detect the APICs (CPUID + ACPI MADT), mask the 8259 pair and move every
+// registered IRQ line onto the I/O APIC. Returns 0 on success; on -1 the
+// 8259 stays in charge and nothing has changed.
+int apic_init();
+
+// Non-zero once apic_init has switched interrupt delivery to the APICs
+int apic_active();
+
+// Acknowledge the interrupt in service on this CPU's local APIC
+void lapic_eoi();
+
+// This CPU's local APIC ID
+uint8_t lapic_id();
+
+// Set up the calling application processor's local APIC (after apic_init on the BSP)
+void lapic_init_ap();
+
+// Interprocessor interrupts: ICR low-word commands (level assert included)
+#define APIC_IPI_INIT 0x4500
+#define APIC_IPI_STARTUP 0x4600 // OR in the start page: physical address >> 12
+#define APIC_IPI_FIXED 0x4000   // OR in the vector
+
+// Send 'command' to the CPU with local APIC ID 'apic_id' and wait until it is delivered
+void lapic_send_ipi(uint8_t apic_id, uint32_t command);
+
+// MADT contents (CPUs, I/O APICs, overrides), or NULL if the APICs are not in use
+const struct acpi_madt_info *apic_madt();
+
+// Mask or unmask IRQ slot 'irq': ISA IRQs 0-15 (through the MADT overrides),
+// GSIs 16-23, or APIC_TIMER_IRQ. Returns -1 if the slot has no pin.
+int apic_set_irq_mask(uint8_t irq, int masked);
+
+// Local APIC timer as a periodic clock-event source on APIC_TIMER_IRQ.
+// 'handler' runs on every event (may be NULL). Returns -1 without an APIC.
+int lapic_timer_start(uint32_t hz, interrupt_handler_t handler);
+void lapic_timer_stop();
+uint64_t lapic_timer_events();
+uint32_t lapic_timer_khz(); // Calibrated timer input clock (after the divider)
+
+// Print APIC/IOAPIC configuration and routing for the 'apic' shell command
+void apic_print_info();
+
+#endif
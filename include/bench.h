@@ -0,0 +1,65 @@
+// bench.h - Microbenchmark registry with rdtsc sampling and median/p99 reporting
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "common.h"
+
+#define BENCH_WARMUP_SAMPLES 5 // Untimed runs before measuring (caches, TLB, branch predictors)
+#define BENCH_SAMPLES 101      // Timed runs; odd so the median is one sample, p99 is the 100th
+
+// One registered benchmark. 'body' performs the measured operation
+// 'iterations' times; every sample times one call of it with interrupts off.
+struct benchmark
+{
+    const char *name;
+    const char *description;
+    void (*body)(uint32_t iterations);
+    uint32_t iterations;
+};
+
+// Cycles per iteration over all samples
+struct bench_result
+{
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t max;
+};
+
+// Define and register a benchmark; the linker collects the entries into
+// the .benchmarks section (link.ld), so no central list has to be edited:
+//
+//     BENCHMARK(memset_4k, "memset of 4 KiB", 64)
+//     {
+//         for (uint32_t i = 0; i < iterations; i++)
+//             ...
+//     }
+#define BENCHMARK(id, desc, iters)                                                                     \
+    static void bench_body_##id(uint32_t iterations);                                                  \
+    static const struct benchmark bench_entry_##id __attribute__((used, section(".benchmarks"))) = { \
+        #id, desc, bench_body_##id, iters};                                                            \
+    static void bench_body_##id(uint32_t iterations)
+
+// Registered benchmark called 'name', or NULL
+const struct benchmark *bench_find(const char *name);
+
+// Warm up, sample and sort the timings of one benchmark
+void bench_measure(const struct benchmark *b, struct bench_result *result);
+
+// Run one benchmark by name (NULL or "" runs all of them) and print a table.
+// Returns -1 if no benchmark has that name.
+int bench_run(const char *name);
+
+// Print the names and descriptions of the registered benchmarks
+void bench_list();
+
+// Boot-time mode ("bench" on the kernel command line): run every benchmark,
+// print one machine-readable line per result on the serial port and exit
+// QEMU through isa-debug-exit. Never returns.
+void bench_boot_suite();
+
+// Flush COM1 and exit QEMU through isa-debug-exit (status 1, or 3 if
+// 'failed'); halts when there is no such device. Never returns.
+void bench_exit(int failed);
+
+#endif
@@ -0,0 +1,23 @@
+// boottime.h - TSC timestamps of the boot phases, from the loader entry to the shell prompt
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include "common.h"
+
+#define BOOT_MAX_PHASES 24
+
+// rdtsc taken by the first instructions of 'loader' (loader.s)
+extern uint64_t boot_loader_tsc;
+
+// Mark the end of boot phase 'name' (a string literal); the phase started
+// at the previous mark, or at the loader entry for the first one
+void boot_phase(const char *name);
+
+// Phase table for the 'boottime' shell command
+void boottime_print();
+
+// Headless check ("boottime" on the kernel command line): one line per phase
+// and the total on COM1, then exit QEMU. Never returns.
+void boottime_report_exit();
+
+#endif
@@ -0,0 +1,79 @@
+// command.h - Shell command registry: hashed by name, filled from a linker section and at run time
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include "common.h"
+
+#define COMMAND_MAX_ARGS 16
+#define COMMAND_HASH_BUCKETS 256 // Power of two; chains stay short well past a few hundred commands
+
+typedef void (*command_fn_t)(int argc, char **argv);
+
+// One command. 'usage' lists the arguments ("" if none), 'help' is a
+// one-line description. The registry links entries in place (no copies),
+// so an entry belongs to one table and must outlive it.
+struct command
+{
+    const char *name;
+    const char *usage;
+    const char *help;
+    command_fn_t fn;
+    uint32_t hash;               // Set on registration
+    struct command *hash_next;   // Bucket chain
+    struct command *sorted_next; // Alphabetical list for 'help'
+};
+
+struct command_table
+{
+    struct command *buckets[COMMAND_HASH_BUCKETS];
+    struct command *sorted;
+    uint32_t count;
+};
+
+// Define a shell command and register it through the 'commands' section
+// (link.ld), the same way BENCHMARK does for benchmarks:
+//
+//     COMMAND(uptime, "", "Show time since boot")
+//     {
+//         ...argc/argv as in C; argv[0] is the command name
+//     }
+//
+// The section name is a C identifier so hosted links provide
+// __start_commands/__stop_commands as well.
+#define COMMAND(id, usage, help)                                                                        \
+    static void command_fn_##id(int argc __attribute__((unused)), char **argv __attribute__((unused))); \
+    static struct command command_entry_##id __attribute__((used, section("commands"), aligned(4))) = { \
+        #id, usage, help, command_fn_##id, 0, NULL, NULL};                                              \
+    static void command_fn_##id(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+
+// FNV-1a of a NUL-terminated name
+uint32_t command_hash(const char *name);
+
+// Add 'cmd' to 'table'. Returns -1 if a command of that name is already there.
+int command_table_add(struct command_table *table, struct command *cmd);
+
+// Command called 'name', or NULL
+struct command *command_table_find(const struct command_table *table, const char *name);
+
+// Register every COMMAND() entry in the shell's table (once, from shell_init)
+void command_init();
+
+// Add a command to the shell at run time (e.g. from a driver); -1 on a duplicate name
+int command_register(struct command *cmd);
+
+// Shell command called 'name', or NULL
+struct command *command_find(const char *name);
+
+// Split 'line' in place into at most 'max_args' words (further words are
+// ignored): the space after a word is overwritten with NUL, and a word in
+// double quotes may contain spaces. 'argv' points into 'line'; nothing is
+// copied. Returns the word count.
+int command_tokenize(char *line, char **argv, int max_args);
+
+// 'help': every command with its usage and description, or one command
+void command_print_help(const char *name);
+
+// 'bench dispatch': lookup cost against table size, hashed and linear
+void command_benchmark();
+
+#endif
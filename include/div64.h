@@ -0,0 +1,26 @@
+// div64.h - 64-by-32-bit division without libgcc (freestanding build has no __udivdi3)
+#ifndef DIV64_H
+#define DIV64_H
+
+#include "common.h"
+
+// Divide n by d, optionally storing the remainder. Two 'divl' steps keep every
+// partial quotient within 32 bits.
+static inline uint64_t div64_u32(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t high = (uint32_t)(n >> 32);
+    uint32_t low = (uint32_t)n;
+    uint32_t q_high = 0, q_low, r;
+
+    if (high >= d)
+    {
+        q_high = high / d;
+        high = high % d;
+    }
+    asm("divl %4" : "=a"(q_low), "=d"(r) : "a"(low), "d"(high), "rm"(d));
+    if (rem)
+        *rem = r;
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
+#endif
@@ -27,6 +27,12 @@
 #define FB_COLS 80
 #define FB_ROWS 25
 
+// Lines kept per virtual terminal (visible window + scrollback)
+#define FB_SCROLLBACK_LINES 400
+
+// Number of virtual terminals (Alt+F1..F4)
+#define FB_VT_COUNT 4
+
 // Write a character with specified colors to linear position i
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg);
 
@@ -36,10 +42,29 @@ void fb_move_cursor(unsigned short row, unsigned short col);
 // Write a character with specified colors at the current cursor position and advance the cursor (handles scrolling simply).
 void fb_write_cell_at_cursor(char c, unsigned char fg, unsigned char bg);
 
-// Write a null-terminated string to the framebuffer starting at the cursor
+// Write a null-terminated string to the framebuffer starting at the cursor (flushes)
 void fb_write_string(const char *str, unsigned char fg, unsigned char bg);
 
-// Clear the framebuffer
+// Writes go to the active terminal's line ring in RAM. Copy the visible rows
+// changed since the last flush to VGA memory and move the hardware cursor.
+void fb_flush();
+
+// Scroll the view back (positive) or forward (negative) through the history.
+// Any new output returns the view to the live window.
+void fb_scroll_view(int lines);
+
+// Show virtual terminal 'index' (0..FB_VT_COUNT-1); output goes to the shown terminal
+void fb_switch_vt(unsigned int index);
+unsigned int fb_active_vt();
+
+// Called with every character written at the cursor (e.g. to mirror the
+// console on a serial port). NULL disables mirroring.
+void fb_set_output_hook(void (*hook)(char c));
+
+// Console throughput benchmark: the original per-character driver vs shadow-buffered output
+void fb_benchmark();
+
+// Clear the visible window of the active terminal
 void fb_clear();
 
 // Get current cursor position
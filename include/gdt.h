@@ -4,6 +4,13 @@
 
 #include "common.h"
 
+// Selectors: flat kernel code/data, then this CPU's per-CPU segment and TSS
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_PERCPU 0x18 // Loaded into %gs; based at the CPU's struct cpu (see percpu.h)
+#define GDT_TSS 0x20
+#define GDT_ENTRIES 5
+
 struct gdt_entry
 {
     uint16_t limit_low;
@@ -20,6 +27,26 @@ struct gdt_ptr
     uint32_t base;
 } __attribute__((packed));
 
+// 32-bit task state segment. Only esp0/ss0 matter until there is a ring 3.
+struct tss
+{
+    uint32_t prev_task;
+    uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+// Build and load the boot CPU's GDT (per-CPU segment and TSS included)
 void gdt_init();
 
-#endif
\ No newline at end of file
+// Build 'gdt' for one CPU: flat kernel segments, a per-CPU data segment
+// covering [percpu, percpu + percpu_size) and a TSS whose ring 0 stack is
+// 'stack_top'. Then load it on the calling CPU, including %gs and the task register.
+void gdt_load_cpu(struct gdt_entry *gdt, struct gdt_ptr *ptr, struct tss *tss, uint32_t percpu,
+                  uint32_t percpu_size, uint32_t stack_top);
+
+#endif
@@ -19,15 +19,28 @@ struct idt_ptr
     uint32_t base;
 } __attribute__((packed));
 
-// Declare ISR stubs (implemented in assembly: idt_asm.s)
-// We only declare the ones we'll use initially
-extern void isr0(); // Divide by zero exception
-// ... add more 'extern void isrN();' lines for other CPU exceptions if you handle them
-extern void irq0(); // Timer interrupt (IRQ 0)
-extern void irq1(); // Keyboard interrupt (IRQ 1)
-// ... add more 'extern void irqN();' lines for other hardware interrupts
+// Exception vectors 0-31, then the IRQ slots from 32: the 16 ISA lines
+// (8259 or I/O APIC), I/O APIC GSIs 16-23, the local APIC timer and the
+// wakeup IPI
+#define IDT_EXCEPTION_COUNT 32
+#define IDT_IRQ_COUNT 26
+#define IDT_IRQ_BASE 32
+
+// Stub addresses (implemented in assembly: idt_asm.s)
+extern uint32_t isr_stub_table[IDT_EXCEPTION_COUNT]; // isr0..isr31, by vector
+extern uint32_t irq_stub_table[IDT_IRQ_COUNT];       // irq0..irq25, by IRQ slot
+extern void apic_spurious_stub();                    // Bare iret for the LAPIC spurious vector
 
 // Function to initialize the IDT and PIC
 void idt_init();
 
+// Load the IDT built by idt_init on the calling CPU (application processors)
+void idt_load_cpu();
+
+// Mask or unmask one PIC line (0-15). Unmasking a slave line also unmasks the cascade.
+void pic_set_mask(uint8_t irq, int masked);
+
+// Mask every 8259 line (the I/O APIC takes over)
+void pic_disable();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+// initrd.h - Read-only filesystem over a tar archive loaded by GRUB as a Multiboot module
+#ifndef INITRD_H
+#define INITRD_H
+
+#include "common.h"
+#include "multiboot.h"
+
+#define INITRD_BLOCK 512 // tar header and data alignment
+
+#define INITRD_FILE 0
+#define INITRD_DIR 1
+
+// Errors from initrd_index and initrd_init
+#define INITRD_NO_MEMORY -1 // No memory for the index
+#define INITRD_NO_MODULE -2 // GRUB loaded no module
+
+// One archive member. 'data' points into the module itself: reads never copy.
+// Paths have no leading "./" or "/" and no trailing "/" ("etc/motd").
+struct initrd_file
+{
+    const char *path;
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t type; // INITRD_FILE or INITRD_DIR
+    uint32_t mode; // Permission bits from the header
+    uint32_t mtime;
+    uint32_t hash;
+    struct initrd_file *hash_next;
+};
+
+// Index over one archive: members in archive order plus a hash table by path
+struct initrd
+{
+    const uint8_t *base;
+    uint32_t size;
+    struct initrd_file *files;
+    uint32_t count;
+    struct initrd_file **buckets;
+    uint32_t bucket_mask;
+    char *paths; // Normalized paths, one allocation
+};
+
+// Parse a ustar archive at 'archive' into 'fs' (the archive stays where it
+// is). Headers with a bad checksum end the archive. Returns the member count,
+// or INITRD_NO_MEMORY if memory for the index runs out.
+int initrd_index(struct initrd *fs, const void *archive, uint32_t size);
+void initrd_free(struct initrd *fs);
+
+// Member of 'fs' at 'path' ("/etc/motd", "etc/motd/" and "etc/motd" are the same), or NULL
+const struct initrd_file *initrd_lookup(const struct initrd *fs, const char *path);
+
+// Index the first Multiboot module as the root filesystem (after kheap_init;
+// pmm_init keeps the modules out of the frame allocator). Returns the member
+// count, INITRD_NO_MODULE if GRUB loaded no archive or INITRD_NO_MEMORY.
+int initrd_init(multiboot_info_t *mb_info);
+
+// Root filesystem member at 'path', or NULL
+const struct initrd_file *initrd_find(const char *path);
+
+// Zero-copy read: points '*data' at byte 'offset' of 'file' and returns how
+// many bytes follow it (0 at or past the end)
+uint32_t initrd_read(const struct initrd_file *file, uint32_t offset, const uint8_t **data);
+
+// 'bench initrd': index, lookup and read cost against archives of up to thousands of members
+void initrd_benchmark();
+
+#endif
@@ -0,0 +1,71 @@
+// interrupts.h - C level interrupt handler interface
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include "common.h"
+
+// Number of vectors with stubs: 32 exceptions + 26 IRQ slots
+#define INTERRUPT_VECTORS 58
+
+// Handlers get the register state saved by the stub
+typedef void (*interrupt_handler_t)(registers_t *regs);
+
+// Entry points called from the assembly stubs in idt_asm.s
+void isr_handler(registers_t *regs);
+void irq_handler(registers_t *regs);
+
+// Install the handler for IRQ slot 'irq' and unmask the line: ISA IRQs 0-15
+// on the 8259 or I/O APIC, 16-24 in APIC mode only (see apic.h).
+// irq_handler sends the EOI before calling it.
+void register_irq_handler(uint8_t irq, interrupt_handler_t handler);
+
+// Called by apic_init with interrupts off: acknowledge through the local APIC
+// from now on and unmask every registered line on the I/O APIC
+void interrupts_use_apic();
+
+// Install the handler for CPU exception 'vector' (0-31). Exceptions without
+// one are reported and halt the machine.
+void register_exception_handler(uint8_t vector, interrupt_handler_t handler);
+
+// Times 'vector' was raised since boot (spurious IRQ 7/15 are not counted)
+uint32_t interrupt_hits(uint8_t vector);
+
+// Spurious IRQ 7 / IRQ 15 seen since boot
+uint32_t irq_spurious_count();
+
+// Human-readable name of an exception vector (0-31) or IRQ vector (32-57)
+const char *interrupt_name(uint8_t vector);
+
+// Per-vector cycle accounting (see irq_set_timing)
+#define IRQ_HIST_BUCKETS 20 // Bucket b counts samples in [2^b, 2^(b+1)) cycles; the last is open-ended
+
+struct irq_cycle_stats
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[IRQ_HIST_BUCKETS];
+};
+
+// Kernel-mode IRQs skip the segment register save/reload (default on)
+void irq_set_fast_entry(int enable);
+int irq_fast_entry_enabled();
+
+// Record stub-entry-to-EOI and handler-body cycles for every IRQ (default off)
+void irq_set_timing(int enable);
+int irq_timing_enabled();
+void irq_get_timing(uint8_t vector, struct irq_cycle_stats *entry, struct irq_cycle_stats *body);
+void irq_reset_timing();
+
+// Round-trip cost of a software-raised IRQ through the fast and slow entry paths
+void irq_benchmark();
+
+// Longest irq_handler run (interrupts disabled) in TSC cycles, and reset
+uint32_t irq_max_disabled_cycles();
+void irq_reset_max_disabled_cycles();
+
+// Cycle benchmark of the EOI + cursor-update port writes, inline vs out-of-line outb
+void io_benchmark();
+
+#endif
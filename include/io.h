@@ -1,9 +1,75 @@
-// io.h - Basic I/O functions declarations
+// io.h - Port I/O primitives (inline, so each access is a single in/out instruction)
 #ifndef IO_H
 #define IO_H
 
-void outb(unsigned short port, unsigned char data);
+#include "common.h"
 
-unsigned char inb(unsigned short port);
+static inline void outb(uint16_t port, uint8_t data)
+{
+    asm volatile("outb %0, %1" : : "a"(data), "Nd"(port));
+}
 
-#endif
\ No newline at end of file
+static inline void outw(uint16_t port, uint16_t data)
+{
+    asm volatile("outw %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline void outl(uint16_t port, uint32_t data)
+{
+    asm volatile("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+    uint8_t data;
+    asm volatile("inb %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+static inline uint16_t inw(uint16_t port)
+{
+    uint16_t data;
+    asm volatile("inw %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+static inline uint32_t inl(uint16_t port)
+{
+    uint32_t data;
+    asm volatile("inl %1, %0" : "=a"(data) : "Nd"(port));
+    return data;
+}
+
+// Block transfers (rep ins/outs) for device data registers, e.g. ATA PIO or NICs.
+// The "memory" clobber keeps the compiler from moving buffer accesses across them.
+static inline void insw(uint16_t port, void *buffer, uint32_t count)
+{
+    asm volatile("cld; rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void *buffer, uint32_t count)
+{
+    asm volatile("cld; rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void insl(uint16_t port, void *buffer, uint32_t count)
+{
+    asm volatile("cld; rep insl" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsl(uint16_t port, const void *buffer, uint32_t count)
+{
+    asm volatile("cld; rep outsl" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+// Short delay for old devices (e.g. the 8259 during init): write to unused port 0x80
+static inline void io_wait()
+{
+    outb(0x80, 0);
+}
+
+// Out-of-line cdecl versions (io.s), kept only as the baseline for 'bench io'
+void outb_call(unsigned short port, unsigned char data);
+unsigned char inb_call(unsigned short port);
+
+#endif
@@ -0,0 +1,62 @@
+// keyboard.h - PS/2 keyboard: IRQ-side scancode ring and deferred decoding
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include "common.h"
+
+// Scancode ring size (power of two)
+#define KBD_RING_SIZE 256
+
+// Key codes above ASCII for keys without a character
+#define KEY_F1 0x81
+#define KEY_F2 0x82
+#define KEY_F3 0x83
+#define KEY_F4 0x84
+#define KEY_F5 0x85
+#define KEY_F6 0x86
+#define KEY_F7 0x87
+#define KEY_F8 0x88
+#define KEY_F9 0x89
+#define KEY_F10 0x8A
+#define KEY_F11 0x8B
+#define KEY_F12 0x8C
+#define KEY_HOME 0x90
+#define KEY_END 0x91
+#define KEY_PGUP 0x92
+#define KEY_PGDN 0x93
+#define KEY_UP 0x94
+#define KEY_DOWN 0x95
+#define KEY_LEFT 0x96
+#define KEY_RIGHT 0x97
+#define KEY_INS 0x98
+#define KEY_DEL 0x99
+
+// Modifier bits OR'ed into the key codes above
+#define KEY_MOD_SHIFT 0x100
+#define KEY_MOD_CTRL 0x200
+#define KEY_MOD_ALT 0x400
+
+// Install the IRQ 1 handler, which only reads one scancode and queues it
+void keyboard_init();
+
+// Queue a scancode the 8042 is still holding because its IRQ 1 edge was lost
+// (ICW1 in pic_remap, the switch to the I/O APIC)
+void keyboard_rearm();
+
+// Decode queued scancodes (outside IRQ context). Returns the next character
+// (ASCII, or a KEY_* code plus KEY_MOD_* bits), or -1 once the ring is empty.
+int keyboard_getchar();
+
+// Non-zero if scancodes are waiting to be decoded
+int keyboard_has_input();
+
+// Scancodes queued since boot and dropped because the ring was full
+uint32_t keyboard_received_count();
+uint32_t keyboard_dropped_count();
+
+// 'bench kbd': interrupts-off time per scancode with decoding, echo and
+// command execution inside IRQ 1 (as before the ring) and with the IRQ only
+// queueing. Types a command into the shell, which runs it.
+void keyboard_benchmark();
+
+#endif
@@ -0,0 +1,48 @@
+// kheap.h - Kernel heap: slab caches for small objects, whole pages for large ones
+#ifndef KHEAP_H
+#define KHEAP_H
+
+#include "common.h"
+
+// Slab caches cover 16..2048 bytes in powers of two
+#define KHEAP_MIN_SIZE 16
+#define KHEAP_MAX_SIZE 2048
+#define KHEAP_CACHE_COUNT 8
+
+// Per-cache usage, reported by kmemstat
+struct kheap_cache_stats
+{
+    uint32_t object_size;
+    uint32_t slab_pages;  // Pages per slab
+    uint32_t slabs;       // Slabs currently owned by the cache
+    uint32_t objects_in_use;
+    uint32_t objects_total; // Capacity of all slabs
+    uint32_t alloc_count;
+    uint32_t free_count;
+};
+
+// Usage of the large-object (whole page) path
+struct kheap_large_stats
+{
+    uint32_t pages_in_use;
+    uint32_t bytes_requested;
+    uint32_t alloc_count;
+    uint32_t free_count;
+};
+
+// Set up the size caches (needs the frame allocator)
+void kheap_init();
+
+// Allocate/free kernel memory. kmalloc returns NULL when out of memory.
+void *kmalloc(size_t size);
+void *kzalloc(size_t size);
+void kfree(void *ptr);
+
+// Usage statistics for cache 'index' (0..KHEAP_CACHE_COUNT-1) and the large path
+void kheap_get_cache_stats(int index, struct kheap_cache_stats *stats);
+void kheap_get_large_stats(struct kheap_large_stats *stats);
+
+// Random alloc/free stress benchmark (prints cycles per operation)
+void kheap_benchmark();
+
+#endif
@@ -0,0 +1,43 @@
+// klog.h - kprintf formatter and lock-free kernel log ring
+#ifndef KLOG_H
+#define KLOG_H
+
+#include "common.h"
+#include "stdarg.h"
+
+// Severity levels (lower is more severe)
+#define KLOG_ERR 0
+#define KLOG_WARN 1
+#define KLOG_INFO 2
+#define KLOG_DEBUG 3
+
+// Ring geometry: fixed-size records, a power-of-two count
+#define KLOG_RECORD_COUNT 256
+#define KLOG_MSG_LEN 112
+
+// Format into 'buf' (always NUL-terminated if size > 0). Supports %d %i %u
+// %x %X %p %s %c %%, the l/ll length modifiers, '-' and '0' flags and a field
+// width. Returns the length the full output would have had.
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap);
+int ksnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// Append a timestamped record to the log ring. Never blocks and never touches
+// an output device, so it is safe from IRQ context. Messages longer than
+// KLOG_MSG_LEN - 1 are truncated.
+void klog(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void kvlog(int level, const char *fmt, va_list ap);
+
+// klog at KLOG_INFO
+void kprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Print records not yet shown (up to the console level) on the console.
+// Called from the shell loop, outside interrupt context.
+void klog_drain();
+
+// Records at or below this level are drained to the console (default KLOG_INFO)
+void klog_set_console_level(int level);
+
+// Replay every record still held in the ring, whatever its level
+void klog_dmesg();
+
+#endif
@@ -0,0 +1,30 @@
+// ksyms.h - Kernel symbol table embedded at link time (address -> function name)
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include "common.h"
+
+// One function: start address and offset of its name in ksym_names
+struct ksym
+{
+    uint32_t addr;
+    uint32_t name;
+};
+
+// Generated by tools/ksyms.awk from the first link pass and placed in the
+// .ksyms section, between .data and .bss, so adding it moves no code.
+// ksym_table is sorted by address and has one extra entry at the end of .text.
+extern const uint32_t ksym_count;
+extern const struct ksym ksym_table[];
+extern const char ksym_names[];
+
+// Index of the function containing 'addr', -1 if it is not kernel text
+int ksym_find(uint32_t addr);
+
+// Name of function 'index' (from ksym_find)
+const char *ksym_name(int index);
+
+// Name of the function containing 'addr' and the offset into it, or NULL
+const char *ksym_lookup(uint32_t addr, uint32_t *offset);
+
+#endif
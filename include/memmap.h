@@ -0,0 +1,49 @@
+// memmap.h - Physical memory map: the Multiboot map sorted, overlap-resolved and merged once at boot
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include "common.h"
+#include "multiboot.h"
+
+#define MEMMAP_MAX_ENTRIES 64                           // Raw Multiboot entries kept; the rest are dropped
+#define MEMMAP_MAX_REGIONS (2 * MEMMAP_MAX_ENTRIES - 1) // Worst case after splitting overlaps
+
+#define MEMMAP_4GIB 0x100000000ULL // Above here memory needs PAE, which the kernel does not use
+
+// One run of physical memory of a single type. Types are Multiboot's
+// (MULTIBOOT_MEMORY_*); types the spec does not define count as reserved.
+// Regions are sorted, never overlap, and neighbours of the same type are merged.
+struct memmap_region
+{
+    uint64_t start;
+    uint64_t end; // Exclusive
+    uint32_t type;
+};
+
+// Build the region table from the Multiboot memory map (call once at boot,
+// before pmm_init and paging_init). Where entries overlap, the higher type
+// wins, so available RAM never covers anything the firmware reserved.
+void memmap_init(multiboot_info_t *mb_info);
+
+// Number of regions, and region 'index' in address order
+uint32_t memmap_count();
+const struct memmap_region *memmap_get(uint32_t index);
+
+// Region containing physical address 'addr', or NULL for a hole (binary search)
+const struct memmap_region *memmap_find(uint64_t addr);
+
+// Bytes of type 'type' between 'start' and 'end'
+uint64_t memmap_total(uint32_t type, uint64_t start, uint64_t end);
+
+// "available", "reserved", "ACPI", "ACPI NVS" or "bad"
+const char *memmap_type_name(uint32_t type);
+
+// Region table and totals for 'meminfo'
+void memmap_print();
+
+// Headless check ("memmap" on the kernel command line): the regions and
+// totals on COM1, then exit QEMU with the result of a consistency check.
+// Never returns.
+void memmap_report_exit();
+
+#endif
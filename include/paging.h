@@ -0,0 +1,42 @@
+// paging.h - Page directory/table management (32-bit, non-PAE)
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "common.h"
+#include "multiboot.h"
+
+// Page directory/table entry flags
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITE 0x002
+#define PAGE_USER 0x004
+#define PAGE_WRITETHROUGH 0x008
+#define PAGE_NOCACHE 0x010
+#define PAGE_LARGE 0x080 // PDE maps a 4 MiB page (needs CR4.PSE)
+#define PAGE_GLOBAL 0x100
+
+#define LARGE_PAGE_SIZE 0x00400000
+
+// Flags for memory-mapped device registers
+#define PAGE_MMIO (PAGE_PRESENT | PAGE_WRITE | PAGE_NOCACHE | PAGE_WRITETHROUGH)
+
+// Build the kernel page directory and turn paging on (after memmap_init)
+void paging_init();
+
+// Map/unmap a single 4 KiB page and invalidate its TLB entry. Returns 0 on success.
+int paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags);
+void paging_unmap_page(uint32_t virt);
+
+// Map/unmap a range of 4 KiB pages; TLB invalidations are batched and issued once at the end
+int paging_map_range(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags);
+void paging_unmap_range(uint32_t virt, uint32_t size);
+
+// Physical address behind a virtual address, or 0 if it is not mapped
+uint32_t paging_get_phys(uint32_t virt);
+
+// Top of the identity-mapped physical memory (all RAM below this is reachable)
+uint32_t paging_direct_map_end();
+
+// Exception 14 handler, installed by paging_init: reports CR2 and halts
+void page_fault_handler(registers_t *regs);
+
+#endif
@@ -0,0 +1,49 @@
+// percpu.h - Per-CPU data reached through the %gs segment
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include "common.h"
+#include "gdt.h"
+
+#define SMP_MAX_CPUS 16
+
+// One per CPU. %gs is based at the owning CPU's entry, so %gs:0 is always
+// "this CPU" without knowing which CPU the code runs on.
+struct cpu
+{
+    struct cpu *self; // Must stay first: this_cpu() loads %gs:0
+    uint32_t index;   // 0 = boot CPU, then in MADT order
+    uint8_t apic_id;
+    uint8_t reserved[3];
+    volatile uint32_t online;
+    uint32_t stack_top;
+    volatile uint32_t irq_count; // Hardware interrupts handled on this CPU
+    volatile uint64_t irq_entry_tsc; // Stub-entry TSC of the IRQ being timed (written by idt_asm.s)
+    struct gdt_entry gdt[GDT_ENTRIES];
+    struct gdt_ptr gdt_ptr;
+    struct tss tss;
+};
+
+// idt_asm.s stores to irq_entry_tsc at this fixed offset (CPU_IRQ_ENTRY_TSC)
+_Static_assert(__builtin_offsetof(struct cpu, irq_entry_tsc) == 24, "idt_asm.s: CPU_IRQ_ENTRY_TSC");
+
+extern struct cpu cpus[SMP_MAX_CPUS];
+
+static inline struct cpu *this_cpu()
+{
+    struct cpu *cpu;
+    asm("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Single-instruction accessors for 32-bit fields: no pointer load first, and
+// an increment cannot be torn by an interrupt on the same CPU
+#define this_cpu_read(field)                                                                  \
+    ({                                                                                        \
+        uint32_t value_;                                                                      \
+        asm volatile("movl %%gs:%c1, %0" : "=r"(value_) : "i"(__builtin_offsetof(struct cpu, field))); \
+        value_;                                                                               \
+    })
+#define this_cpu_inc(field) asm volatile("incl %%gs:%c0" : : "i"(__builtin_offsetof(struct cpu, field)) : "memory")
+
+#endif
@@ -0,0 +1,48 @@
+// pmm.h - Physical page-frame allocator (buddy system)
+#ifndef PMM_H
+#define PMM_H
+
+#include "common.h"
+#include "multiboot.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+
+// Largest block handed out is 2^PMM_MAX_ORDER pages (order 10 = 4 MiB)
+#define PMM_MAX_ORDER 10
+
+// Counters reported by meminfo
+struct pmm_stats
+{
+    uint32_t total_frames; // Frames that were free after boot reservations
+    uint32_t free_frames;  // Frames currently free
+    uint32_t alloc_count;  // Successful allocations (any order)
+    uint32_t free_count;   // Blocks returned
+    uint32_t failed_count; // Allocations that could not be satisfied
+    uint32_t free_blocks[PMM_MAX_ORDER + 1]; // Free blocks per order
+};
+
+// Build the free lists from the memory region index (call once at boot,
+// after memmap_init); 'mb_info' is kept out of the allocator
+void pmm_init(multiboot_info_t *mb_info);
+
+// Allocate/free a single 4 KiB frame. Returns the physical address, 0 on failure.
+uint32_t pmm_alloc_page();
+void pmm_free_page(uint32_t addr);
+
+// Allocate/free 2^order physically contiguous frames, aligned to their size
+uint32_t pmm_alloc_pages(unsigned int order);
+void pmm_free_pages(uint32_t addr, unsigned int order);
+
+// Tag every frame of an allocated block with an owner value, and read it back
+// for any address inside the block (used to find a slab from an object pointer)
+void pmm_set_owner(uint32_t addr, unsigned int order, uint32_t owner);
+uint32_t pmm_get_owner(uint32_t addr);
+
+// Snapshot of the allocator counters
+void pmm_get_stats(struct pmm_stats *stats);
+
+// rdtsc microbenchmark of alloc/free throughput (prints its results)
+void pmm_benchmark();
+
+#endif
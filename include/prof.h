@@ -0,0 +1,31 @@
+// prof.h - Timer-driven sampling profiler with symbolized and folded-stack reports
+#ifndef PROF_H
+#define PROF_H
+
+#include "common.h"
+
+#define PROF_DEFAULT_HZ 997    // Sampling rate on the LAPIC timer (prime: does not beat with 100 Hz ticks)
+#define PROF_MAX_DEPTH 15      // Interrupted eip plus up to 14 return addresses
+#define PROF_BUFFER_ORDER 6    // 256 KiB of samples per CPU (4096 samples)
+#define PROF_STACK_SPAN 16384  // Frame pointers further than this above the interrupted esp are not followed
+#define PROF_DEFAULT_TOP 15
+
+// Start sampling every online CPU at 'hz' (0 = PROF_DEFAULT_HZ). Without a
+// local APIC the PIT tick is used and 'hz' is ignored. Earlier samples are
+// discarded. Returns -1 if the sample buffers cannot be allocated.
+int prof_start(uint32_t hz);
+void prof_stop();
+int prof_running();
+
+// Called by irq_handler for every IRQ: records a sample on the profiling tick
+void prof_interrupt(uint32_t irq, registers_t *regs);
+
+// Per-CPU sample counts, then the 'top' functions by samples in the function
+// itself (self) and anywhere on the stack (total)
+void prof_report(uint32_t top);
+
+// Write every sample to COM1 as folded stacks ("root;caller;leaf count"),
+// between PROF-BEGIN and PROF-END lines, for flamegraph.pl and similar tools
+void prof_export_folded();
+
+#endif
@@ -0,0 +1,41 @@
+// serial.h - 16550 UART (COM1) console with interrupt-driven TX/RX rings
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "common.h"
+
+#define SERIAL_COM1_BASE 0x3F8
+#define SERIAL_BAUD 115200
+
+// Ring sizes (powers of two)
+#define SERIAL_TX_RING_SIZE 4096
+#define SERIAL_RX_RING_SIZE 256
+
+// Program COM1 (FIFO on, 8N1 at SERIAL_BAUD) and install the IRQ 4 handler,
+// which drains the RX FIFO and refills the TX FIFO.
+// Returns 0 if a UART answered the loopback test, -1 if none is present.
+int serial_init();
+
+// Service anything the UART raised while its IRQ edge could be lost (ICW1 in
+// pic_remap, the switch to the I/O APIC) and rearm the TX-empty interrupt
+void serial_rearm();
+
+// Non-zero once serial_init found a UART
+int serial_present();
+
+// Queue one character ('\n' is sent as "\r\n"). Waits for IRQ 4 to make
+// room if the ring is full, or polls the UART when interrupts are disabled.
+void serial_putc(char c);
+void serial_write(const char *str);
+
+// Wait until every queued byte has left the UART (e.g. before powering off)
+void serial_flush();
+
+// Next received byte, -1 if none is waiting
+int serial_getchar();
+int serial_has_input();
+
+// Bytes dropped because the RX ring was full
+uint32_t serial_rx_dropped();
+
+#endif
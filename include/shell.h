@@ -9,13 +9,19 @@
 // Initialize shell state (e.g., clear buffer)
 void shell_init();
 
-// Start the shell (e.g., show prompt, enter loop or wait state)
+// Start the shell: show the prompt, then decode and handle input forever
 void shell_run();
 
-// Executes a command string (called by keyboard handler)
-void run_shell_command(const char *command);
+// Feed one decoded input character to the line editor (echo, backspace, Enter)
+void shell_input_char(char c);
 
-// Clears the internal command buffer (called by keyboard handler)
+// Feed one decoded key (character or KEY_* code): also handles scrollback and VT switching
+void shell_input_key(int key);
+
+// Executes a command line (called when Enter is pressed); the line is tokenized in place
+void run_shell_command(char *command);
+
+// Clears the internal command buffer
 void clear_cmd_buffer();
 
 // Declare utility functions defined in shell.c if needed elsewhere
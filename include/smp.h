@@ -0,0 +1,22 @@
+// smp.h - Application processor startup (INIT-SIPI-SIPI) and CPU enumeration
+#ifndef SMP_H
+#define SMP_H
+
+#include "common.h"
+#include "percpu.h"
+
+// Physical page the real-mode trampoline is copied to (SIPI vector 0x08)
+#define SMP_TRAMPOLINE_BASE 0x8000
+#define SMP_AP_STACK_ORDER 2 // 16 KiB kernel stack per application processor
+
+// Start every enabled processor listed in the MADT. Needs apic_init.
+// Returns the number of CPUs online afterwards (1 if none could be started).
+int smp_init();
+
+// CPUs online (boot CPU included)
+int smp_cpu_count();
+
+// Print one line per CPU for the 'cpus' shell command
+void smp_print_cpus();
+
+#endif
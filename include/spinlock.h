@@ -0,0 +1,34 @@
+// spinlock.h - Test-and-test-and-set spinlock that also keeps interrupts off on the holding CPU
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "common.h"
+#include "cpu.h"
+
+// Zero-initialized means unlocked
+struct spinlock
+{
+    volatile uint32_t locked;
+};
+
+// Disable interrupts, then take 'lock'. Interrupts stay off while it is held,
+// so an IRQ or a preempting thread on this CPU can never spin on it.
+// Returns the EFLAGS to pass to spin_unlock_irqrestore().
+static inline uint32_t spin_lock_irqsave(struct spinlock *lock)
+{
+    uint32_t flags = irq_save();
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+            asm volatile("pause");
+    }
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock *lock, uint32_t flags)
+{
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+    irq_restore(flags);
+}
+
+#endif
@@ -1,9 +1,31 @@
-// string.h - Basic string/memory function declarations for freestanding
+// string.h - Freestanding string and memory functions
 #ifndef STRING_H
 #define STRING_H
 
 #include "common.h"
 
+// Copies of at least this many bytes use SSE2 when the CPU has it
+#define MEM_SSE2_THRESHOLD 512
+
+// Pick the memset/memcpy variants for this CPU (enables SSE if present)
+void string_init();
+
+// Non-zero if memcpy/memset use the SSE2 paths for large blocks
+int string_have_sse2();
+
 void *memset(void *s, int c, size_t n);
+void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
+
+// Fill 'count' 16-bit words (e.g. VGA cells) with 'value'
+void *memsetw(void *s, uint16_t value, size_t count);
+
+size_t strlen(const char *s);
+int strcmp(const char *s1, const char *s2);
+int strncmp(const char *s1, const char *s2, size_t n);
+
+// Sweep block sizes from 8 bytes to 1 MiB and report bytes/cycle per variant
+void mem_benchmark();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,78 @@
+// thread.h - Preemptive kernel threads with an O(1) priority-bitmap scheduler
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "common.h"
+
+// Priority 0 is the most urgent; the shell runs at THREAD_PRIORITY_DEFAULT
+#define THREAD_PRIORITIES 32
+#define THREAD_PRIORITY_DEFAULT 16
+#define THREAD_TIMESLICE_TICKS 10 // Round-robin quantum among equal priorities
+#define THREAD_STACK_ORDER 1      // 8 KiB kernel stack per thread
+#define THREAD_NAME_LEN 16
+
+enum thread_state
+{
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_SLEEPING,   // thread_sleep
+    THREAD_BLOCKED,    // thread_join
+    THREAD_WAIT_IRQ,   // thread_wait_interrupt
+    THREAD_DEAD,       // Returned from its entry point, waiting to be joined
+};
+
+struct thread
+{
+    uint32_t esp; // Saved stack pointer while switched out (context_switch)
+    uint32_t tid;
+    enum thread_state state;
+    uint32_t priority;
+    char name[THREAD_NAME_LEN];
+
+    void (*entry)(void *arg);
+    void *arg;
+    uint32_t stack; // Base of the stack frames, 0 for the boot thread
+
+    uint64_t cycles;   // TSC cycles spent running
+    uint32_t switches; // Times switched in
+    uint64_t wake_tick;
+
+    struct thread *next;   // Run queue / sleep list / wait list link
+    struct thread *joiner; // Thread blocked in thread_join on this one
+    struct thread *all_next;
+};
+
+// Adopt the calling context (kmain/shell) as the first thread and create the idle thread
+void thread_init();
+
+// Start 'entry(arg)' in a new thread. Returns NULL if memory runs out.
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg, uint32_t priority);
+
+// Give up the CPU to the next ready thread of the same or higher priority
+void thread_yield();
+
+// Block for at least 'ms' milliseconds (rounded up to timer ticks)
+void thread_sleep(uint32_t ms);
+
+// Wait for 't' to return, then free it. Returns -1 if another thread is already joining.
+int thread_join(struct thread *t);
+
+// Running thread
+struct thread *thread_current();
+
+// Idle until the next interrupt. Called with interrupts disabled, returns with
+// them enabled. Other ready threads run in the meantime; without any the CPU
+// simply halts.
+void thread_wait_interrupt();
+
+// Scheduler hooks: IRQ 0 tick accounting, and the preemption point at the end of irq_handler
+void thread_tick();
+void thread_irq_exit();
+
+// 'ps' shell command: one line per thread with state, priority and CPU time
+void thread_print_list();
+
+// Cycles per context switch: two threads yielding to each other
+void thread_benchmark();
+
+#endif
@@ -0,0 +1,25 @@
+// timer.h - PIT tick source, TSC calibration and monotonic clock
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "common.h"
+
+#define TIMER_DEFAULT_HZ 1000
+
+// Program PIT channel 0 to 'hz' interrupts per second and calibrate the TSC
+void timer_init(uint32_t hz);
+
+// Timer interrupts since timer_init
+uint64_t ticks();
+
+// Nanoseconds since timer_init (TSC based, tick based without a TSC)
+uint64_t clock_ns();
+
+// Halt until at least 'ms' milliseconds have passed
+void sleep_ms(uint32_t ms);
+
+// Configured tick rate and calibrated TSC frequency (0 if there is no TSC)
+uint32_t timer_hz();
+uint32_t tsc_khz();
+
+#endif
@@ -0,0 +1,69 @@
+// trace.h - Static tracepoints and function-entry tracing into per-CPU rings of timestamped events
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common.h"
+
+#define TRACE_BUFFER_ORDER 4 // 64 KiB ring per CPU (4096 events); the oldest events are overwritten
+
+enum trace_event_id
+{
+    TRACE_NONE = 0,
+    TRACE_FUNC_ENTER,   // arg: function address (make trace builds only)
+    TRACE_FUNC_EXIT,    // arg: function address
+    TRACE_IRQ_ENTER,    // arg: IRQ slot
+    TRACE_IRQ_EXIT,     // arg: IRQ slot
+    TRACE_KBD_SCANCODE, // arg: scancode queued by the keyboard IRQ
+    TRACE_SHELL_INPUT,  // arg: character handed to the line editor
+    TRACE_FB_PUTC,      // arg: character written at the cursor
+    TRACE_SCHED_SWITCH, // arg: TID of the thread switched to
+    TRACE_SHELL_BEGIN,  // arg: command length
+    TRACE_SHELL_END,    // arg: command length
+    TRACE_EVENT_COUNT
+};
+
+// One event, 16 bytes. Dumped over serial as hex and decoded on the host
+// (tools/trace_decode.py), so the layout is part of the dump format.
+struct trace_record
+{
+    uint64_t tsc;
+    uint16_t event;
+    uint16_t cpu;
+    uint32_t arg;
+};
+
+// Non-zero while events are recorded; tested inline by every tracepoint
+extern volatile int trace_active;
+
+void trace_record_event(uint32_t event, uint32_t arg);
+
+// TRACE(event, arg): one load and a not-taken branch while tracing is off.
+// Building with -DNO_TRACEPOINTS (make TRACEPOINTS=0) removes them entirely.
+#ifdef NO_TRACEPOINTS
+#define TRACE(event, arg) \
+    do                    \
+    {                     \
+    } while (0)
+#else
+#define TRACE(event, arg)                                       \
+    do                                                          \
+    {                                                           \
+        if (__builtin_expect(trace_active, 0))                  \
+            trace_record_event((event), (uint32_t)(arg));       \
+    } while (0)
+#endif
+
+// Start recording on every online CPU, discarding earlier events.
+// Returns -1 if the rings cannot be allocated.
+int trace_enable();
+void trace_disable();
+void trace_clear();
+
+// State, per-CPU event counts and whether function tracing is built in
+void trace_print_status();
+
+// Stop tracing and write every buffered event to COM1 between TRACE-BEGIN
+// and TRACE-END lines, for tools/trace_decode.py
+void trace_dump();
+
+#endif
@@ -0,0 +1,28 @@
+// workpool.h - Work-stealing task pool (Chase-Lev deques) with parallel_for
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include "common.h"
+
+#define WORKPOOL_DEQUE_SIZE 256 // Tasks per worker deque (power of two)
+
+// Body of a parallel loop: handle indices [begin, end)
+typedef void (*parallel_fn_t)(uint32_t begin, uint32_t end, void *arg);
+
+// Run fn over [begin, end) split into pieces of at most 'grain' indices,
+// spread over every active worker (the caller is worker 0). Returns when all
+// pieces are done. With one CPU, or when called from inside a loop body,
+// fn runs inline over the whole range.
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, parallel_fn_t fn, void *arg);
+
+// Limit the workers taking part (1 = caller only); 0 means all online CPUs
+void workpool_set_workers(uint32_t count);
+uint32_t workpool_workers();
+
+// Application processor main loop: sleep until a loop is posted, then help. Never returns.
+void workpool_ap_main();
+
+// 'bench parfor': memory zeroing and checksum speedup for 1..N workers
+void workpool_benchmark();
+
+#endif
@@ -0,0 +1,230 @@
+// acpi.c - RSDP/RSDT discovery and MADT parsing for interrupt routing
+#include "acpi.h"
+#include "paging.h"
+#include "pmm.h" // For PAGE_SIZE
+#include "string.h"
+
+#define EBDA_SEGMENT_PTR 0x40E // BIOS data area word holding the EBDA segment
+#define EBDA_SCAN_LEN 1024
+#define BIOS_ROM_START 0xE0000
+#define BIOS_ROM_END 0x100000
+#define RSDP_ALIGN 16
+#define RSDP_V1_LEN 20
+
+// MADT entry types
+#define MADT_LOCAL_APIC 0
+#define MADT_IO_APIC 1
+#define MADT_INT_OVERRIDE 2
+#define MADT_LAPIC_ADDR_OVERRIDE 5
+
+#define MADT_FLAG_PCAT_COMPAT 0x1
+#define MADT_LAPIC_ENABLED 0x1
+
+struct acpi_rsdp
+{
+    char signature[8]; // "RSD PTR "
+    uint8_t checksum;  // Covers the first 20 bytes
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+struct acpi_madt
+{
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_entry_header
+{
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct madt_local_apic
+{
+    struct madt_entry_header header;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_io_apic
+{
+    struct madt_entry_header header;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_int_override
+{
+    struct madt_entry_header header;
+    uint8_t bus; // Always 0 (ISA)
+    uint8_t source_irq;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct madt_lapic_addr_override
+{
+    struct madt_entry_header header;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed));
+
+static struct acpi_sdt_header *rsdt = NULL;
+
+static uint8_t checksum(const void *data, uint32_t len)
+{
+    const uint8_t *bytes = data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++)
+        sum += bytes[i];
+    return sum;
+}
+
+// Tables live in ACPI memory, normally inside the direct map. Anything
+// beyond it (firmware placing them above the mapped RAM) is identity-mapped.
+static int acpi_map(uint32_t phys, uint32_t len)
+{
+    if (phys + len <= paging_direct_map_end())
+        return 0;
+    uint32_t start = phys & ~(PAGE_SIZE - 1);
+    uint32_t end = (phys + len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    return paging_map_range(start, start, end - start, PAGE_PRESENT);
+}
+
+static struct acpi_sdt_header *map_table(uint32_t phys)
+{
+    if (acpi_map(phys, sizeof(struct acpi_sdt_header)) != 0)
+        return NULL;
+    struct acpi_sdt_header *table = (struct acpi_sdt_header *)phys;
+    if (acpi_map(phys, table->length) != 0 || checksum(table, table->length) != 0)
+        return NULL;
+    return table;
+}
+
+static struct acpi_rsdp *scan_rsdp(uint32_t start, uint32_t end)
+{
+    for (uint32_t addr = start; addr + RSDP_V1_LEN <= end; addr += RSDP_ALIGN)
+    {
+        struct acpi_rsdp *rsdp = (struct acpi_rsdp *)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && checksum(rsdp, RSDP_V1_LEN) == 0)
+            return rsdp;
+    }
+    return NULL;
+}
+
+int acpi_init()
+{
+    // The RSDP is in the first KiB of the EBDA or in the BIOS ROM area
+    // (the barrier hides the constant low address, which -O2 flags as out of bounds)
+    volatile uint16_t *bda = (volatile uint16_t *)(uint32_t)EBDA_SEGMENT_PTR;
+    asm("" : "+r"(bda));
+    uint32_t ebda = (uint32_t)*bda << 4;
+    struct acpi_rsdp *rsdp = NULL;
+    if (ebda >= 0x80000 && ebda < BIOS_ROM_START)
+        rsdp = scan_rsdp(ebda, ebda + EBDA_SCAN_LEN);
+    if (rsdp == NULL)
+        rsdp = scan_rsdp(BIOS_ROM_START, BIOS_ROM_END);
+    if (rsdp == NULL)
+        return -1;
+
+    // Only the 32-bit RSDT is used: every table a 32-bit kernel can reach is listed there too
+    rsdt = map_table(rsdp->rsdt_address);
+    if (rsdt == NULL || memcmp(rsdt->signature, "RSDT", 4) != 0)
+    {
+        rsdt = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+struct acpi_sdt_header *acpi_find_table(const char *signature)
+{
+    if (rsdt == NULL)
+        return NULL;
+
+    uint32_t count = (rsdt->length - sizeof(struct acpi_sdt_header)) / sizeof(uint32_t);
+    uint32_t *entries = (uint32_t *)(rsdt + 1);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        struct acpi_sdt_header *table = map_table(entries[i]);
+        if (table != NULL && memcmp(table->signature, signature, 4) == 0)
+            return table;
+    }
+    return NULL;
+}
+
+int acpi_parse_madt(struct acpi_madt_info *info)
+{
+    struct acpi_madt *madt = (struct acpi_madt *)acpi_find_table("APIC");
+    if (madt == NULL)
+        return -1;
+
+    memset(info, 0, sizeof(*info));
+    info->lapic_address = madt->lapic_address;
+    info->pcat_compat = (madt->flags & MADT_FLAG_PCAT_COMPAT) != 0;
+    for (int irq = 0; irq < ACPI_ISA_IRQS; irq++)
+        info->isa_gsi[irq] = irq; // ISA IRQs are identity-mapped unless overridden
+
+    uint8_t *entry = madt->entries;
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    while (entry + sizeof(struct madt_entry_header) <= end)
+    {
+        struct madt_entry_header *header = (struct madt_entry_header *)entry;
+        if (header->length < sizeof(*header) || entry + header->length > end)
+            break;
+
+        switch (header->type)
+        {
+        case MADT_LOCAL_APIC:
+        {
+            struct madt_local_apic *lapic = (struct madt_local_apic *)entry;
+            if ((lapic->flags & MADT_LAPIC_ENABLED) && info->cpu_count < ACPI_MAX_CPUS)
+                info->cpu_apic_ids[info->cpu_count++] = lapic->apic_id;
+            break;
+        }
+        case MADT_IO_APIC:
+        {
+            struct madt_io_apic *ioapic = (struct madt_io_apic *)entry;
+            if (info->ioapic_count < ACPI_MAX_IOAPICS)
+            {
+                struct acpi_ioapic *out = &info->ioapics[info->ioapic_count++];
+                out->id = ioapic->id;
+                out->address = ioapic->address;
+                out->gsi_base = ioapic->gsi_base;
+            }
+            break;
+        }
+        case MADT_INT_OVERRIDE:
+        {
+            struct madt_int_override *iso = (struct madt_int_override *)entry;
+            if (iso->bus != 0 || iso->source_irq >= ACPI_ISA_IRQS)
+                break;
+            // The ISA IRQ whose identity GSI is taken (IRQ 2 for a timer on GSI 2) loses its pin
+            for (int irq = 0; irq < ACPI_ISA_IRQS; irq++)
+            {
+                if (irq != iso->source_irq && info->isa_gsi[irq] == iso->gsi)
+                    info->isa_gsi[irq] = ACPI_GSI_NONE;
+            }
+            info->isa_gsi[iso->source_irq] = iso->gsi;
+            info->isa_flags[iso->source_irq] = iso->flags;
+            break;
+        }
+        case MADT_LAPIC_ADDR_OVERRIDE:
+        {
+            struct madt_lapic_addr_override *addr = (struct madt_lapic_addr_override *)entry;
+            if (addr->address < 0x100000000ULL)
+                info->lapic_address = (uint32_t)addr->address;
+            break;
+        }
+        }
+        entry += header->length;
+    }
+    return 0;
+}
@@ -0,0 +1,383 @@
+// apic.c - Local APIC / I/O APIC setup, IRQ routing and the LAPIC timer
+#include "apic.h"
+#include "acpi.h"
+#include "idt.h"
+#include "cpu.h"
+#include "paging.h"
+#include "timer.h"
+#include "fb.h"
+#include "klog.h"
+#include "div64.h"
+
+// Local APIC registers (byte offsets from the MMIO base)
+#define LAPIC_ID 0x020
+#define LAPIC_VERSION 0x030
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0B0
+#define LAPIC_SVR 0x0F0
+#define LAPIC_ESR 0x280
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+#define LAPIC_SVR_ENABLE 0x100
+#define LVT_MASKED 0x10000
+#define LVT_DELIVERY_NMI 0x400
+#define LVT_TIMER_PERIODIC 0x20000
+#define TIMER_DIVIDE_16 0x3
+#define ICR_DELIVERY_PENDING 0x1000
+
+#define APIC_BASE_ENABLE 0x800 // IA32_APIC_BASE global enable
+#define APIC_BASE_ADDR_MASK 0xFFFFF000
+
+// I/O APIC: an index register and a data window
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_REG_VERSION 0x01
+#define IOAPIC_REG_REDIR 0x10 // Two 32-bit registers per pin
+
+#define REDIR_ACTIVE_LOW 0x2000
+#define REDIR_LEVEL 0x8000
+#define REDIR_MASKED 0x10000
+
+// Pins above the ISA range: GSIs 16-23 are PCI interrupts on IRQ slots 16-23
+#define APIC_ISA_IRQS 16
+#define APIC_GSI_SLOTS 24
+
+#define CALIBRATE_MS 10
+
+struct ioapic
+{
+    volatile uint32_t *base;
+    uint32_t gsi_base;
+    uint32_t pins;
+};
+
+static volatile uint32_t *lapic = NULL;
+static struct ioapic ioapics[ACPI_MAX_IOAPICS];
+static int ioapic_count = 0;
+static struct acpi_madt_info madt;
+static int active = 0;
+
+static uint32_t timer_khz = 0; // LAPIC timer counts per millisecond after the divider
+static uint32_t timer_rate_hz = 0;
+static volatile uint64_t timer_events = 0;
+static interrupt_handler_t timer_handler = NULL;
+
+// --- Register access ---
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+}
+
+static uint32_t ioapic_read(struct ioapic *io, uint32_t reg)
+{
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    return io->base[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic *io, uint32_t reg, uint32_t value)
+{
+    io->base[IOAPIC_REGSEL / 4] = reg;
+    io->base[IOAPIC_WINDOW / 4] = value;
+}
+
+// I/O APIC owning 'gsi', with 'pin' set to its input number there
+static struct ioapic *ioapic_for_gsi(uint32_t gsi, uint32_t *pin)
+{
+    for (int i = 0; i < ioapic_count; i++)
+    {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].pins)
+        {
+            *pin = gsi - ioapics[i].gsi_base;
+            return &ioapics[i];
+        }
+    }
+    return NULL;
+}
+
+// GSI behind IRQ slot 'irq', or ACPI_GSI_NONE
+static uint32_t irq_to_gsi(uint8_t irq)
+{
+    if (irq < APIC_ISA_IRQS)
+        return madt.isa_gsi[irq];
+    if (irq >= APIC_GSI_SLOTS)
+        return ACPI_GSI_NONE;
+    // A GSI that an ISA IRQ was overridden onto belongs to that IRQ's slot
+    for (int isa = 0; isa < APIC_ISA_IRQS; isa++)
+    {
+        if (madt.isa_gsi[isa] == irq)
+            return ACPI_GSI_NONE;
+    }
+    return irq;
+}
+
+// Program the redirection entry for IRQ slot 'irq' (masked) to raise its vector on the BSP
+static void ioapic_route(uint8_t irq, uint8_t dest)
+{
+    uint32_t pin;
+    struct ioapic *io = ioapic_for_gsi(irq_to_gsi(irq), &pin);
+    if (io == NULL)
+        return;
+
+    uint32_t low = (IDT_IRQ_BASE + irq) | REDIR_MASKED;
+    if (irq < APIC_ISA_IRQS)
+    {
+        // ISA lines are active-high edge unless the MADT says otherwise
+        uint16_t flags = madt.isa_flags[irq];
+        if ((flags & ACPI_POLARITY_MASK) == ACPI_POLARITY_LOW)
+            low |= REDIR_ACTIVE_LOW;
+        if ((flags & ACPI_TRIGGER_MASK) == ACPI_TRIGGER_LEVEL)
+            low |= REDIR_LEVEL;
+    }
+    else
+    {
+        low |= REDIR_ACTIVE_LOW | REDIR_LEVEL; // PCI interrupts
+    }
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2 + 1, (uint32_t)dest << 24);
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, low);
+}
+
+// Globally enable the LAPIC at 'phys', then software-enable it with the
+// spurious vector, accept all priorities and mask error interrupts
+static void lapic_enable(uint32_t phys)
+{
+    wrmsr(MSR_APIC_BASE, (rdmsr(MSR_APIC_BASE) & ~(uint64_t)APIC_BASE_ADDR_MASK) | phys | APIC_BASE_ENABLE);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+}
+
+// --- LAPIC timer ---
+
+// Count LAPIC timer ticks over CALIBRATE_MS of the already calibrated clock
+static void lapic_timer_calibrate()
+{
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | (IDT_IRQ_BASE + APIC_TIMER_IRQ));
+
+    uint64_t end = clock_ns() + CALIBRATE_MS * 1000000ULL;
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    while (clock_ns() < end)
+        asm volatile("pause");
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+    timer_khz = elapsed / CALIBRATE_MS;
+}
+
+static void lapic_timer_irq(registers_t *regs)
+{
+    timer_events++;
+    if (timer_handler)
+        timer_handler(regs);
+}
+
+int lapic_timer_start(uint32_t hz, interrupt_handler_t handler)
+{
+    if (!active || timer_khz == 0 || hz == 0)
+        return -1;
+
+    uint32_t count = (uint32_t)div64_u32((uint64_t)timer_khz * 1000, hz, NULL);
+    if (count == 0)
+        count = 1;
+
+    uint32_t flags = irq_save();
+    timer_handler = handler;
+    timer_rate_hz = hz;
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LVT_TIMER_PERIODIC | (IDT_IRQ_BASE + APIC_TIMER_IRQ));
+    lapic_write(LAPIC_TIMER_INITIAL, count);
+    register_irq_handler(APIC_TIMER_IRQ, lapic_timer_irq); // Unmasks the LVT entry
+    irq_restore(flags);
+    return 0;
+}
+
+void lapic_timer_stop()
+{
+    if (!active)
+        return;
+    uint32_t flags = irq_save();
+    register_irq_handler(APIC_TIMER_IRQ, NULL);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+    timer_handler = NULL;
+    timer_rate_hz = 0;
+    irq_restore(flags);
+}
+
+uint64_t lapic_timer_events()
+{
+    uint64_t a, b;
+    do
+    {
+        a = timer_events;
+        b = timer_events;
+    } while (a != b);
+    return a;
+}
+
+uint32_t lapic_timer_khz()
+{
+    return timer_khz;
+}
+
+// --- Public API ---
+
+void lapic_eoi()
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+uint8_t lapic_id()
+{
+    return lapic ? lapic_read(LAPIC_ID) >> 24 : 0;
+}
+
+int apic_active()
+{
+    return active;
+}
+
+int apic_set_irq_mask(uint8_t irq, int masked)
+{
+    if (lapic == NULL)
+        return -1;
+    if (irq == APIC_TIMER_IRQ)
+    {
+        uint32_t lvt = lapic_read(LAPIC_LVT_TIMER);
+        lapic_write(LAPIC_LVT_TIMER, masked ? (lvt | LVT_MASKED) : (lvt & ~LVT_MASKED));
+        return 0;
+    }
+
+    uint32_t pin;
+    struct ioapic *io = ioapic_for_gsi(irq_to_gsi(irq), &pin);
+    if (io == NULL)
+        return -1;
+    uint32_t low = ioapic_read(io, IOAPIC_REG_REDIR + pin * 2);
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, masked ? (low | REDIR_MASKED) : (low & ~REDIR_MASKED));
+    return 0;
+}
+
+void lapic_init_ap()
+{
+    lapic_enable((uint32_t)lapic);
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED); // External interrupts only reach the boot CPU
+    lapic_write(LAPIC_LVT_LINT1, LVT_DELIVERY_NMI);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | (IDT_IRQ_BASE + APIC_TIMER_IRQ));
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t command)
+{
+    // Interrupt handlers send IPIs too (the profiler): keep the two ICR
+    // writes of one IPI together
+    uint32_t flags = irq_save();
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command); // Writing the low half sends it
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING)
+        asm volatile("pause");
+    irq_restore(flags);
+}
+
+const struct acpi_madt_info *apic_madt()
+{
+    return active ? &madt : NULL;
+}
+
+int apic_init()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_APIC) || !(edx & CPUID_EDX_MSR))
+        return -1;
+    if (acpi_init() != 0 || acpi_parse_madt(&madt) != 0 || madt.ioapic_count == 0)
+        return -1;
+
+    // Map the register pages uncached; both live in the device window above RAM
+    uint32_t lapic_phys = madt.lapic_address ? madt.lapic_address : (uint32_t)rdmsr(MSR_APIC_BASE) & APIC_BASE_ADDR_MASK;
+    if (paging_map_page(lapic_phys, lapic_phys, PAGE_MMIO) != 0)
+        return -1;
+    for (int i = 0; i < madt.ioapic_count; i++)
+    {
+        uint32_t phys = madt.ioapics[i].address;
+        if (paging_map_page(phys & APIC_BASE_ADDR_MASK, phys & APIC_BASE_ADDR_MASK, PAGE_MMIO) != 0)
+            return -1;
+        struct ioapic *io = &ioapics[ioapic_count++];
+        io->base = (volatile uint32_t *)phys;
+        io->gsi_base = madt.ioapics[i].gsi_base;
+        io->pins = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+    }
+
+    // LINT0 keeps delivering the 8259 (virtual wire) until the switch below
+    lapic = (volatile uint32_t *)lapic_phys;
+    lapic_enable(lapic_phys);
+    lapic_timer_calibrate(); // The PIT still ticks here, so the clock is usable
+
+    uint32_t flags = irq_save();
+
+    // LINT0 carries the 8259 in virtual-wire mode: mask both ends of that path
+    pic_disable();
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LVT_DELIVERY_NMI);
+
+    for (int i = 0; i < ioapic_count; i++)
+    {
+        for (uint32_t pin = 0; pin < ioapics[i].pins; pin++)
+            ioapic_write(&ioapics[i], IOAPIC_REG_REDIR + pin * 2, REDIR_MASKED);
+    }
+    uint8_t bsp = lapic_id();
+    for (int irq = 0; irq < APIC_GSI_SLOTS; irq++)
+        ioapic_route(irq, bsp);
+
+    active = 1;
+    interrupts_use_apic(); // Unmask every line that already has a handler
+    irq_restore(flags);
+    return 0;
+}
+
+void apic_print_info()
+{
+    char line[80];
+    if (!active)
+    {
+        fb_write_string("Interrupt controller: 8259 PIC (no usable APIC)\n", FB_WHITE, FB_BLACK);
+        return;
+    }
+
+    ksnprintf(line, sizeof(line), "Local APIC: id %u, version 0x%02x at 0x%08x, %d CPU(s) in MADT\n", lapic_id(),
+              lapic_read(LAPIC_VERSION) & 0xFF, (uint32_t)lapic, madt.cpu_count);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+    for (int i = 0; i < ioapic_count; i++)
+    {
+        ksnprintf(line, sizeof(line), "I/O APIC %u at 0x%08x: GSI %u-%u\n", madt.ioapics[i].id,
+                  (uint32_t)ioapics[i].base, ioapics[i].gsi_base, ioapics[i].gsi_base + ioapics[i].pins - 1);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+    for (int irq = 0; irq < APIC_ISA_IRQS; irq++)
+    {
+        if (madt.isa_gsi[irq] == (uint32_t)irq && madt.isa_flags[irq] == 0)
+            continue;
+        if (madt.isa_gsi[irq] == ACPI_GSI_NONE)
+            ksnprintf(line, sizeof(line), "  IRQ %2d -> none\n", irq);
+        else
+            ksnprintf(line, sizeof(line), "  IRQ %2d -> GSI %u%s%s\n", irq, madt.isa_gsi[irq],
+                      (madt.isa_flags[irq] & ACPI_POLARITY_MASK) == ACPI_POLARITY_LOW ? ", active low" : "",
+                      (madt.isa_flags[irq] & ACPI_TRIGGER_MASK) == ACPI_TRIGGER_LEVEL ? ", level" : "");
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+    ksnprintf(line, sizeof(line), "LAPIC timer: %u kHz input, %u Hz, %llu events\n", timer_khz, timer_rate_hz,
+              lapic_timer_events());
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
@@ -0,0 +1,170 @@
+// bench.c - Benchmark registry, rdtsc sampling and the headless boot-time suite
+#include "bench.h"
+#include "cpu.h"
+#include "io.h"
+#include "timer.h"
+#include "div64.h"
+#include "string.h"
+#include "serial.h"
+#include "smp.h"
+#include "fb.h"
+#include "klog.h"
+
+// QEMU's isa-debug-exit device ('make bench'): writing v exits with status (v << 1) | 1
+#define BENCH_EXIT_PORT 0xF4
+#define BENCH_EXIT_OK 0     // QEMU status 1
+#define BENCH_EXIT_FAILED 1 // QEMU status 3
+
+// Start and end of the .benchmarks section (link.ld)
+extern const struct benchmark bench_table_start[];
+extern const struct benchmark bench_table_end[];
+
+static uint32_t samples[BENCH_SAMPLES];
+
+// Insertion sort: 101 values, no allocation
+static void sort_samples(uint32_t *v, int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        uint32_t x = v[i];
+        int j = i - 1;
+        while (j >= 0 && v[j] > x)
+        {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = x;
+    }
+}
+
+const struct benchmark *bench_find(const char *name)
+{
+    for (const struct benchmark *b = bench_table_start; b < bench_table_end; b++)
+    {
+        if (strcmp(b->name, name) == 0)
+            return b;
+    }
+    return NULL;
+}
+
+void bench_measure(const struct benchmark *b, struct bench_result *result)
+{
+    uint32_t iterations = b->iterations ? b->iterations : 1;
+
+    // Interrupts are off per sample only, so ticks and serial output still
+    // get through between samples
+    for (int i = 0; i < BENCH_WARMUP_SAMPLES; i++)
+    {
+        uint32_t flags = irq_save();
+        b->body(iterations);
+        irq_restore(flags);
+    }
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+    {
+        uint32_t flags = irq_save();
+        uint64_t start = rdtsc();
+        b->body(iterations);
+        uint64_t cycles = rdtsc() - start;
+        irq_restore(flags);
+        samples[i] = (uint32_t)div64_u32(cycles, iterations, NULL);
+    }
+
+    sort_samples(samples, BENCH_SAMPLES);
+    result->min = samples[0];
+    result->median = samples[BENCH_SAMPLES / 2];
+    result->p99 = samples[(BENCH_SAMPLES * 99 + 99) / 100 - 1];
+    result->max = samples[BENCH_SAMPLES - 1];
+}
+
+static uint32_t cycles_to_ns(uint32_t cycles)
+{
+    uint32_t khz = tsc_khz();
+    return khz ? (uint32_t)div64_u32((uint64_t)cycles * 1000000, khz, NULL) : 0;
+}
+
+static void print_result(const struct benchmark *b, const struct bench_result *r)
+{
+    char line[96];
+    ksnprintf(line, sizeof(line), "  %-16s %8u %8u %8u %8u %9u\n", b->name, r->min, r->median, r->p99, r->max,
+              cycles_to_ns(r->median));
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
+
+int bench_run(const char *name)
+{
+    const struct benchmark *only = NULL;
+    if (name && name[0])
+    {
+        only = bench_find(name);
+        if (only == NULL)
+            return -1;
+    }
+
+    char line[80];
+    ksnprintf(line, sizeof(line), "Cycles per iteration, %u samples after %u warm-up runs:\n", BENCH_SAMPLES,
+              BENCH_WARMUP_SAMPLES);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("  name                  min   median      p99      max median ns\n", FB_WHITE, FB_BLACK);
+
+    for (const struct benchmark *b = bench_table_start; b < bench_table_end; b++)
+    {
+        if (only && b != only)
+            continue;
+        struct bench_result r;
+        bench_measure(b, &r);
+        print_result(b, &r);
+    }
+    return 0;
+}
+
+void bench_list()
+{
+    char line[96];
+    for (const struct benchmark *b = bench_table_start; b < bench_table_end; b++)
+    {
+        ksnprintf(line, sizeof(line), "  %-16s %s (%u per sample)\n", b->name, b->description, b->iterations);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
+
+void bench_boot_suite()
+{
+    char line[160];
+    uint32_t count = 0;
+
+    // The serial port carries only the result lines; progress stays on screen
+    fb_set_output_hook(NULL);
+    fb_write_string("Benchmark mode: running the suite, results on COM1.\n", FB_GREEN, FB_BLACK);
+
+    ksnprintf(line, sizeof(line), "BENCH-BEGIN tsc_khz=%u cpus=%d samples=%u warmup=%u\n", tsc_khz(), smp_cpu_count(),
+              BENCH_SAMPLES, BENCH_WARMUP_SAMPLES);
+    serial_write(line);
+
+    for (const struct benchmark *b = bench_table_start; b < bench_table_end; b++)
+    {
+        struct bench_result r;
+        fb_write_string(b->name, FB_WHITE, FB_BLACK);
+        fb_write_string("\n", FB_WHITE, FB_BLACK);
+        bench_measure(b, &r);
+        ksnprintf(line, sizeof(line),
+                  "BENCH name=%s iterations=%u unit=cycles min=%u median=%u p99=%u max=%u median_ns=%u\n", b->name,
+                  b->iterations, r.min, r.median, r.p99, r.max, cycles_to_ns(r.median));
+        serial_write(line);
+        count++;
+    }
+
+    ksnprintf(line, sizeof(line), "BENCH-END count=%u\n", count);
+    serial_write(line);
+    fb_write_string("Benchmark suite done.\n", FB_GREEN, FB_BLACK);
+    bench_exit(count == 0);
+}
+
+void bench_exit(int failed)
+{
+    serial_flush();
+    outb(BENCH_EXIT_PORT, failed ? BENCH_EXIT_FAILED : BENCH_EXIT_OK);
+
+    // No debug-exit device (real hardware, plain 'make run'): just stop here
+    while (1)
+        asm volatile("cli; hlt");
+}
@@ -0,0 +1,83 @@
+// boottime.c - Boot phase timestamps, the boottime command and the headless boot-time report
+#include "boottime.h"
+#include "cpu.h"
+#include "timer.h"
+#include "div64.h"
+#include "serial.h"
+#include "bench.h"
+#include "fb.h"
+#include "klog.h"
+
+struct boot_mark
+{
+    const char *name;
+    uint64_t tsc;
+};
+
+static struct boot_mark marks[BOOT_MAX_PHASES];
+static uint32_t mark_count = 0;
+
+void boot_phase(const char *name)
+{
+    if (mark_count < BOOT_MAX_PHASES)
+    {
+        marks[mark_count].name = name;
+        marks[mark_count].tsc = rdtsc();
+        mark_count++;
+    }
+}
+
+// Marks are taken before the TSC is calibrated, so they are only converted here
+static uint32_t cycles_to_us(uint64_t cycles)
+{
+    uint32_t khz = tsc_khz();
+    return khz ? (uint32_t)div64_u32(cycles * 1000, khz, NULL) : 0;
+}
+
+static uint64_t phase_start(uint32_t i)
+{
+    return i == 0 ? boot_loader_tsc : marks[i - 1].tsc;
+}
+
+static uint32_t total_us()
+{
+    return mark_count ? cycles_to_us(marks[mark_count - 1].tsc - boot_loader_tsc) : 0;
+}
+
+void boottime_print()
+{
+    char line[96];
+
+    if (tsc_khz() == 0)
+    {
+        fb_write_string("No calibrated TSC: boot phases cannot be timed.\n", FB_RED, FB_BLACK);
+        return;
+    }
+    fb_write_string("Phase           done at (us)   took (us)\n", FB_GREEN, FB_BLACK);
+    for (uint32_t i = 0; i < mark_count; i++)
+    {
+        ksnprintf(line, sizeof(line), "%-16s %12u %11u\n", marks[i].name, cycles_to_us(marks[i].tsc - boot_loader_tsc),
+                  cycles_to_us(marks[i].tsc - phase_start(i)));
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+    ksnprintf(line, sizeof(line), "Loader entry to prompt: %u us; reset to loader entry (firmware, GRUB): %u ms\n",
+              total_us(), cycles_to_us(boot_loader_tsc) / 1000);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+}
+
+void boottime_report_exit()
+{
+    char line[96];
+
+    fb_set_output_hook(NULL); // COM1 carries only the report
+    for (uint32_t i = 0; i < mark_count; i++)
+    {
+        ksnprintf(line, sizeof(line), "BOOT-PHASE name=%s end_us=%u took_us=%u\n", marks[i].name,
+                  cycles_to_us(marks[i].tsc - boot_loader_tsc), cycles_to_us(marks[i].tsc - phase_start(i)));
+        serial_write(line);
+    }
+    ksnprintf(line, sizeof(line), "BOOT-TIME total_us=%u before_loader_us=%u\n", total_us(),
+              cycles_to_us(boot_loader_tsc));
+    serial_write(line);
+    bench_exit(tsc_khz() == 0);
+}
@@ -0,0 +1,268 @@
+// command.c - Hashed shell command registry, in-place tokenizer, help and dispatch benchmarks
+#include "command.h"
+#include "string.h"
+#include "cpu.h"
+#include "kheap.h"
+#include "bench.h"
+#include "fb.h"
+#include "klog.h"
+
+#define BUCKET_MASK (COMMAND_HASH_BUCKETS - 1)
+
+#define DISPATCH_BENCH_MAX 512    // Synthetic commands in the largest table
+#define DISPATCH_BENCH_LOOKUPS 256 // Lookups per timed run
+#define DISPATCH_BENCH_RUNS 5      // Best run is reported
+#define DISPATCH_BENCH_NAME 12     // "cmd511" plus room
+
+// Bounds of the 'commands' section (link.ld, or provided by a hosted ld)
+extern struct command __start_commands[];
+extern struct command __stop_commands[];
+
+static struct command_table shell_table;
+
+uint32_t command_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int command_table_add(struct command_table *table, struct command *cmd)
+{
+    if (command_table_find(table, cmd->name) != NULL)
+        return -1;
+
+    cmd->hash = command_hash(cmd->name);
+    struct command **bucket = &table->buckets[cmd->hash & BUCKET_MASK];
+    cmd->hash_next = *bucket;
+    *bucket = cmd;
+
+    // Registration is rare, so 'help' gets its order here rather than by sorting
+    struct command **link = &table->sorted;
+    while (*link && strcmp((*link)->name, cmd->name) < 0)
+        link = &(*link)->sorted_next;
+    cmd->sorted_next = *link;
+    *link = cmd;
+
+    table->count++;
+    return 0;
+}
+
+struct command *command_table_find(const struct command_table *table, const char *name)
+{
+    uint32_t hash = command_hash(name);
+    for (struct command *cmd = table->buckets[hash & BUCKET_MASK]; cmd; cmd = cmd->hash_next)
+    {
+        if (cmd->hash == hash && strcmp(cmd->name, name) == 0)
+            return cmd;
+    }
+    return NULL;
+}
+
+void command_init()
+{
+    for (struct command *cmd = __start_commands; cmd < __stop_commands; cmd++)
+    {
+        if (command_table_add(&shell_table, cmd) != 0)
+            klog(KLOG_WARN, "Shell command '%s' is defined twice\n", cmd->name);
+    }
+}
+
+int command_register(struct command *cmd)
+{
+    return command_table_add(&shell_table, cmd);
+}
+
+struct command *command_find(const char *name)
+{
+    return command_table_find(&shell_table, name);
+}
+
+int command_tokenize(char *line, char **argv, int max_args)
+{
+    int argc = 0;
+    char *p = line;
+
+    while (argc < max_args)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            break;
+
+        if (*p == '"')
+        {
+            argv[argc++] = ++p;
+            while (*p && *p != '"')
+                p++;
+        }
+        else
+        {
+            argv[argc++] = p;
+            while (*p && *p != ' ' && *p != '\t')
+                p++;
+        }
+        if (*p == '\0')
+            break;
+        *p++ = '\0';
+    }
+    return argc;
+}
+
+void command_print_help(const char *name)
+{
+    char line[128];
+
+    if (name != NULL)
+    {
+        const struct command *cmd = command_find(name);
+        if (cmd == NULL)
+        {
+            fb_write_string("No such command: '", FB_RED, FB_BLACK);
+            fb_write_string(name, FB_RED, FB_BLACK);
+            fb_write_string("'\n", FB_RED, FB_BLACK);
+            return;
+        }
+        ksnprintf(line, sizeof(line), "Usage: %s %s\n", cmd->name, cmd->usage);
+        fb_write_string(line, FB_GREEN, FB_BLACK);
+        ksnprintf(line, sizeof(line), "  %s\n", cmd->help);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+        return;
+    }
+
+    fb_write_string("Available commands ('help <command>' shows its arguments):\n", FB_GREEN, FB_BLACK);
+    for (const struct command *cmd = shell_table.sorted; cmd; cmd = cmd->sorted_next)
+    {
+        ksnprintf(line, sizeof(line), "  %-9s - %s\n", cmd->name, cmd->help);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
+
+// --- Benchmarks ---
+
+// Worst case for the old if-chain: an unknown name, tokenized from a fresh copy
+BENCHMARK(shell_dispatch, "Tokenize and look up an unknown command", 100)
+{
+    static const char input[] = "no-such-command first second third";
+    char line[sizeof(input)];
+    char *argv[COMMAND_MAX_ARGS];
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        memcpy(line, input, sizeof(input));
+        if (command_tokenize(line, argv, COMMAND_MAX_ARGS) > 0 && command_find(argv[0]) != NULL)
+            break;
+    }
+}
+
+BENCHMARK(command_lookup, "Registry lookup of an existing command", 1000)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        if (command_find("help") == NULL)
+            break;
+    }
+}
+
+// What an if-chain of strcmp calls does: compare against every command in turn
+static struct command *linear_find(struct command *cmds, uint32_t count, const char *name)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (strcmp(cmds[i].name, name) == 0)
+            return &cmds[i];
+    }
+    return NULL;
+}
+
+static void dispatch_bench_fn(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+}
+
+// Best-of-runs cycles per lookup of 'names' (hashed or linear)
+static uint32_t time_lookups(const struct command_table *table, struct command *cmds, uint32_t count,
+                             const char *const *names, int hashed)
+{
+    uint64_t best = ~0ULL;
+    volatile uint32_t found = 0; // Keeps the lookups from being optimized away
+
+    for (int run = 0; run < DISPATCH_BENCH_RUNS; run++)
+    {
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < DISPATCH_BENCH_LOOKUPS; i++)
+        {
+            const char *name = names[i];
+            found += (hashed ? command_table_find(table, name) : linear_find(cmds, count, name)) != NULL;
+        }
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+    return (uint32_t)best / DISPATCH_BENCH_LOOKUPS;
+}
+
+static void dispatch_report(struct command_table *table, struct command *cmds, char *names, const char **hits,
+                            const char **misses)
+{
+    static const uint32_t sizes[] = {8, 32, 128, 512};
+    char line[96];
+
+    for (uint32_t i = 0; i < DISPATCH_BENCH_MAX; i++)
+    {
+        char *name = names + i * DISPATCH_BENCH_NAME;
+        ksnprintf(name, DISPATCH_BENCH_NAME, "cmd%u", i);
+        cmds[i].name = name;
+        cmds[i].usage = "";
+        cmds[i].help = "Synthetic command for the dispatch benchmark";
+        cmds[i].fn = dispatch_bench_fn;
+    }
+    for (uint32_t i = 0; i < DISPATCH_BENCH_LOOKUPS; i++)
+        misses[i] = "no-such-command";
+
+    ksnprintf(line, sizeof(line), "Command lookup, cycles per call (best of %u runs of %u):\n", DISPATCH_BENCH_RUNS,
+              DISPATCH_BENCH_LOOKUPS);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("  commands   hashed hit  hashed miss   linear hit  linear miss\n", FB_WHITE, FB_BLACK);
+
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        while (count < sizes[s])
+            command_table_add(table, &cmds[count++]);
+        // Hits spread evenly over the table, as typed commands would be
+        for (uint32_t i = 0; i < DISPATCH_BENCH_LOOKUPS; i++)
+            hits[i] = cmds[(i * 2654435761u) % count].name;
+
+        ksnprintf(line, sizeof(line), "  %8u %12u %12u %12u %12u\n", count,
+                  time_lookups(table, cmds, count, hits, 1), time_lookups(table, cmds, count, misses, 1),
+                  time_lookups(table, cmds, count, hits, 0), time_lookups(table, cmds, count, misses, 0));
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
+
+void command_benchmark()
+{
+    // Synthetic commands in a private table: the shell's own is left alone
+    struct command_table *table = kzalloc(sizeof(*table));
+    struct command *cmds = kzalloc(DISPATCH_BENCH_MAX * sizeof(struct command));
+    char *names = kzalloc(DISPATCH_BENCH_MAX * DISPATCH_BENCH_NAME);
+    const char **hits = kzalloc(DISPATCH_BENCH_LOOKUPS * sizeof(char *));
+    const char **misses = kzalloc(DISPATCH_BENCH_LOOKUPS * sizeof(char *));
+
+    if (table && cmds && names && hits && misses)
+        dispatch_report(table, cmds, names, hits, misses);
+    else
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+
+    kfree(table);
+    kfree(cmds);
+    kfree(names);
+    kfree(hits);
+    kfree(misses);
+}
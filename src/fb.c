@@ -1,14 +1,46 @@
 // fb.c - Framebuffer driver implementation
 #include "fb.h"
 #include "io.h"
-#include "string.h" // For memset in fb_clear scrolling logic if needed
+#include "string.h"
+#include "cpu.h"
+#include "timer.h" // For tsc_khz in the benchmark
+#include "div64.h"
+#include "shell.h" // For fb_write_dec
+#include "bench.h"
+#include "trace.h"
 
-// Framebuffer memory address
-static char *fb = (char *)0x000B8000;
+// Framebuffer memory address (the host build points this at a mock buffer)
+#ifndef FB_MEMORY
+#define FB_MEMORY 0x000B8000
+#endif
+static volatile uint32_t *fb = (volatile uint32_t *)FB_MEMORY;
 
-// Current cursor position (simple state)
-static unsigned short cursor_row = 0;
-static unsigned short cursor_col = 0;
+// One virtual terminal. Its text lives in a ring of lines (char in the low
+// byte, attribute in the high byte); the visible window is the FB_ROWS lines
+// starting at 'top'. Scrolling just advances 'top' and blanks one line.
+struct vt
+{
+    uint16_t lines[FB_SCROLLBACK_LINES][FB_COLS];
+    unsigned int top;         // Ring index of screen row 0 in the live view
+    unsigned int used;        // Lines holding text (visible window + history)
+    unsigned int view_offset; // Lines scrolled back from the live view
+    unsigned short cursor_row;
+    unsigned short cursor_col;
+};
+
+static struct vt vts[FB_VT_COUNT];
+static struct vt *vt = &vts[0]; // Active terminal: receives output, shown on screen
+static unsigned int active_vt = 0;
+
+static uint32_t dirty_rows = 0; // Bit r set: screen row r differs from VGA memory
+static unsigned short hw_cursor_pos = 0xFFFF; // Last position programmed into the CRTC
+
+// Receives a copy of everything written at the cursor
+static void (*output_hook)(char c) = NULL;
+
+#define ALL_ROWS_DIRTY ((1u << FB_ROWS) - 1)
+#define BLANK_CELL ((uint16_t)(((FB_BLACK << 4) | FB_WHITE) << 8 | ' '))
+#define CURSOR_HIDDEN (FB_ROWS * FB_COLS) // Off-screen cursor position
 
 // Framebuffer I/O ports
 #define FB_COMMAND_PORT 0x3D4
@@ -18,6 +50,23 @@ static unsigned short cursor_col = 0;
 #define FB_HIGH_BYTE_COMMAND 14
 #define FB_LOW_BYTE_COMMAND 15
 
+// Ring line shown on screen row 'row' of the live view
+static uint16_t *live_line(struct vt *t, unsigned int row)
+{
+    return t->lines[(t->top + row) % FB_SCROLLBACK_LINES];
+}
+
+// Ring line shown on screen row 'row', taking scrollback into account
+static uint16_t *view_line(struct vt *t, unsigned int row)
+{
+    return t->lines[(t->top + FB_SCROLLBACK_LINES - t->view_offset + row) % FB_SCROLLBACK_LINES];
+}
+
+static void blank_line(uint16_t *line)
+{
+    memsetw(line, BLANK_CELL, FB_COLS);
+}
+
 // Internal function to move cursor based on linear position
 void fb_move_cursor_internal(unsigned short pos)
 {
@@ -27,6 +76,42 @@ void fb_move_cursor_internal(unsigned short pos)
     outb(FB_DATA_PORT, pos & 0x00FF);
 }
 
+// Copy dirty rows of the visible window to VGA memory and sync the hardware cursor once
+void fb_flush()
+{
+    while (dirty_rows)
+    {
+        unsigned int row = __builtin_ctz(dirty_rows);
+        dirty_rows &= dirty_rows - 1;
+
+        // One row is 160 bytes: a single rep movsd instead of 160 byte stores
+        memcpy((void *)(fb + row * (FB_COLS / 2)), view_line(vt, row), FB_COLS * sizeof(uint16_t));
+    }
+
+    // The cursor is only meaningful in the live view
+    unsigned short pos = vt->view_offset ? CURSOR_HIDDEN : vt->cursor_row * FB_COLS + vt->cursor_col;
+    if (pos != hw_cursor_pos)
+    {
+        fb_move_cursor_internal(pos);
+        hw_cursor_pos = pos;
+    }
+}
+
+void fb_set_output_hook(void (*hook)(char c))
+{
+    output_hook = hook;
+}
+
+// Return to the live view if the user scrolled back
+static void snap_to_live()
+{
+    if (vt->view_offset)
+    {
+        vt->view_offset = 0;
+        dirty_rows = ALL_ROWS_DIRTY;
+    }
+}
+
 // Move the cursor to a specific row and column
 void fb_move_cursor(unsigned short row, unsigned short col)
 {
@@ -35,105 +120,310 @@ void fb_move_cursor(unsigned short row, unsigned short col)
         // Keep cursor within bounds
         return;
     }
-    unsigned short pos = row * FB_COLS + col;
-    fb_move_cursor_internal(pos);
-    cursor_row = row;
-    cursor_col = col;
+    vt->cursor_row = row;
+    vt->cursor_col = col;
 }
 
-// --- Basic Scrolling ---
-// Shifts all lines up by one, clears the last line
+// --- Scrolling ---
+// Advance the window by one line: O(1) in the ring, only one line is cleared.
+// The line that leaves the top stays in the ring as scrollback.
 void fb_scroll()
 {
-    unsigned int i;
-    // Move rows 1 to FB_ROWS-1 up one row
-    for (i = 0; i < (FB_ROWS - 1) * FB_COLS * 2; i++)
-    {
-        fb[i] = fb[i + FB_COLS * 2];
-    }
-    // Clear the last row
-    for (i = (FB_ROWS - 1) * FB_COLS; i < FB_ROWS * FB_COLS; i++)
+    vt->top = (vt->top + 1) % FB_SCROLLBACK_LINES;
+    blank_line(live_line(vt, FB_ROWS - 1));
+    if (vt->used < FB_SCROLLBACK_LINES)
+        vt->used++;
+    dirty_rows = ALL_ROWS_DIRTY; // Every visible row now shows a different line
+    // Set cursor to the beginning of the last line
+    vt->cursor_row = FB_ROWS - 1;
+    vt->cursor_col = 0;
+}
+
+// Scroll the view back (positive) or forward (negative) through the history
+void fb_scroll_view(int lines)
+{
+    int offset = (int)vt->view_offset + lines;
+    int max_offset = (int)vt->used - FB_ROWS;
+    if (offset > max_offset)
+        offset = max_offset;
+    if (offset < 0)
+        offset = 0;
+    if ((unsigned int)offset != vt->view_offset)
     {
-        fb_write_cell(i, ' ', FB_WHITE, FB_BLACK);
+        vt->view_offset = offset;
+        dirty_rows = ALL_ROWS_DIRTY;
     }
-    // Set cursor to the beginning of the last line
-    cursor_row = FB_ROWS - 1;
-    cursor_col = 0;
+    fb_flush();
 }
 
-// Write a cell (char + colors) at a linear position i
+// Write a cell (char + colors) at a linear position i of the live view
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg)
 {
     if (i >= FB_ROWS * FB_COLS)
         return;
-    unsigned int fb_idx = i * 2;
-    fb[fb_idx] = c;
-    fb[fb_idx + 1] = ((bg & 0x0F) << 4) | (fg & 0x0F);
+    live_line(vt, i / FB_COLS)[i % FB_COLS] = (uint16_t)((((bg & 0x0F) << 4) | (fg & 0x0F)) << 8 | (unsigned char)c);
+    dirty_rows |= 1u << (i / FB_COLS);
 }
 
 // Write a cell (char + colors) at the current cursor position and advance
 void fb_write_cell_at_cursor(char c, unsigned char fg, unsigned char bg)
 {
+    TRACE(TRACE_FB_PUTC, (uint8_t)c);
+    snap_to_live(); // New output always shows up on screen
+    if (output_hook)
+        output_hook(c);
+
     // Handle newline separately
     if (c == '\n')
     {
-        cursor_col = 0;
-        cursor_row++;
+        vt->cursor_col = 0;
+        vt->cursor_row++;
     }
     else
     {
-        unsigned short pos = cursor_row * FB_COLS + cursor_col;
+        unsigned short pos = vt->cursor_row * FB_COLS + vt->cursor_col;
         fb_write_cell(pos, c, fg, bg);
         // Advance cursor
-        cursor_col++;
+        vt->cursor_col++;
     }
 
     // Wrap cursor to next line if needed
-    if (cursor_col >= FB_COLS)
+    if (vt->cursor_col >= FB_COLS)
     {
-        cursor_col = 0;
-        cursor_row++;
+        vt->cursor_col = 0;
+        vt->cursor_row++;
     }
 
     // Scroll if cursor goes past the last row
-    if (cursor_row >= FB_ROWS)
+    if (vt->cursor_row >= FB_ROWS)
     {
         fb_scroll();
     }
 
-    // Update hardware cursor position
-    fb_move_cursor(cursor_row, cursor_col);
+    // The hardware cursor follows on the next flush
 }
 
-// Write a null-terminated string
+// Write a null-terminated string, then push it to the screen in one flush
 void fb_write_string(const char *str, unsigned char fg, unsigned char bg)
 {
     for (int i = 0; str[i] != '\0'; i++)
     {
         fb_write_cell_at_cursor(str[i], fg, bg);
     }
+    fb_flush();
 }
 
-// Clear the screen
+// Clear the visible window of the active terminal (history is kept)
 void fb_clear()
 {
+    if (vt->used < FB_ROWS)
+        vt->used = FB_ROWS;
+    vt->view_offset = 0;
     for (int r = 0; r < FB_ROWS; r++)
     {
-        for (int c = 0; c < FB_COLS; c++)
-        {
-            fb_write_cell(r * FB_COLS + c, ' ', FB_WHITE, FB_BLACK);
-        }
+        blank_line(live_line(vt, r));
+    }
+    dirty_rows = ALL_ROWS_DIRTY;
+    vt->cursor_row = 0; // Reset cursor to top-left
+    vt->cursor_col = 0;
+    fb_flush();
+}
+
+// --- Virtual terminals ---
+
+void fb_switch_vt(unsigned int index)
+{
+    if (index >= FB_VT_COUNT || index == active_vt)
+        return;
+    active_vt = index;
+    vt = &vts[index];
+    if (vt->used == 0)
+    {
+        // First visit: start with a blank screen
+        fb_clear();
+        return;
     }
-    fb_move_cursor(0, 0); // Reset cursor to top-left
+    dirty_rows = ALL_ROWS_DIRTY;
+    fb_flush();
+}
+
+unsigned int fb_active_vt()
+{
+    return active_vt;
 }
 
 // Get current cursor position
 unsigned short fb_get_cursor_row()
 {
-    return cursor_row;
+    return vt->cursor_row;
 }
 
 unsigned short fb_get_cursor_col()
 {
-    return cursor_col;
-}
\ No newline at end of file
+    return vt->cursor_col;
+}
+
+// --- Benchmark ---
+
+#define BENCH_LINES 200
+
+static const char bench_line[] = "The quick brown fox jumps over the lazy dog 0123456789 ABCDEFGHIJ\n";
+
+// The console as it was before the RAM buffer, kept verbatim (only renamed)
+// as the baseline for fb_benchmark: every character is stored straight into
+// VGA memory and reprograms the hardware cursor, and scrolling copies VGA
+// memory byte by byte.
+static char *baseline_fb = (char *)FB_MEMORY;
+
+static unsigned short baseline_cursor_row = 0;
+static unsigned short baseline_cursor_col = 0;
+
+static void baseline_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg)
+{
+    if (i >= FB_ROWS * FB_COLS)
+        return;
+    unsigned int fb_idx = i * 2;
+    baseline_fb[fb_idx] = c;
+    baseline_fb[fb_idx + 1] = ((bg & 0x0F) << 4) | (fg & 0x0F);
+}
+
+static void baseline_move_cursor(unsigned short row, unsigned short col)
+{
+    if (row >= FB_ROWS || col >= FB_COLS)
+    {
+        // Keep cursor within bounds
+        return;
+    }
+    unsigned short pos = row * FB_COLS + col;
+    fb_move_cursor_internal(pos);
+    baseline_cursor_row = row;
+    baseline_cursor_col = col;
+}
+
+static void baseline_scroll()
+{
+    unsigned int i;
+    // Move rows 1 to FB_ROWS-1 up one row
+    for (i = 0; i < (FB_ROWS - 1) * FB_COLS * 2; i++)
+    {
+        baseline_fb[i] = baseline_fb[i + FB_COLS * 2];
+    }
+    // Clear the last row
+    for (i = (FB_ROWS - 1) * FB_COLS; i < FB_ROWS * FB_COLS; i++)
+    {
+        baseline_write_cell(i, ' ', FB_WHITE, FB_BLACK);
+    }
+    // Set cursor to the beginning of the last line
+    baseline_cursor_row = FB_ROWS - 1;
+    baseline_cursor_col = 0;
+}
+
+static void baseline_write_cell_at_cursor(char c, unsigned char fg, unsigned char bg)
+{
+    // Handle newline separately
+    if (c == '\n')
+    {
+        baseline_cursor_col = 0;
+        baseline_cursor_row++;
+    }
+    else
+    {
+        unsigned short pos = baseline_cursor_row * FB_COLS + baseline_cursor_col;
+        baseline_write_cell(pos, c, fg, bg);
+        // Advance cursor
+        baseline_cursor_col++;
+    }
+
+    // Wrap cursor to next line if needed
+    if (baseline_cursor_col >= FB_COLS)
+    {
+        baseline_cursor_col = 0;
+        baseline_cursor_row++;
+    }
+
+    // Scroll if cursor goes past the last row
+    if (baseline_cursor_row >= FB_ROWS)
+    {
+        baseline_scroll();
+    }
+
+    // Update hardware cursor position
+    baseline_move_cursor(baseline_cursor_row, baseline_cursor_col);
+}
+
+static void baseline_write_string(const char *str, unsigned char fg, unsigned char bg)
+{
+    for (int i = 0; str[i] != '\0'; i++)
+    {
+        baseline_write_cell_at_cursor(str[i], fg, bg);
+    }
+}
+
+// Dump BENCH_LINES lines through 'write' and return the TSC cycles it took
+static uint64_t bench_dump(void (*write)(const char *str, unsigned char fg, unsigned char bg), uint32_t *chars)
+{
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_LINES; i++)
+    {
+        write(bench_line, FB_LIGHT_GREY, FB_BLACK);
+    }
+    *chars = BENCH_LINES * (sizeof(bench_line) - 1);
+    return rdtsc() - start;
+}
+
+static void bench_report(const char *label, uint64_t cycles, uint32_t chars)
+{
+    uint32_t cycles_per_char = chars ? (uint32_t)div64_u32(cycles, chars, NULL) : 0;
+
+    // chars/s = chars * tsc_khz * 1000 / cycles, scaled so the divisor fits 32 bits
+    uint64_t numerator = (uint64_t)chars * tsc_khz() * 1000;
+    while (cycles >> 32)
+    {
+        cycles >>= 1;
+        numerator >>= 1;
+    }
+    uint32_t chars_per_sec = cycles ? (uint32_t)div64_u32(numerator, (uint32_t)cycles, NULL) : 0;
+
+    fb_write_string(label, FB_WHITE, FB_BLACK);
+    fb_write_dec(chars_per_sec);
+    fb_write_string(" chars/s (", FB_WHITE, FB_BLACK);
+    fb_write_dec(cycles_per_char);
+    fb_write_string(" cycles/char)\n", FB_WHITE, FB_BLACK);
+}
+
+void fb_benchmark()
+{
+    uint32_t chars;
+
+    // Measure the console alone, not a mirror draining at serial speed
+    void (*hook)(char c) = output_hook;
+    output_hook = NULL;
+    baseline_cursor_row = vt->cursor_row;
+    baseline_cursor_col = vt->cursor_col;
+    uint64_t direct_cycles = bench_dump(baseline_write_string, &chars);
+
+    // The baseline wrote behind the buffer's back: repaint the screen from it
+    dirty_rows = ALL_ROWS_DIRTY;
+    hw_cursor_pos = 0xFFFF;
+    fb_flush();
+    uint64_t shadow_cycles = bench_dump(fb_write_string, &chars);
+    output_hook = hook;
+
+    fb_write_string("Console throughput (", FB_GREEN, FB_BLACK);
+    fb_write_dec(BENCH_LINES);
+    fb_write_string(" lines):\n", FB_GREEN, FB_BLACK);
+    bench_report("  original per-character VGA: ", direct_cycles, chars);
+    bench_report("  buffered, row flush:        ", shadow_cycles, chars);
+}
+
+// Buffered console output as the shell produces it: one line per iteration,
+// scrolling included. The serial mirror is detached so only the console is timed.
+BENCHMARK(console_line, "fb_write_string of one 65-character line", 25)
+{
+    void (*hook)(char c) = output_hook;
+    output_hook = NULL;
+    for (uint32_t i = 0; i < iterations; i++)
+        fb_write_string(bench_line, FB_LIGHT_GREY, FB_BLACK);
+    output_hook = hook;
+}
+
@@ -1,11 +1,11 @@
-// gdt.c - GDT initialization
+// gdt.c - Per-CPU GDT and TSS initialization
 #include "gdt.h"
 #include "common.h"
+#include "percpu.h"
+#include "string.h"
 
-// Define the GDT array (3 entries: Null, Code, Data)
-#define GDT_ENTRIES 3
-struct gdt_entry gdt[GDT_ENTRIES];
-struct gdt_ptr gdt_p;
+// Top of the boot stack (defined in loader.s)
+extern char kernel_stack_top[];
 
 // External ASM function to load GDT register (lgdt) and update segment registers
 extern void gdt_flush(struct gdt_ptr *gdt_p_addr);
@@ -16,7 +16,8 @@ extern void gdt_flush(struct gdt_ptr *gdt_p_addr);
 // limit: Max addressable unit (limit, up to 2^20 bytes or pages)
 // access: Access flags byte
 // granularity: Granularity byte
-static void gdt_set_gate(int32_t num, uint32_t base, uint32_t limit, uint8_t access, uint8_t granularity)
+static void gdt_set_gate(struct gdt_entry *gdt, int32_t num, uint32_t base, uint32_t limit, uint8_t access,
+                         uint8_t granularity)
 {
     gdt[num].base_low = (base & 0xFFFF);
     gdt[num].base_middle = (base >> 16) & 0xFF;
@@ -29,28 +30,53 @@ static void gdt_set_gate(int32_t num, uint32_t base, uint32_t limit, uint8_t acc
     gdt[num].access = access;
 }
 
-// Initialize GDT
-void gdt_init()
+void gdt_load_cpu(struct gdt_entry *gdt, struct gdt_ptr *ptr, struct tss *tss, uint32_t percpu,
+                  uint32_t percpu_size, uint32_t stack_top)
 {
     // Set up GDT pointer
-    gdt_p.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
-    gdt_p.base = (uint32_t)&gdt;
+    ptr->limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    ptr->base = (uint32_t)gdt;
 
     // GDT Entry 0: Null Segment (required)
-    gdt_set_gate(0, 0, 0, 0, 0);
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);
 
     // GDT Entry 1: Kernel Code Segment
     // Base=0, Limit=4GB, Access=P(1) DPL(0) S(1) Type(Execute/Read=A), Granularity=G(1) D/B(1=32bit)
     // Access byte 0x9A = 1001 1010b (Present=1, DPL=00, S=1, Type=1010 E=1,R=1,A=0)
     // Granularity byte 0xCF = 1100 1111b (G=1, D/B=1, L=0, AVL=0 | Limit[19:16]=1111)
-    gdt_set_gate(1, 0x00000000, 0xFFFFFFFF, 0x9A, 0xCF);
+    gdt_set_gate(gdt, 1, 0x00000000, 0xFFFFFFFF, 0x9A, 0xCF);
 
     // GDT Entry 2: Kernel Data Segment
     // Base=0, Limit=4GB, Access=P(1) DPL(0) S(1) Type(Read/Write=2), Granularity=G(1) D/B(1=32bit)
     // Access byte 0x92 = 1001 0010b (Present=1, DPL=00, S=1, Type=0010 W=1,A=0)
     // Granularity byte 0xCF = 1100 1111b (G=1, D/B=1, L=0, AVL=0 | Limit[19:16]=1111)
-    gdt_set_gate(2, 0x00000000, 0xFFFFFFFF, 0x92, 0xCF);
+    gdt_set_gate(gdt, 2, 0x00000000, 0xFFFFFFFF, 0x92, 0xCF);
+
+    // GDT Entry 3: Per-CPU data segment, byte granular over this CPU's struct cpu
+    // Granularity byte 0x40 = 0100 0000b (G=0, D/B=1)
+    gdt_set_gate(gdt, 3, percpu, percpu_size - 1, 0x92, 0x40);
+
+    // GDT Entry 4: 32-bit TSS (available)
+    // Access byte 0x89 = 1000 1001b (Present=1, DPL=00, S=0, Type=1001 available 32-bit TSS)
+    memset(tss, 0, sizeof(*tss));
+    tss->ss0 = GDT_KERNEL_DATA;
+    tss->esp0 = stack_top;
+    tss->iomap_base = sizeof(*tss); // No I/O permission bitmap
+    gdt_set_gate(gdt, 4, (uint32_t)tss, sizeof(*tss) - 1, 0x89, 0x00);
+
+    // Load the GDT using the assembly function, then the per-CPU segment and TSS
+    gdt_flush(ptr);
+    asm volatile("mov %0, %%gs" : : "r"((uint32_t)GDT_PERCPU));
+    asm volatile("ltr %w0" : : "r"((uint32_t)GDT_TSS));
+}
 
-    // Load the GDT using the assembly function
-    gdt_flush(&gdt_p);
-}
\ No newline at end of file
+// Initialize GDT for the boot CPU
+void gdt_init()
+{
+    struct cpu *bsp = &cpus[0];
+    bsp->self = bsp;
+    bsp->index = 0;
+    bsp->online = 1;
+    bsp->stack_top = (uint32_t)kernel_stack_top;
+    gdt_load_cpu(bsp->gdt, &bsp->gdt_ptr, &bsp->tss, (uint32_t)bsp, sizeof(*bsp), bsp->stack_top);
+}
@@ -4,6 +4,7 @@
 #include "string.h"
 #include "common.h"
 #include "fb.h"
+#include "apic.h" // For APIC_SPURIOUS_VECTOR
 
 #define IDT_ENTRIES 256
 #define KERNEL_CODE_SEGMENT 0x08
@@ -61,26 +62,47 @@ void pic_remap(int offset1, int offset2)
     outb(PIC2_DATA, mask2);
 }
 
+void pic_set_mask(uint8_t irq, int masked)
+{
+    uint16_t port = irq < 8 ? PIC1_DATA : PIC2_DATA;
+    uint8_t bit = 1 << (irq & 7);
+    uint8_t mask = inb(port);
+    outb(port, masked ? (mask | bit) : (mask & ~bit));
+    if (irq >= 8 && !masked)
+        pic_set_mask(2, 0); // Slave interrupts arrive through IRQ 2
+}
+
+void pic_disable()
+{
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
 // --- IDT Initialization ---
 void idt_init()
 {
     idt_p.limit = (sizeof(struct idt_entry) * IDT_ENTRIES) - 1;
     idt_p.base = (uint32_t)&idt;
     memset(&idt, 0, sizeof(struct idt_entry) * IDT_ENTRIES);
-    pic_remap(0x20, 0x28); // Remap IRQs to 0x20-0x2F (32-47)
+    pic_remap(IDT_IRQ_BASE, IDT_IRQ_BASE + 8); // Remap IRQs to 0x20-0x2F (32-47)
 
-    // Set up ISR Gates (ensure stubs exist in idt_asm.s)
-    idt_set_gate(0, (uint32_t)isr0, KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT);
-    // Add others if needed
-
-    // Set up IRQ Gates (ensure stubs exist in idt_asm.s)
-    idt_set_gate(32, (uint32_t)irq0, KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT); // Timer
-    idt_set_gate(33, (uint32_t)irq1, KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT); // Keyboard
-    // Add others if needed
+    // Every exception and every IRQ slot gets a gate; unhandled ones are
+    // reported (exceptions) or counted and acknowledged (IRQs) by interrupts.c
+    for (int i = 0; i < IDT_EXCEPTION_COUNT; i++)
+        idt_set_gate(i, isr_stub_table[i], KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT);
+    for (int i = 0; i < IDT_IRQ_COUNT; i++)
+        idt_set_gate(IDT_IRQ_BASE + i, irq_stub_table[i], KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT);
+    // Spurious LAPIC interrupts must not be acknowledged, so they bypass irq_handler
+    idt_set_gate(APIC_SPURIOUS_VECTOR, (uint32_t)apic_spurious_stub, KERNEL_CODE_SEGMENT, IDT_INTERRUPT_GATE_32BIT);
 
     // Load the IDT register
     idt_load(&idt_p);
 
     // Enable interrupts processor-wide using the 'sti' instruction
     asm volatile("sti");
+}
+
+void idt_load_cpu()
+{
+    idt_load(&idt_p);
 }
\ No newline at end of file
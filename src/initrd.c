@@ -0,0 +1,558 @@
+// initrd.c - tar archive index with a path hash table, ls/cat/stat commands and bench initrd
+#include "initrd.h"
+#include "command.h"
+#include "kheap.h"
+#include "pmm.h"
+#include "string.h"
+#include "cpu.h"
+#include "fb.h"
+#include "klog.h"
+
+#define NAME_LEN 100
+#define PREFIX_LEN 155
+#define PATH_MAX_LEN (PREFIX_LEN + 1 + NAME_LEN)
+#define MIN_BUCKETS 16
+
+#define INITRD_BENCH_DIRS 40      // Directories in the synthetic archive...
+#define INITRD_BENCH_PER_DIR 100  // ...each with this many files: 4000 in all
+#define INITRD_BENCH_FILE_SIZE 256
+#define INITRD_BENCH_ORDER 10     // 4 MiB for the archive
+#define INITRD_BENCH_LOOKUPS 256  // Lookups or reads per timed run
+#define INITRD_BENCH_RUNS 5       // Best run is reported
+
+// ustar header (POSIX.1-1988): one block, numbers as octal text
+struct tar_header
+{
+    char name[NAME_LEN];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[PREFIX_LEN];
+    char pad[12];
+};
+
+static struct initrd root;
+static int root_status = INITRD_NO_MODULE; // Result of initrd_init
+
+static uint32_t parse_octal(const char *field, uint32_t len)
+{
+    uint32_t value = 0;
+    uint32_t i = 0;
+    while (i < len && field[i] == ' ')
+        i++;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+        value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+// Sum of the header bytes with the checksum field counted as spaces
+static uint32_t header_checksum(const struct tar_header *h)
+{
+    const uint8_t *bytes = (const uint8_t *)h;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < INITRD_BLOCK; i++)
+        sum += bytes[i];
+    for (uint32_t i = 0; i < sizeof(h->checksum); i++)
+        sum += ' ' - (uint8_t)h->checksum[i];
+    return sum;
+}
+
+// Header at '*offset', or NULL at the end of the archive; '*offset' moves
+// past the member's data. The end is two zero blocks, a bad checksum or
+// running out of module.
+static const struct tar_header *next_header(const struct initrd *fs, uint32_t *offset)
+{
+    if (*offset + INITRD_BLOCK > fs->size || *offset + INITRD_BLOCK < *offset)
+        return NULL;
+    const struct tar_header *h = (const struct tar_header *)(fs->base + *offset);
+    if (h->name[0] == '\0' || header_checksum(h) != parse_octal(h->checksum, sizeof(h->checksum)))
+        return NULL;
+
+    uint32_t size = parse_octal(h->size, sizeof(h->size));
+    uint32_t data = *offset + INITRD_BLOCK;
+    if (size > fs->size - data)
+        return NULL;
+    *offset = data + ((size + INITRD_BLOCK - 1) & ~(INITRD_BLOCK - 1));
+    return h;
+}
+
+// Skip leading "./" and "/" and drop trailing "/"; "." and "/" are the root ("")
+static const char *normalize(const char *path, uint32_t *len)
+{
+    for (;;)
+    {
+        if (path[0] == '/')
+            path++;
+        else if (path[0] == '.' && (path[1] == '/' || path[1] == '\0'))
+            path++;
+        else
+            break;
+    }
+    uint32_t n = strlen(path);
+    while (n > 0 && path[n - 1] == '/')
+        n--;
+    *len = n;
+    return path;
+}
+
+// Path of a member as stored in the header (prefix "/" name), normalized
+// into 'buffer'. Returns its length; 0 for the root or a type not served.
+static uint32_t member_path(const struct tar_header *h, char *buffer)
+{
+    char full[PATH_MAX_LEN + 1];
+    uint32_t len = 0;
+
+    if (h->typeflag != '0' && h->typeflag != '\0' && h->typeflag != '7' && h->typeflag != '5')
+        return 0; // Links, devices, pax/GNU extension headers
+    for (uint32_t i = 0; i < PREFIX_LEN && h->prefix[i]; i++)
+        full[len++] = h->prefix[i];
+    if (len > 0)
+        full[len++] = '/';
+    for (uint32_t i = 0; i < NAME_LEN && h->name[i]; i++)
+        full[len++] = h->name[i];
+    full[len] = '\0';
+
+    const char *path = normalize(full, &len);
+    memcpy(buffer, path, len);
+    buffer[len] = '\0';
+    return len;
+}
+
+static uint32_t path_hash(const char *path, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)path[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int initrd_index(struct initrd *fs, const void *archive, uint32_t size)
+{
+    char path[PATH_MAX_LEN + 1];
+    uint32_t count = 0, path_bytes = 0, offset = 0;
+    const struct tar_header *h;
+
+    memset(fs, 0, sizeof(*fs));
+    fs->base = archive;
+    fs->size = size;
+
+    // First pass sizes the index, so it takes three allocations whatever the archive
+    while ((h = next_header(fs, &offset)) != NULL)
+    {
+        uint32_t len = member_path(h, path);
+        if (len > 0)
+        {
+            count++;
+            path_bytes += len + 1;
+        }
+    }
+
+    uint32_t buckets = MIN_BUCKETS;
+    while (buckets < count)
+        buckets <<= 1;
+    fs->files = kzalloc((count ? count : 1) * sizeof(struct initrd_file));
+    fs->buckets = kzalloc(buckets * sizeof(struct initrd_file *));
+    fs->paths = kmalloc(path_bytes ? path_bytes : 1);
+    fs->bucket_mask = buckets - 1;
+    if (fs->files == NULL || fs->buckets == NULL || fs->paths == NULL)
+    {
+        initrd_free(fs);
+        return INITRD_NO_MEMORY;
+    }
+
+    // Later members go to the front of their chain, so a path stored twice
+    // resolves to the last copy, as when the archive is extracted
+    char *next_path = fs->paths;
+    offset = 0;
+    while ((h = next_header(fs, &offset)) != NULL)
+    {
+        uint32_t len = member_path(h, next_path);
+        if (len == 0)
+            continue;
+        struct initrd_file *file = &fs->files[fs->count++];
+        file->path = next_path;
+        file->data = (const uint8_t *)(h + 1);
+        file->size = parse_octal(h->size, sizeof(h->size));
+        file->type = h->typeflag == '5' ? INITRD_DIR : INITRD_FILE;
+        file->mode = parse_octal(h->mode, sizeof(h->mode)) & 07777;
+        file->mtime = parse_octal(h->mtime, sizeof(h->mtime));
+        file->hash = path_hash(next_path, len);
+        file->hash_next = fs->buckets[file->hash & fs->bucket_mask];
+        fs->buckets[file->hash & fs->bucket_mask] = file;
+        next_path += len + 1;
+    }
+    return (int)fs->count;
+}
+
+void initrd_free(struct initrd *fs)
+{
+    kfree(fs->files);
+    kfree(fs->buckets);
+    kfree(fs->paths);
+    memset(fs, 0, sizeof(*fs));
+}
+
+const struct initrd_file *initrd_lookup(const struct initrd *fs, const char *path)
+{
+    uint32_t len;
+    path = normalize(path, &len);
+    if (fs->buckets == NULL || len == 0)
+        return NULL;
+
+    uint32_t hash = path_hash(path, len);
+    for (const struct initrd_file *file = fs->buckets[hash & fs->bucket_mask]; file; file = file->hash_next)
+    {
+        if (file->hash == hash && strncmp(file->path, path, len) == 0 && file->path[len] == '\0')
+            return file;
+    }
+    return NULL;
+}
+
+int initrd_init(multiboot_info_t *mb_info)
+{
+    if (mb_info == NULL || !(mb_info->flags & MULTIBOOT_INFO_MODS) || mb_info->mods_count == 0)
+    {
+        root_status = INITRD_NO_MODULE;
+        return root_status;
+    }
+    multiboot_module_t *mod = (multiboot_module_t *)mb_info->mods_addr;
+    root_status = initrd_index(&root, (const void *)mod->mod_start, mod->mod_end - mod->mod_start);
+    return root_status;
+}
+
+const struct initrd_file *initrd_find(const char *path)
+{
+    return initrd_lookup(&root, path);
+}
+
+uint32_t initrd_read(const struct initrd_file *file, uint32_t offset, const uint8_t **data)
+{
+    if (offset >= file->size)
+    {
+        *data = NULL;
+        return 0;
+    }
+    *data = file->data + offset;
+    return file->size - offset;
+}
+
+// --- Commands ---
+
+static void no_such_file(const char *path)
+{
+    fb_write_string("No such file or directory: '", FB_RED, FB_BLACK);
+    fb_write_string(path, FB_RED, FB_BLACK);
+    fb_write_string("'\n", FB_RED, FB_BLACK);
+}
+
+static int initrd_loaded()
+{
+    if (root_status == INITRD_NO_MEMORY)
+        fb_write_string("No initrd: out of memory indexing the module.\n", FB_RED, FB_BLACK);
+    else if (root_status < 0)
+        fb_write_string("No initrd: GRUB loaded no module.\n", FB_RED, FB_BLACK);
+    return root_status >= 0;
+}
+
+static void print_entry(const struct initrd_file *file, const char *name)
+{
+    char line[96];
+    ksnprintf(line, sizeof(line), "  %10u  %s%s\n", file->size, name, file->type == INITRD_DIR ? "/" : "");
+    fb_write_string(line, file->type == INITRD_DIR ? FB_CYAN : FB_WHITE, FB_BLACK);
+}
+
+COMMAND(ls, "[path]", "List a directory of the initrd (default: the root)")
+{
+    if (!initrd_loaded())
+        return;
+
+    const char *arg = argc > 1 ? argv[1] : "/";
+    uint32_t len;
+    const char *dir = normalize(arg, &len);
+    const struct initrd_file *file = initrd_find(arg);
+    if (file != NULL && file->type == INITRD_FILE)
+    {
+        print_entry(file, file->path);
+        return;
+    }
+
+    // Direct children: "<dir>/<name>" with no further '/'. Directories
+    // without a header of their own still list.
+    uint32_t shown = 0;
+    for (uint32_t i = 0; i < root.count; i++)
+    {
+        const struct initrd_file *child = &root.files[i];
+        if (len > 0 && (strncmp(child->path, dir, len) != 0 || child->path[len] != '/'))
+            continue;
+        const char *name = child->path + (len > 0 ? len + 1 : 0);
+        const char *p = name;
+        while (*p && *p != '/')
+            p++;
+        if (*p == '\0' && initrd_find(child->path) == child) // Shadowed copies are left out
+        {
+            print_entry(child, name);
+            shown++;
+        }
+    }
+    if (shown == 0 && file == NULL && len > 0)
+        no_such_file(arg);
+}
+
+COMMAND(cat, "<path>...", "Print files of the initrd")
+{
+    char chunk[128];
+
+    if (argc < 2)
+    {
+        fb_write_string("Usage: cat <path>...\n", FB_RED, FB_BLACK);
+        return;
+    }
+    if (!initrd_loaded())
+        return;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const struct initrd_file *file = initrd_find(argv[i]);
+        if (file == NULL || file->type != INITRD_FILE)
+        {
+            no_such_file(argv[i]);
+            continue;
+        }
+
+        // The read hands out the module's own bytes; only the console needs
+        // them as NUL-terminated pieces, with unprintable bytes as '.'
+        const uint8_t *data;
+        uint32_t left = initrd_read(file, 0, &data);
+        while (left > 0)
+        {
+            uint32_t n = left < sizeof(chunk) - 1 ? left : sizeof(chunk) - 1;
+            for (uint32_t j = 0; j < n; j++)
+            {
+                uint8_t c = data[j];
+                chunk[j] = (c == '\n' || (c >= ' ' && c < 0x7F)) ? (char)c : c == '\t' ? ' ' : '.';
+            }
+            chunk[n] = '\0';
+            fb_write_string(chunk, FB_WHITE, FB_BLACK);
+            data += n;
+            left -= n;
+        }
+    }
+}
+
+COMMAND(stat, "<path>", "Show type, size, mode, time and location of an initrd member")
+{
+    char line[96];
+
+    if (argc != 2)
+    {
+        fb_write_string("Usage: stat <path>\n", FB_RED, FB_BLACK);
+        return;
+    }
+    if (!initrd_loaded())
+        return;
+
+    const struct initrd_file *file = initrd_find(argv[1]);
+    if (file == NULL)
+    {
+        no_such_file(argv[1]);
+        return;
+    }
+    ksnprintf(line, sizeof(line), "  File: %s\n", file->path);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  Type: %s  Size: %u bytes  Mode: %u%u%u%u\n",
+              file->type == INITRD_DIR ? "directory" : "file", file->size, (file->mode >> 9) & 7,
+              (file->mode >> 6) & 7, (file->mode >> 3) & 7, file->mode & 7);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  Modified: %u (seconds since 1970)\n", file->mtime);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  Data: %p (archive offset 0x%x)\n", file->data,
+              (uint32_t)(file->data - root.base));
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
+
+// --- Benchmarks ---
+
+// Zero-padded octal number filling all but the last byte of 'field'
+static void write_octal(char *field, uint32_t len, uint32_t value)
+{
+    field[len - 1] = '\0';
+    for (uint32_t i = len - 1; i > 0; i--)
+    {
+        field[i - 1] = '0' + (value & 7);
+        value >>= 3;
+    }
+}
+
+static void make_header(struct tar_header *h, const char *name, uint32_t size, char type)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->name, name, strlen(name));
+    write_octal(h->mode, sizeof(h->mode), type == '5' ? 0755 : 0644);
+    write_octal(h->uid, sizeof(h->uid), 0);
+    write_octal(h->gid, sizeof(h->gid), 0);
+    write_octal(h->size, sizeof(h->size), size);
+    write_octal(h->mtime, sizeof(h->mtime), 0);
+    h->typeflag = type;
+    memcpy(h->magic, "ustar", 6);
+    memcpy(h->version, "00", 2);
+    write_octal(h->checksum, 7, header_checksum(h)); // Six digits, NUL, then the space already counted
+    h->checksum[7] = ' ';
+}
+
+// INITRD_BENCH_DIRS directories of INITRD_BENCH_PER_DIR files in a row; the
+// first n directories are a valid archive on their own
+static uint32_t build_archive(uint8_t *archive)
+{
+    char name[32];
+    uint32_t offset = 0;
+
+    for (uint32_t d = 0; d < INITRD_BENCH_DIRS; d++)
+    {
+        ksnprintf(name, sizeof(name), "d%02u/", d);
+        make_header((struct tar_header *)(archive + offset), name, 0, '5');
+        offset += INITRD_BLOCK;
+        for (uint32_t f = 0; f < INITRD_BENCH_PER_DIR; f++)
+        {
+            ksnprintf(name, sizeof(name), "d%02u/file%03u.txt", d, f);
+            make_header((struct tar_header *)(archive + offset), name, INITRD_BENCH_FILE_SIZE, '0');
+            memset(archive + offset + INITRD_BLOCK, 'a' + f % 26, INITRD_BENCH_FILE_SIZE);
+            offset += 2 * INITRD_BLOCK;
+        }
+    }
+    memset(archive + offset, 0, 2 * INITRD_BLOCK);
+    return offset + 2 * INITRD_BLOCK;
+}
+
+static const struct initrd_file *linear_lookup(const struct initrd *fs, const char *path)
+{
+    for (uint32_t i = 0; i < fs->count; i++)
+    {
+        if (strcmp(fs->files[i].path, path) == 0)
+            return &fs->files[i];
+    }
+    return NULL;
+}
+
+enum bench_op
+{
+    OP_HASHED,
+    OP_LINEAR,
+    OP_READ, // Zero-copy read, then sum the bytes
+    OP_COPY  // What a copying read costs: memcpy to a buffer, then sum
+};
+
+// Best-of-runs cycles per operation on 'paths'
+static uint32_t time_op(const struct initrd *fs, const char *const *paths, enum bench_op op)
+{
+    static uint8_t buffer[INITRD_BENCH_FILE_SIZE];
+    uint64_t best = ~0ULL;
+    volatile uint32_t sink = 0; // Keeps the work from being optimized away
+
+    for (int run = 0; run < INITRD_BENCH_RUNS; run++)
+    {
+        uint64_t start = rdtsc();
+        for (uint32_t i = 0; i < INITRD_BENCH_LOOKUPS; i++)
+        {
+            const struct initrd_file *file =
+                op == OP_LINEAR ? linear_lookup(fs, paths[i]) : initrd_lookup(fs, paths[i]);
+            if (file == NULL || op == OP_HASHED || op == OP_LINEAR)
+            {
+                sink += file != NULL;
+                continue;
+            }
+            const uint8_t *data;
+            uint32_t len = initrd_read(file, 0, &data);
+            if (op == OP_COPY)
+            {
+                memcpy(buffer, data, len);
+                data = buffer;
+            }
+            uint32_t sum = 0;
+            for (uint32_t j = 0; j < len; j++)
+                sum += data[j];
+            sink += sum;
+        }
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+    return (uint32_t)best / INITRD_BENCH_LOOKUPS;
+}
+
+static void initrd_report(uint8_t *archive, const char **hits, const char **misses)
+{
+    static const uint32_t dirs[] = {1, 10, INITRD_BENCH_DIRS};
+    const uint32_t dir_bytes = (1 + 2 * INITRD_BENCH_PER_DIR) * INITRD_BLOCK;
+    struct initrd fs;
+    char line[96];
+
+    build_archive(archive);
+    for (uint32_t i = 0; i < INITRD_BENCH_LOOKUPS; i++)
+        misses[i] = "d00/no-such-file.txt";
+
+    ksnprintf(line, sizeof(line), "initrd, cycles (best of %u runs of %u; reads of %u-byte files):\n",
+              INITRD_BENCH_RUNS, INITRD_BENCH_LOOKUPS, INITRD_BENCH_FILE_SIZE);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("  members index/member  hash hit hash miss linear hit  zero-copy  copying\n", FB_WHITE,
+                    FB_BLACK);
+
+    for (uint32_t s = 0; s < sizeof(dirs) / sizeof(dirs[0]); s++)
+    {
+        // A prefix of whole directories, without the end blocks
+        uint64_t start = rdtsc();
+        int count = initrd_index(&fs, archive, dirs[s] * dir_bytes);
+        uint64_t index_cycles = rdtsc() - start;
+        if (count <= 0)
+        {
+            fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+            return;
+        }
+        // Hits spread evenly over the files, skipping the directory members
+        for (uint32_t i = 0; i < INITRD_BENCH_LOOKUPS; i++)
+        {
+            uint32_t index = (i * 2654435761u) % (uint32_t)count;
+            if (fs.files[index].type == INITRD_DIR)
+                index++;
+            hits[i] = fs.files[index].path;
+        }
+
+        ksnprintf(line, sizeof(line), "  %7d %12u %9u %9u %10u %10u %8u\n", count,
+                  (uint32_t)index_cycles / (uint32_t)count, time_op(&fs, hits, OP_HASHED),
+                  time_op(&fs, misses, OP_HASHED), time_op(&fs, hits, OP_LINEAR), time_op(&fs, hits, OP_READ),
+                  time_op(&fs, hits, OP_COPY));
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+        initrd_free(&fs);
+    }
+}
+
+void initrd_benchmark()
+{
+    // A synthetic archive: the loaded initrd may be small or missing
+    uint32_t archive = pmm_alloc_pages(INITRD_BENCH_ORDER);
+    const char **hits = kzalloc(INITRD_BENCH_LOOKUPS * sizeof(char *));
+    const char **misses = kzalloc(INITRD_BENCH_LOOKUPS * sizeof(char *));
+
+    if (archive && hits && misses)
+        initrd_report((uint8_t *)archive, hits, misses);
+    else
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+
+    if (archive)
+        pmm_free_pages(archive, INITRD_BENCH_ORDER);
+    kfree(hits);
+    kfree(misses);
+}
@@ -2,160 +2,417 @@
 
 #include "common.h" // For registers_t, uintN_t, size_t
 #include "fb.h"     // For printing, screen manipulation
-#include "io.h"     // For inb/outb (keyboard, PIC EOI)
-#include "shell.h"  // For shell functions (command execution, buffer management)
-
-// Define constants BEFORE use
-#define ESC 0x1B // ASCII value for the Escape key
-
-// Access the global command buffer and index (defined in shell.c)
-extern char cmd_buffer[];
-extern int cmd_buffer_idx;
-
-// --- Keyboard Handling ---
-#define KEYBOARD_DATA_PORT 0x60
-#define KEYBOARD_STATUS_PORT 0x64 // Not used here, but good to know
-
-// Simple keyboard scan code to ASCII mapping (US QWERTY layout) - Expand as needed
-// Index corresponds to scancode. 0 means unhandled/non-printable.
-const unsigned char scancode_to_ascii[] = {
-    0, ESC, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',           // 0x00-0x0E
-    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',             // 0x0F-0x1C (Enter)
-    0, /*LCTRL*/ 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',           // 0x1D-0x29
-    0, /*LSHIFT*/ '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0, /*RSHIFT*/ // 0x2A-0x36
-    0, /*KP **/ 0, /*LALT*/ ' ', 0, /*CAPS*/                                            // 0x37-0x3A
-    // F1-F10, NumLock, ScrollLock, Keypad 7-9, -, Keypad 4-6, +, Keypad 1-3, 0, . ...
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* F1-F10 */
-    0,                            /* NUMLOCK */
-    0,                            /* SCROLLLOCK */
-    0,                            /* HOME */
-    0,                            /* UP */
-    0,                            /* PGUP */
-    '-',
-    0,   /* LEFT */
-    '5', // Keypad 5 assumes NumLock is on/handled
-    0,   /* RIGHT */
-    '+',
-    0, /* END */
-    0, /* DOWN */
-    0, /* PGDN */
-    0, /* INS */
-    0, /* DEL */
+#include "io.h"     // For inb/outb (PIC EOI and ISR reads)
+#include "shell.h"  // For fb_write_dec
+#include "interrupts.h"
+#include "idt.h"  // For pic_set_mask, IDT_IRQ_BASE
+#include "cpu.h"  // For rdtsc
+#include "klog.h" // For klog
+#include "string.h"
+#include "div64.h"
+#include "apic.h" // For lapic_eoi, apic_set_irq_mask
+#include "percpu.h"
+#include "thread.h"
+#include "bench.h"
+#include "prof.h"
+#include "trace.h"
+#include "keyboard.h" // For keyboard_rearm
+#include "serial.h"   // For serial_rearm
+
+// --- Interrupt Handlers ---
+
+#define PIC1_COMMAND_PORT 0x20 // Master PIC command port
+#define PIC2_COMMAND_PORT 0xA0 // Slave PIC command port
+#define PIC_EOI 0x20           // End-of-interrupt command code
+#define PIC_READ_ISR 0x0B      // OCW3: next read of the command port returns the ISR
+
+#define IRQ_SPURIOUS_MASTER 7
+#define IRQ_SPURIOUS_SLAVE 15
+
+static interrupt_handler_t handlers[INTERRUPT_VECTORS];
+static volatile uint32_t hits[INTERRUPT_VECTORS];
+static volatile uint32_t spurious = 0;
+static int use_apic = 0; // Set by interrupts_use_apic: LAPIC EOI, I/O APIC masks
+
+// Longest time spent in irq_handler, i.e. with interrupts disabled
+static volatile uint32_t irq_max_cycles = 0;
+
+// Read by irq_common_stub in idt_asm.s
+volatile uint32_t irq_fast_entry = 1;
+volatile uint32_t irq_timing = 0;
+
+// Per CPU, indexed by struct cpu's index: CPUs take IRQs concurrently (the
+// wakeup IPI, LAPIC timers), and each only ever updates its own row
+static struct irq_cycle_stats entry_stats[SMP_MAX_CPUS][IDT_IRQ_COUNT];
+static struct irq_cycle_stats body_stats[SMP_MAX_CPUS][IDT_IRQ_COUNT];
+
+static const char *const exception_names[IDT_EXCEPTION_COUNT] = {
+    "Divide error", "Debug", "NMI", "Breakpoint", "Overflow", "BOUND range exceeded",
+    "Invalid opcode", "Device not available", "Double fault", "Coprocessor segment overrun",
+    "Invalid TSS", "Segment not present", "Stack-segment fault", "General protection fault",
+    "Page fault", "Reserved", "x87 floating-point error", "Alignment check", "Machine check",
+    "SIMD floating-point exception", "Virtualization exception", "Control protection exception",
+    "Reserved", "Reserved", "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection exception", "VMM communication exception", "Security exception", "Reserved",
+};
+
+static const char *const irq_names[IDT_IRQ_COUNT] = {
+    "PIT timer", "Keyboard", "Cascade", "COM2", "COM1", "LPT2", "Floppy", "LPT1",
+    "RTC", "ACPI/free", "Free", "Free", "PS/2 mouse", "FPU", "Primary ATA", "Secondary ATA",
+    "GSI 16", "GSI 17", "GSI 18", "GSI 19", "GSI 20", "GSI 21", "GSI 22", "GSI 23", "LAPIC timer",
+    "Wakeup IPI",
 };
 
-// --- Keyboard Handler function (Restored, but NOT called from irq_handler yet) ---
-void keyboard_handler()
+static void set_line_mask(uint8_t irq, int masked)
 {
-    unsigned char scancode = inb(KEYBOARD_DATA_PORT);
+    if (use_apic)
+        apic_set_irq_mask(irq, masked);
+    else if (irq < 16)
+        pic_set_mask(irq, masked);
+}
 
-    // Basic handling: ignore key release events (top bit set) for now
-    if (scancode & 0x80)
-    {
-        // Key release - could handle shift/ctrl release here if needed
+void register_irq_handler(uint8_t irq, interrupt_handler_t handler)
+{
+    if (irq >= IDT_IRQ_COUNT)
         return;
-    }
+    handlers[IDT_IRQ_BASE + irq] = handler;
+    set_line_mask(irq, handler == NULL);
+}
 
-    // Handle key press - Check if scancode is within our defined mapping range
-    if (scancode < sizeof(scancode_to_ascii) && scancode_to_ascii[scancode] != 0)
+void interrupts_use_apic()
+{
+    use_apic = 1;
+    for (int irq = 0; irq < IDT_IRQ_COUNT; irq++)
     {
-        char ascii = scancode_to_ascii[scancode];
-
-        if (ascii == '\n')
-        {
-            fb_write_cell_at_cursor('\n', FB_WHITE, FB_BLACK); // Echo newline
-            cmd_buffer[cmd_buffer_idx] = '\0';                 // Null-terminate (in shell's buffer)
-            if (cmd_buffer_idx > 0)
-            {                                  // Only run if command is not empty
-                run_shell_command(cmd_buffer); // Call shell function to execute
-            }
-            clear_cmd_buffer();                       // Call shell function to reset buffer
-            fb_write_string("> ", FB_CYAN, FB_BLACK); // Show prompt again
-        }
-        else if (ascii == '\b')
-        { // Handle backspace
-            if (cmd_buffer_idx > 0)
-            {
-                cmd_buffer_idx--;
-                // Erase character on screen
-                unsigned short current_col = fb_get_cursor_col();
-                unsigned short current_row = fb_get_cursor_row();
-                if (current_col == 0)
-                {
-                    if (current_row > 0)
-                    {
-                        current_row--;
-                        current_col = FB_COLS - 1;
-                    } // else, already at 0,0, can't backspace further visually
-                }
-                else
-                {
-                    current_col--;
-                }
-                fb_move_cursor(current_row, current_col);
-                fb_write_cell_at_cursor(' ', FB_WHITE, FB_BLACK); // Write space (advances cursor)
-                fb_move_cursor(current_row, current_col);         // Move back again over the space
-            }
-        }
-        else
-        {
-            // Add character to buffer if space available
-            if (cmd_buffer_idx < CMD_BUFFER_SIZE - 1)
-            {
-                cmd_buffer[cmd_buffer_idx++] = ascii;
-                fb_write_cell_at_cursor(ascii, FB_WHITE, FB_BLACK); // Echo character to screen
-            }
-        }
+        if (handlers[IDT_IRQ_BASE + irq])
+            apic_set_irq_mask(irq, 0);
     }
-}
 
-// --- Interrupt Handlers ---
+    // An edge-triggered device that raised its line while the 8259 was being
+    // masked never produces a new edge for the I/O APIC. Service the ones
+    // that hold their request until read; the PIT just ticks again.
+    keyboard_rearm();
+    serial_rearm();
+}
 
-#define PIC1_COMMAND_PORT 0x20 // Master PIC command port
-#define PIC2_COMMAND_PORT 0xA0 // Slave PIC command port
-#define PIC_EOI 0x20           // End-of-interrupt command code
+void register_exception_handler(uint8_t vector, interrupt_handler_t handler)
+{
+    if (vector < IDT_EXCEPTION_COUNT)
+        handlers[vector] = handler;
+}
 
-// Generic ISR Handler (for CPU exceptions - Restored)
+// Generic ISR Handler (for CPU exceptions)
 // Called from isr_common_stub in idt_asm.s
 // 'regs' points to the register state on the stack
 void isr_handler(registers_t *regs)
 {
-    fb_write_string("CPU Exception: ", FB_RED, FB_BLACK);
-    // Ensure fb_write_dec is declared (in shell.h/fb.h) and defined (in shell.c/fb.c)
-    fb_write_dec(regs->int_no);
-    fb_write_string(" Error Code: ", FB_RED, FB_BLACK);
-    fb_write_dec(regs->err_code);
-    fb_write_string("\nHalting system.\n", FB_RED, FB_BLACK);
+    hits[regs->int_no]++;
+    if (handlers[regs->int_no])
+    {
+        handlers[regs->int_no](regs);
+        return;
+    }
+
+    klog(KLOG_ERR, "CPU Exception %u (%s) Error Code: 0x%x EIP: 0x%08x\n", regs->int_no,
+         exception_names[regs->int_no], regs->err_code, regs->eip);
+    klog(KLOG_ERR, "Halting system.\n");
+    klog_drain(); // Nothing else will run: show the log now
     // Halt the system completely on unexpected exceptions
     asm volatile("cli; hlt");
     while (1)
         ; // Should not be reached
 }
 
-// Generic IRQ Handler (for hardware interrupts - Restored, but keyboard call commented out)
+// Fold one CPU's samples into 'into'
+static void cycle_stats_merge(struct irq_cycle_stats *into, const struct irq_cycle_stats *from)
+{
+    if (from->count == 0)
+        return;
+    if (into->count == 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+    into->count += from->count;
+    into->total += from->total;
+    for (int b = 0; b < IRQ_HIST_BUCKETS; b++)
+        into->histogram[b] += from->histogram[b];
+}
+
+static void cycle_stats_add(struct irq_cycle_stats *stats, uint32_t cycles)
+{
+    if (stats->count == 0 || cycles < stats->min)
+        stats->min = cycles;
+    if (cycles > stats->max)
+        stats->max = cycles;
+    stats->count++;
+    stats->total += cycles;
+
+    int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    if (bucket >= IRQ_HIST_BUCKETS)
+        bucket = IRQ_HIST_BUCKETS - 1;
+    stats->histogram[bucket]++;
+}
+
+// Non-zero if the PIC at 'command_port' really has 'irq' (0-7 on that PIC) in service
+static int pic_in_service(uint16_t command_port, int irq)
+{
+    outb(command_port, PIC_READ_ISR);
+    return inb(command_port) & (1 << irq);
+}
+
+// Generic IRQ Handler (for hardware interrupts)
 // Called from irq_common_stub in idt_asm.s
 // 'regs' points to the register state on the stack
+// Handlers only do top-half work (e.g. queue a scancode); anything slow
+// runs later in the shell loop with interrupts enabled.
 void irq_handler(registers_t *regs)
 {
-    // Send End-of-Interrupt (EOI) signal(s) to the PIC(s)
-    if (regs->int_no >= 40)
-    {                                     // From Slave PIC? (ISR 40-47 are IRQ 8-15)
-        outb(PIC2_COMMAND_PORT, PIC_EOI); // Send EOI to Slave
+    uint64_t start = rdtsc();
+    uint32_t irq = regs->int_no - IDT_IRQ_BASE;
+
+    if (use_apic)
+    {
+        // One uncached store instead of one or two port writes; the LAPIC
+        // reports its own spurious interrupts on a separate vector
+        lapic_eoi();
+    }
+    else
+    {
+        // A line that drops before the PIC acknowledges it is delivered as IRQ 7
+        // (or 15) without its ISR bit set. It must not be acknowledged: an EOI
+        // would retire whatever real interrupt is in service instead.
+        if (irq == IRQ_SPURIOUS_MASTER && !pic_in_service(PIC1_COMMAND_PORT, 7))
+        {
+            spurious++;
+            return;
+        }
+        if (irq == IRQ_SPURIOUS_SLAVE && !pic_in_service(PIC2_COMMAND_PORT, 7))
+        {
+            spurious++;
+            outb(PIC1_COMMAND_PORT, PIC_EOI); // The master did see a real IRQ 2
+            return;
+        }
+
+        // Send End-of-Interrupt (EOI) signal(s) to the PIC(s)
+        if (irq >= 8)
+        {                                     // From Slave PIC? (IRQ 8-15)
+            outb(PIC2_COMMAND_PORT, PIC_EOI); // Send EOI to Slave
+        }
+        outb(PIC1_COMMAND_PORT, PIC_EOI); // Send EOI to Master
+    }
+
+    TRACE(TRACE_IRQ_ENTER, irq);
+    hits[regs->int_no]++;
+    this_cpu_inc(irq_count);
+    prof_interrupt(irq, regs);
+    if (irq_timing)
+    {
+        uint32_t cpu = this_cpu_read(index);
+        uint64_t eoi = rdtsc();
+        uint64_t entry_tsc = this_cpu()->irq_entry_tsc;
+        if (handlers[regs->int_no])
+            handlers[regs->int_no](regs);
+        cycle_stats_add(&entry_stats[cpu][irq], (uint32_t)(eoi - entry_tsc));
+        cycle_stats_add(&body_stats[cpu][irq], (uint32_t)(rdtsc() - eoi));
+    }
+    else if (handlers[regs->int_no])
+    {
+        handlers[regs->int_no](regs);
+    }
+
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    if (cycles > irq_max_cycles)
+        irq_max_cycles = cycles;
+
+    TRACE(TRACE_IRQ_EXIT, irq);
+    // Preemption point: may switch threads and come back much later
+    thread_irq_exit();
+}
+
+void irq_set_fast_entry(int enable)
+{
+    irq_fast_entry = enable != 0;
+}
+
+int irq_fast_entry_enabled()
+{
+    return irq_fast_entry;
+}
+
+void irq_set_timing(int enable)
+{
+    irq_timing = enable != 0;
+}
+
+int irq_timing_enabled()
+{
+    return irq_timing;
+}
+
+void irq_get_timing(uint8_t vector, struct irq_cycle_stats *entry, struct irq_cycle_stats *body)
+{
+    uint32_t irq = vector - IDT_IRQ_BASE;
+    if (irq >= IDT_IRQ_COUNT)
+    {
+        memset(entry, 0, sizeof(*entry));
+        memset(body, 0, sizeof(*body));
+        return;
     }
-    outb(PIC1_COMMAND_PORT, PIC_EOI); // Send EOI to Master
-
-    // Handle the specific hardware interrupt based on its number
-    if (regs->int_no == 33)
-    { // IRQ 1 (Keyboard) -> ISR 33
-        keyboard_handler();
-        // --- You could print a character here to see if IRQ 1 arrives ---
-        // fb_write_cell_at_cursor('K', FB_MAGENTA, FB_BLACK);
+    memset(entry, 0, sizeof(*entry));
+    memset(body, 0, sizeof(*body));
+
+    // Interrupts off keeps this CPU's row consistent; rows of CPUs still
+    // taking IRQs may be caught mid-update
+    uint32_t flags = irq_save();
+    for (int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+    {
+        cycle_stats_merge(entry, &entry_stats[cpu][irq]);
+        cycle_stats_merge(body, &body_stats[cpu][irq]);
     }
-    else if (regs->int_no == 32)
-    { // IRQ 0 (Timer) -> ISR 32
-      // Timer handler code would go here (e.g., increment tick counter)
-      // For now, do nothing.
-      // --- You could print a character here to see if IRQ 0 arrives ---
-      // fb_write_cell_at_cursor('.', FB_CYAN, FB_BLACK);
+    irq_restore(flags);
+}
+
+void irq_reset_timing()
+{
+    uint32_t flags = irq_save();
+    memset(entry_stats, 0, sizeof(entry_stats));
+    memset(body_stats, 0, sizeof(body_stats));
+    irq_restore(flags);
+}
+
+uint32_t interrupt_hits(uint8_t vector)
+{
+    return vector < INTERRUPT_VECTORS ? hits[vector] : 0;
+}
+
+uint32_t irq_spurious_count()
+{
+    return spurious;
+}
+
+const char *interrupt_name(uint8_t vector)
+{
+    if (vector < IDT_EXCEPTION_COUNT)
+        return exception_names[vector];
+    if (vector < INTERRUPT_VECTORS)
+        return irq_names[vector - IDT_IRQ_BASE];
+    return "Unknown";
+}
+
+// --- Port I/O benchmark ---
+// Times the port writes of one timer/keyboard interrupt plus one console
+// flush: a master EOI and the four CRTC writes that move the cursor.
+
+#define IO_BENCH_ROUNDS 1000
+#define CRTC_INDEX_PORT 0x3D4
+#define CRTC_DATA_PORT 0x3D5
+
+static uint32_t io_bench_inline(unsigned short pos)
+{
+    uint64_t start = rdtsc();
+    for (int i = 0; i < IO_BENCH_ROUNDS; i++)
+    {
+        outb(PIC1_COMMAND_PORT, PIC_EOI);
+        outb(CRTC_INDEX_PORT, 14);
+        outb(CRTC_DATA_PORT, (pos >> 8) & 0xFF);
+        outb(CRTC_INDEX_PORT, 15);
+        outb(CRTC_DATA_PORT, pos & 0xFF);
     }
-    // Add 'else if' blocks for other IRQs you want to handle
-}
\ No newline at end of file
+    return (uint32_t)(rdtsc() - start);
+}
+
+static uint32_t io_bench_call(unsigned short pos)
+{
+    uint64_t start = rdtsc();
+    for (int i = 0; i < IO_BENCH_ROUNDS; i++)
+    {
+        outb_call(PIC1_COMMAND_PORT, PIC_EOI);
+        outb_call(CRTC_INDEX_PORT, 14);
+        outb_call(CRTC_DATA_PORT, (pos >> 8) & 0xFF);
+        outb_call(CRTC_INDEX_PORT, 15);
+        outb_call(CRTC_DATA_PORT, pos & 0xFF);
+    }
+    return (uint32_t)(rdtsc() - start);
+}
+
+void io_benchmark()
+{
+    // Rewrite the cursor's current position so the screen does not change.
+    // Interrupts stay off so no IRQ is in service while the EOIs are sent.
+    unsigned short pos = fb_get_cursor_row() * FB_COLS + fb_get_cursor_col();
+    asm volatile("cli");
+    uint32_t call_cycles = io_bench_call(pos);
+    uint32_t inline_cycles = io_bench_inline(pos);
+    asm volatile("sti");
+
+    fb_write_string("EOI + cursor update (5 port writes):\n", FB_GREEN, FB_BLACK);
+    fb_write_string("  out-of-line outb: ", FB_WHITE, FB_BLACK);
+    fb_write_dec(call_cycles / IO_BENCH_ROUNDS);
+    fb_write_string(" cycles\n  inline outb:      ", FB_WHITE, FB_BLACK);
+    fb_write_dec(inline_cycles / IO_BENCH_ROUNDS);
+    fb_write_string(" cycles\n", FB_WHITE, FB_BLACK);
+}
+
+uint32_t irq_max_disabled_cycles()
+{
+    return irq_max_cycles;
+}
+
+void irq_reset_max_disabled_cycles()
+{
+    irq_max_cycles = 0;
+}
+
+// --- IRQ entry benchmark ---
+// Raises a free PIC vector with 'int' so the full stub + irq_handler + iret
+// round trip is timed without waiting for hardware.
+
+#define IRQ_BENCH_ROUNDS 10000
+#define IRQ_BENCH_VECTOR 43 // IRQ 11: free on the PC/AT map, no handler registered
+
+static uint32_t irq_bench_round_trip()
+{
+    uint64_t start = rdtsc();
+    for (int i = 0; i < IRQ_BENCH_ROUNDS; i++)
+        asm volatile("int %0" : : "i"(IRQ_BENCH_VECTOR) : "memory");
+    return (uint32_t)div64_u32(rdtsc() - start, IRQ_BENCH_ROUNDS, NULL);
+}
+
+void irq_benchmark()
+{
+    uint32_t saved_fast = irq_fast_entry;
+    uint32_t saved_timing = irq_timing;
+    uint32_t saved_hits = hits[IRQ_BENCH_VECTOR];
+
+    // Interrupts off so timer/keyboard IRQs don't land inside the loops
+    irq_timing = 0;
+    uint32_t flags = irq_save();
+    irq_fast_entry = 1;
+    uint32_t fast = irq_bench_round_trip();
+    irq_fast_entry = 0;
+    uint32_t slow = irq_bench_round_trip();
+    irq_restore(flags);
+
+    irq_fast_entry = saved_fast;
+    irq_timing = saved_timing;
+    hits[IRQ_BENCH_VECTOR] = saved_hits;
+
+    char line[64];
+    fb_write_string("IRQ round trip (int + stub + irq_handler + EOI + iret):\n", FB_GREEN, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  fast entry (no segment reloads): %u cycles\n", fast);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  slow entry (save/reload DS-FS):  %u cycles\n", slow);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
+
+// Registered version of the round trip on the current entry path
+BENCHMARK(irq_roundtrip, "int + IRQ stub + irq_handler + EOI + iret", 100)
+{
+    uint32_t saved_timing = irq_timing;
+    uint32_t saved_hits = hits[IRQ_BENCH_VECTOR];
+    irq_timing = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        asm volatile("int %0" : : "i"(IRQ_BENCH_VECTOR) : "memory");
+    irq_timing = saved_timing;
+    hits[IRQ_BENCH_VECTOR] = saved_hits;
+}
@@ -0,0 +1,277 @@
+// keyboard.c - PS/2 keyboard driver (lock-free scancode ring, decoding in the shell loop)
+#include "keyboard.h"
+#include "io.h"
+#include "interrupts.h"
+#include "trace.h"
+#include "cpu.h"
+#include "fb.h"
+#include "shell.h" // For the line editor and fb_write_dec in the benchmark
+
+// Define constants BEFORE use
+#define ESC 0x1B // ASCII value for the Escape key
+
+#define KEYBOARD_DATA_PORT 0x60
+#define KEYBOARD_STATUS_PORT 0x64
+#define KEYBOARD_STATUS_OUTPUT_FULL 0x01
+#define KEYBOARD_IRQ 1
+
+#define KBD_RING_MASK (KBD_RING_SIZE - 1)
+
+// Keep the compiler from reordering ring accesses around index updates.
+// x86 does not reorder stores with stores or loads with loads, so on one
+// CPU this is all a single-producer/single-consumer ring needs.
+#define barrier() asm volatile("" ::: "memory")
+
+// Modifier and prefix scancodes
+#define SC_EXTENDED 0xE0 // Prefix for the grey (non-keypad) cursor keys, right Ctrl/Alt
+#define SC_LCTRL 0x1D
+#define SC_LSHIFT 0x2A
+#define SC_RSHIFT 0x36
+#define SC_LALT 0x38
+
+// Simple keyboard scan code to ASCII mapping (US QWERTY layout) - Expand as needed
+// Index corresponds to scancode. 0 means unhandled, values >= 0x80 are KEY_* codes.
+const unsigned char scancode_to_ascii[] = {
+    0, ESC, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',           // 0x00-0x0E
+    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',             // 0x0F-0x1C (Enter)
+    0, /*LCTRL*/ 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',           // 0x1D-0x29
+    0, /*LSHIFT*/ '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0, /*RSHIFT*/ // 0x2A-0x36
+    0, /*KP **/ 0, /*LALT*/ ' ', 0, /*CAPS*/                                            // 0x37-0x3A
+    KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10,    // 0x3B-0x44
+    0,         /* NUMLOCK */
+    0,         /* SCROLLLOCK */
+    KEY_HOME,  // 0x47 (Keypad 7)
+    KEY_UP,    // 0x48 (Keypad 8)
+    KEY_PGUP,  // 0x49 (Keypad 9)
+    '-',
+    KEY_LEFT,  // 0x4B (Keypad 4)
+    '5',       // Keypad 5 assumes NumLock is on/handled
+    KEY_RIGHT, // 0x4D (Keypad 6)
+    '+',
+    KEY_END,   // 0x4F (Keypad 1)
+    KEY_DOWN,  // 0x50 (Keypad 2)
+    KEY_PGDN,  // 0x51 (Keypad 3)
+    KEY_INS,   // 0x52 (Keypad 0)
+    KEY_DEL,   // 0x53 (Keypad .)
+    0, 0, 0,   // 0x54-0x56
+    KEY_F11,   // 0x57
+    KEY_F12,   // 0x58
+};
+
+// Same layout with Shift held (only printable keys differ)
+const unsigned char scancode_to_ascii_shift[] = {
+    0, ESC, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+', '\b',            // 0x00-0x0E
+    '\t', 'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}', '\n',             // 0x0F-0x1C
+    0, 'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',                     // 0x1D-0x29
+    0, '|', 'Z', 'X', 'C', 'V', 'B', 'N', 'M', '<', '>', '?', 0,                       // 0x2A-0x36
+    0, 0, ' ', 0,                                                                      // 0x37-0x3A
+    KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10,    // 0x3B-0x44
+    0, 0, KEY_HOME, KEY_UP, KEY_PGUP, '-', KEY_LEFT, '5', KEY_RIGHT, '+',               // 0x45-0x4E
+    KEY_END, KEY_DOWN, KEY_PGDN, KEY_INS, KEY_DEL, 0, 0, 0, KEY_F11, KEY_F12,            // 0x4F-0x58
+};
+
+// Written only by keyboard_irq (producer), read only by the shell loop (consumer)
+static volatile uint8_t ring[KBD_RING_SIZE];
+static volatile uint32_t ring_head = 0; // Next slot to write (producer)
+static volatile uint32_t ring_tail = 0; // Next slot to read (consumer)
+static volatile uint32_t received = 0;
+static volatile uint32_t dropped = 0;
+
+// Decoder state (consumer side only)
+static int extended = 0; // Last scancode was the 0xE0 prefix
+static int shift_down = 0;
+static int ctrl_down = 0;
+static int alt_down = 0;
+
+// Everything IRQ 1 does after reading the data port
+static void queue_scancode(unsigned char scancode)
+{
+    uint32_t head = ring_head;
+    TRACE(TRACE_KBD_SCANCODE, scancode);
+
+    if (head - ring_tail >= KBD_RING_SIZE)
+    {
+        dropped++; // Consumer fell a whole ring behind
+        return;
+    }
+    ring[head & KBD_RING_MASK] = scancode;
+    barrier(); // Publish the data before the new head
+    ring_head = head + 1;
+    received++;
+}
+
+static void keyboard_irq(registers_t *regs)
+{
+    (void)regs;
+    // Nothing to read: spurious, or keyboard_rearm already took the byte
+    if (!(inb(KEYBOARD_STATUS_PORT) & KEYBOARD_STATUS_OUTPUT_FULL))
+        return;
+    queue_scancode(inb(KEYBOARD_DATA_PORT));
+}
+
+void keyboard_init()
+{
+    register_irq_handler(KEYBOARD_IRQ, keyboard_irq);
+}
+
+void keyboard_rearm()
+{
+    uint32_t flags = irq_save();
+    // The 8042 raises IRQ 1 once per byte and sends nothing more until it is read
+    if (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_STATUS_OUTPUT_FULL)
+        queue_scancode(inb(KEYBOARD_DATA_PORT));
+    irq_restore(flags);
+}
+
+int keyboard_has_input()
+{
+    return ring_head != ring_tail;
+}
+
+// Pop one raw scancode, -1 if the ring is empty
+static int read_scancode()
+{
+    uint32_t tail = ring_tail;
+    if (tail == ring_head)
+        return -1;
+    barrier(); // Read the data only after seeing the head
+    unsigned char scancode = ring[tail & KBD_RING_MASK];
+    barrier();
+    ring_tail = tail + 1;
+    return scancode;
+}
+
+int keyboard_getchar()
+{
+    int scancode;
+    while ((scancode = read_scancode()) >= 0)
+    {
+        if (scancode == SC_EXTENDED)
+        {
+            extended = 1;
+            continue;
+        }
+        int was_extended = extended;
+        extended = 0;
+
+        int released = scancode & 0x80;
+        int code = scancode & 0x7F;
+
+        // Track modifiers on both press and release
+        if (code == SC_LSHIFT || code == SC_RSHIFT)
+        {
+            if (!was_extended) // E0 2A/E0 AA are fake shifts around grey keys
+                shift_down = !released;
+            continue;
+        }
+        if (code == SC_LCTRL)
+        {
+            ctrl_down = !released;
+            continue;
+        }
+        if (code == SC_LALT)
+        {
+            alt_down = !released;
+            continue;
+        }
+
+        // Otherwise ignore key release events
+        if (released || (unsigned int)code >= sizeof(scancode_to_ascii))
+            continue;
+
+        int key = shift_down ? scancode_to_ascii_shift[code] : scancode_to_ascii[code];
+        if (was_extended)
+            key = scancode_to_ascii[code]; // Grey keys (E0 xx) are not affected by Shift
+        if (key == 0)
+            continue;
+
+        // Special keys carry the modifier state with them
+        if (key >= 0x80)
+        {
+            if (shift_down)
+                key |= KEY_MOD_SHIFT;
+            if (ctrl_down)
+                key |= KEY_MOD_CTRL;
+            if (alt_down)
+                key |= KEY_MOD_ALT;
+        }
+        return key;
+    }
+    return -1;
+}
+
+uint32_t keyboard_received_count()
+{
+    return received;
+}
+
+uint32_t keyboard_dropped_count()
+{
+    return dropped;
+}
+
+// --- Benchmark ---
+
+// "uptime" and Enter as make/break pairs (scancode set 1)
+static const unsigned char bench_scancodes[] = {
+    0x16, 0x96, 0x19, 0x99, 0x14, 0x94, 0x17, 0x97, 0x32, 0xB2, 0x12, 0x92, 0x1C, 0x9C,
+};
+
+#define BENCH_SCANCODES (sizeof(bench_scancodes) / sizeof(bench_scancodes[0]))
+
+static void bench_drain()
+{
+    int key;
+    while ((key = keyboard_getchar()) >= 0)
+        shell_input_key(key);
+}
+
+// Type the script once and record the interrupts-off window per scancode.
+// 'in_irq' repeats what IRQ 1 did before the ring: decode, echo and run the
+// command before returning. Otherwise the window is the handler alone and
+// the shell loop's work happens after interrupts are back on.
+static void bench_type(int in_irq, uint32_t *max_cycles, uint32_t *total_cycles)
+{
+    *max_cycles = 0;
+    *total_cycles = 0;
+    clear_cmd_buffer(); // The line still holds "bench kbd"
+    for (uint32_t i = 0; i < BENCH_SCANCODES; i++)
+    {
+        uint32_t flags = irq_save();
+        uint64_t start = rdtsc();
+        queue_scancode(bench_scancodes[i]);
+        if (in_irq)
+            bench_drain();
+        uint32_t cycles = (uint32_t)(rdtsc() - start);
+        irq_restore(flags);
+        if (!in_irq)
+            bench_drain();
+
+        *total_cycles += cycles;
+        if (cycles > *max_cycles)
+            *max_cycles = cycles;
+    }
+}
+
+static void bench_report(const char *label, uint32_t max_cycles, uint32_t total_cycles)
+{
+    fb_write_string(label, FB_WHITE, FB_BLACK);
+    fb_write_dec(max_cycles);
+    fb_write_string(" cycles max, ", FB_WHITE, FB_BLACK);
+    fb_write_dec(total_cycles / BENCH_SCANCODES);
+    fb_write_string(" mean\n", FB_WHITE, FB_BLACK);
+}
+
+void keyboard_benchmark()
+{
+    uint32_t before_max, before_total, after_max, after_total;
+
+    // The scancodes go through the real ring and line editor, so each pass
+    // echoes "uptime" and runs it
+    bench_type(1, &before_max, &before_total);
+    bench_type(0, &after_max, &after_total);
+
+    fb_write_string("Interrupts-off window per scancode (typing 'uptime' + Enter):\n", FB_GREEN, FB_BLACK);
+    bench_report("  processing in IRQ 1 (before): ", before_max, before_total);
+    bench_report("  queue only, shell decodes:    ", after_max, after_total);
+}
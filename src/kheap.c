@@ -0,0 +1,367 @@
+// kheap.c - Slab-based kmalloc/kfree
+#include "kheap.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "fb.h"
+#include "shell.h" // For fb_write_dec
+#include "string.h"
+#include "spinlock.h"
+#include "klog.h"
+
+// Objects start this far into a slab; the rest of the slab is objects only
+// (no per-object header), so a 4 KiB slab of 32-byte objects wastes 32 bytes.
+#define SLAB_HEADER_SIZE 32
+
+// Slabs are sized to hold at least this many objects after the header
+#define SLAB_MIN_OBJECTS 16
+
+// pmm owner tag for large allocations: (order << 1) | 1. Slab headers are
+// page aligned, so an odd owner value can never be confused with one.
+#define LARGE_TAG(order) (((order) << 1) | 1)
+#define LARGE_ORDER(tag) ((tag) >> 1)
+
+struct kmem_cache;
+
+// Lives at the start of every slab
+struct slab
+{
+    struct kmem_cache *cache;
+    struct slab *next;
+    struct slab *prev;
+    void *free_list;   // LIFO list threaded through the free objects
+    uint16_t in_use;
+    uint16_t capacity;
+};
+
+struct kmem_cache
+{
+    uint32_t object_size;
+    uint32_t slab_order;
+    uint32_t capacity; // Objects per slab
+    struct slab *partial;
+    struct slab *full;
+    struct slab *empty; // At most one spare slab is kept around
+    uint32_t slabs;
+    uint32_t objects_in_use;
+    uint32_t alloc_count;
+    uint32_t free_count;
+};
+
+static struct kmem_cache caches[KHEAP_CACHE_COUNT];
+static struct kheap_large_stats large_stats;
+
+// One lock for every cache and the large-object counters. It is taken before
+// the frame allocator's when a slab is created or destroyed, never after.
+static struct spinlock lock;
+
+// --- Slab list helpers ---
+
+static void slab_unlink(struct slab **list, struct slab *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static void slab_push(struct slab **list, struct slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+// Grab pages for a new slab and thread its free list
+static struct slab *slab_create(struct kmem_cache *cache)
+{
+    uint32_t addr = pmm_alloc_pages(cache->slab_order);
+    if (addr == 0)
+        return NULL;
+    pmm_set_owner(addr, cache->slab_order, addr);
+
+    struct slab *slab = (struct slab *)addr;
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->in_use = 0;
+    slab->capacity = cache->capacity;
+
+    // Build the list back to front so the lowest object is handed out first
+    char *objects = (char *)addr + SLAB_HEADER_SIZE;
+    void *head = NULL;
+    for (int i = cache->capacity - 1; i >= 0; i--)
+    {
+        void **obj = (void **)(objects + i * cache->object_size);
+        *obj = head;
+        head = obj;
+    }
+    slab->free_list = head;
+    cache->slabs++;
+    return slab;
+}
+
+static void slab_destroy(struct kmem_cache *cache, struct slab *slab)
+{
+    pmm_set_owner((uint32_t)slab, cache->slab_order, 0);
+    pmm_free_pages((uint32_t)slab, cache->slab_order);
+    cache->slabs--;
+}
+
+// --- Cache operations ---
+
+static void *cache_alloc(struct kmem_cache *cache)
+{
+    struct slab *slab = cache->partial;
+    if (slab == NULL)
+    {
+        slab = cache->empty;
+        if (slab)
+            cache->empty = NULL;
+        else
+            slab = slab_create(cache);
+        if (slab == NULL)
+            return NULL;
+        slab_push(&cache->partial, slab);
+    }
+
+    void **obj = (void **)slab->free_list;
+    slab->free_list = *obj;
+    slab->in_use++;
+    if (slab->in_use == slab->capacity)
+    {
+        slab_unlink(&cache->partial, slab);
+        slab_push(&cache->full, slab);
+    }
+    cache->objects_in_use++;
+    cache->alloc_count++;
+    return obj;
+}
+
+static void cache_free(struct slab *slab, void *ptr)
+{
+    struct kmem_cache *cache = slab->cache;
+
+    // Push to the front: the next allocation reuses the most recently freed
+    // (and most likely still cached) object
+    *(void **)ptr = slab->free_list;
+    slab->free_list = ptr;
+
+    if (slab->in_use == slab->capacity)
+    {
+        slab_unlink(&cache->full, slab);
+        slab_push(&cache->partial, slab);
+    }
+    slab->in_use--;
+    cache->objects_in_use--;
+    cache->free_count++;
+
+    if (slab->in_use == 0)
+    {
+        slab_unlink(&cache->partial, slab);
+        if (cache->empty == NULL)
+            cache->empty = slab;
+        else
+            slab_destroy(cache, slab);
+    }
+}
+
+static int cache_index(size_t size)
+{
+    int index = 0;
+    uint32_t object_size = KHEAP_MIN_SIZE;
+    while (object_size < size)
+    {
+        object_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+// --- Public API ---
+
+void kheap_init()
+{
+    memset(caches, 0, sizeof(caches));
+    memset(&large_stats, 0, sizeof(large_stats));
+
+    uint32_t size = KHEAP_MIN_SIZE;
+    for (int i = 0; i < KHEAP_CACHE_COUNT; i++, size <<= 1)
+    {
+        uint32_t order = 0;
+        while (((PAGE_SIZE << order) - SLAB_HEADER_SIZE) / size < SLAB_MIN_OBJECTS)
+            order++;
+        caches[i].object_size = size;
+        caches[i].slab_order = order;
+        caches[i].capacity = ((PAGE_SIZE << order) - SLAB_HEADER_SIZE) / size;
+    }
+}
+
+void *kmalloc(size_t size)
+{
+    if (size == 0)
+        return NULL;
+    if (size <= KHEAP_MAX_SIZE)
+    {
+        uint32_t flags = spin_lock_irqsave(&lock);
+        void *obj = cache_alloc(&caches[cache_index(size)]);
+        spin_unlock_irqrestore(&lock, flags);
+        return obj;
+    }
+
+    // Large objects get whole, naturally aligned pages. Anything bigger than
+    // the largest buddy block can never be satisfied (and would overflow the
+    // order search below).
+    if (size > ((size_t)PAGE_SIZE << PMM_MAX_ORDER))
+        return NULL;
+    unsigned int order = 0;
+    while (((uint32_t)PAGE_SIZE << order) < size)
+        order++;
+    uint32_t addr = pmm_alloc_pages(order);
+    if (addr == 0)
+        return NULL;
+    pmm_set_owner(addr, order, LARGE_TAG(order));
+    uint32_t flags = spin_lock_irqsave(&lock);
+    large_stats.pages_in_use += 1u << order;
+    large_stats.bytes_requested += size;
+    large_stats.alloc_count++;
+    spin_unlock_irqrestore(&lock, flags);
+    return (void *)addr;
+}
+
+void *kzalloc(size_t size)
+{
+    void *ptr = kmalloc(size);
+    if (ptr)
+        memset(ptr, 0, size);
+    return ptr;
+}
+
+void kfree(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    uint32_t owner = pmm_get_owner((uint32_t)ptr);
+    if (owner == 0)
+        return; // Not a heap pointer
+
+    if (owner & 1)
+    {
+        unsigned int order = LARGE_ORDER(owner);
+        pmm_set_owner((uint32_t)ptr, order, 0);
+        pmm_free_pages((uint32_t)ptr, order);
+        uint32_t flags = spin_lock_irqsave(&lock);
+        large_stats.pages_in_use -= 1u << order;
+        large_stats.free_count++;
+        spin_unlock_irqrestore(&lock, flags);
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&lock);
+    cache_free((struct slab *)owner, ptr);
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+void kheap_get_cache_stats(int index, struct kheap_cache_stats *stats)
+{
+    struct kmem_cache *cache = &caches[index];
+    uint32_t flags = spin_lock_irqsave(&lock);
+    stats->object_size = cache->object_size;
+    stats->slab_pages = 1u << cache->slab_order;
+    stats->slabs = cache->slabs;
+    stats->objects_in_use = cache->objects_in_use;
+    stats->objects_total = cache->slabs * cache->capacity;
+    stats->alloc_count = cache->alloc_count;
+    stats->free_count = cache->free_count;
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+void kheap_get_large_stats(struct kheap_large_stats *stats)
+{
+    uint32_t flags = spin_lock_irqsave(&lock);
+    *stats = large_stats;
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+// --- Benchmark ---
+
+#define BENCH_SLOTS 512
+#define BENCH_OPS 20000
+
+static void *bench_slots[BENCH_SLOTS];
+
+// xorshift32: cheap, deterministic pseudo-random numbers
+static uint32_t bench_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Mostly small objects, with an occasional large (page-backed) one
+static size_t bench_size(uint32_t r)
+{
+    if ((r & 0xFF) == 0)
+        return KHEAP_MAX_SIZE + 1 + (r >> 20); // ~1 in 256: large path
+    return KHEAP_MIN_SIZE / 2 + ((r >> 8) % 512);
+}
+
+void kheap_benchmark()
+{
+    uint32_t seed = 0x12345678;
+    uint32_t alloc_cycles = 0, free_cycles = 0;
+    uint32_t allocs = 0, frees = 0, failed = 0;
+
+    memset(bench_slots, 0, sizeof(bench_slots));
+    for (int op = 0; op < BENCH_OPS; op++)
+    {
+        uint32_t r = bench_rand(&seed);
+        int slot = r % BENCH_SLOTS;
+        if (bench_slots[slot])
+        {
+            uint64_t t0 = rdtsc();
+            kfree(bench_slots[slot]);
+            free_cycles += (uint32_t)(rdtsc() - t0);
+            bench_slots[slot] = NULL;
+            frees++;
+        }
+        else
+        {
+            size_t size = bench_size(bench_rand(&seed));
+            uint64_t t0 = rdtsc();
+            bench_slots[slot] = kmalloc(size);
+            alloc_cycles += (uint32_t)(rdtsc() - t0);
+            if (bench_slots[slot])
+                allocs++;
+            else
+                failed++;
+        }
+    }
+    for (int i = 0; i < BENCH_SLOTS; i++)
+        kfree(bench_slots[i]);
+
+    // Requests past the largest buddy block must fail rather than spin or wrap
+    if (kmalloc(((size_t)PAGE_SIZE << PMM_MAX_ORDER) + 1) != NULL || kmalloc(0x90000000) != NULL)
+        klog(KLOG_ERR, "kheap: oversized kmalloc did not return NULL\n");
+
+    fb_write_string("kmalloc stress benchmark (random alloc/free mix):\n", FB_GREEN, FB_BLACK);
+    fb_write_string("  kmalloc: ", FB_WHITE, FB_BLACK);
+    fb_write_dec(allocs ? alloc_cycles / allocs : 0);
+    fb_write_string(" cycles/op (", FB_WHITE, FB_BLACK);
+    fb_write_dec(allocs);
+    fb_write_string(" ops, ", FB_WHITE, FB_BLACK);
+    fb_write_dec(failed);
+    fb_write_string(" failed)\n  kfree:   ", FB_WHITE, FB_BLACK);
+    fb_write_dec(frees ? free_cycles / frees : 0);
+    fb_write_string(" cycles/op (", FB_WHITE, FB_BLACK);
+    fb_write_dec(frees);
+    fb_write_string(" ops)\n", FB_WHITE, FB_BLACK);
+}
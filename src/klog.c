@@ -0,0 +1,327 @@
+// klog.c - kprintf formatter and lock-free kernel log ring
+#include "klog.h"
+#include "fb.h"
+#include "timer.h"
+#include "div64.h"
+#include "string.h"
+
+#define KLOG_MASK (KLOG_RECORD_COUNT - 1)
+
+// One log entry. 'seq' is the reservation number + 1 once the record is
+// complete and 0 while a writer is filling it in.
+struct klog_record
+{
+    volatile uint32_t seq;
+    uint8_t level;
+    uint8_t reserved[3];
+    uint64_t timestamp_ns;
+    char msg[KLOG_MSG_LEN];
+};
+
+static struct klog_record ring[KLOG_RECORD_COUNT];
+static volatile uint32_t next_seq = 0; // Next reservation number (lock xadd)
+
+// Reader side (shell loop only)
+static uint32_t drain_seq = 0;
+static int console_level = KLOG_INFO;
+
+// --- Formatter ---
+
+struct out
+{
+    char *buf;
+    size_t size;
+    size_t len; // Characters produced so far, including any that did not fit
+};
+
+static void out_char(struct out *o, char c)
+{
+    if (o->len + 1 < o->size)
+        o->buf[o->len] = c;
+    o->len++;
+}
+
+static void out_pad(struct out *o, char c, int count)
+{
+    while (count-- > 0)
+        out_char(o, c);
+}
+
+// Emit 'str' of length 'len' right- or left-justified in 'width'
+static void out_field(struct out *o, const char *str, int len, int width, int left, char pad)
+{
+    if (!left)
+        out_pad(o, pad, width - len);
+    for (int i = 0; i < len; i++)
+        out_char(o, str[i]);
+    if (left)
+        out_pad(o, ' ', width - len);
+}
+
+static void out_number(struct out *o, uint64_t value, uint32_t base, int negative, int upper,
+                       int width, int left, char pad)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char tmp[24];
+    int i = sizeof(tmp);
+
+    do
+    {
+        uint32_t rem;
+        if (base == 16)
+        {
+            rem = (uint32_t)value & 0xF;
+            value >>= 4;
+        }
+        else
+        {
+            value = div64_u32(value, base, &rem);
+        }
+        tmp[--i] = digits[rem];
+    } while (value);
+
+    int len = sizeof(tmp) - i;
+    if (negative)
+    {
+        // With zero padding the sign goes before the zeros: -0042
+        if (pad == '0' && !left)
+        {
+            out_char(o, '-');
+            width--;
+        }
+        else
+        {
+            tmp[--i] = '-';
+            len++;
+        }
+    }
+    out_field(o, &tmp[i], len, width, left, pad);
+}
+
+int kvsnprintf(char *buf, size_t size, const char *fmt, va_list ap)
+{
+    struct out o = {buf, size, 0};
+
+    for (; *fmt; fmt++)
+    {
+        if (*fmt != '%')
+        {
+            out_char(&o, *fmt);
+            continue;
+        }
+        fmt++;
+
+        int left = 0;
+        char pad = ' ';
+        for (;; fmt++)
+        {
+            if (*fmt == '-')
+                left = 1;
+            else if (*fmt == '0')
+                pad = '0';
+            else
+                break;
+        }
+
+        int width = 0;
+        while (*fmt >= '0' && *fmt <= '9')
+            width = width * 10 + (*fmt++ - '0');
+
+        int longs = 0;
+        while (*fmt == 'l')
+        {
+            longs++;
+            fmt++;
+        }
+
+        switch (*fmt)
+        {
+        case 'd':
+        case 'i':
+        {
+            int64_t value = longs >= 2 ? va_arg(ap, int64_t) : va_arg(ap, int32_t);
+            int negative = value < 0;
+            out_number(&o, negative ? -(uint64_t)value : (uint64_t)value, 10, negative, 0, width, left, pad);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        {
+            uint64_t value = longs >= 2 ? va_arg(ap, uint64_t) : va_arg(ap, uint32_t);
+            out_number(&o, value, *fmt == 'u' ? 10 : 16, 0, *fmt == 'X', width, left, pad);
+            break;
+        }
+        case 'p':
+            out_char(&o, '0');
+            out_char(&o, 'x');
+            out_number(&o, (uint32_t)va_arg(ap, void *), 16, 0, 0, 8, 0, '0');
+            break;
+        case 's':
+        {
+            const char *str = va_arg(ap, const char *);
+            if (str == NULL)
+                str = "(null)";
+            out_field(&o, str, strlen(str), width, left, ' ');
+            break;
+        }
+        case 'c':
+        {
+            char c = (char)va_arg(ap, int);
+            out_field(&o, &c, 1, width, left, ' ');
+            break;
+        }
+        case '%':
+            out_char(&o, '%');
+            break;
+        case '\0':
+            fmt--; // Lone '%' at the end: stop at the terminator
+            break;
+        default:
+            // Unknown conversion: print it as written
+            out_char(&o, '%');
+            out_char(&o, *fmt);
+            break;
+        }
+    }
+
+    if (size > 0)
+        buf[o.len < size ? o.len : size - 1] = '\0';
+    return o.len;
+}
+
+int ksnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = kvsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    return len;
+}
+
+// --- Log ring ---
+
+void kvlog(int level, const char *fmt, va_list ap)
+{
+    // Claim a slot with one lock xadd; concurrent writers (IRQs now, other
+    // CPUs later) each get their own record and never wait for each other
+    uint32_t seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+    struct klog_record *rec = &ring[seq & KLOG_MASK];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED); // Readers skip it until complete
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    rec->level = level;
+    rec->timestamp_ns = clock_ns();
+    kvsnprintf(rec->msg, KLOG_MSG_LEN, fmt, ap);
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+void klog(int level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    kvlog(level, fmt, ap);
+    va_end(ap);
+}
+
+void kprintf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    kvlog(KLOG_INFO, fmt, ap);
+    va_end(ap);
+}
+
+// Copy record 'seq' out of the ring. Returns 1 on success, 0 if it is still
+// being written, -1 if it has already been overwritten by a newer record.
+static int read_record(uint32_t seq, struct klog_record *copy)
+{
+    struct klog_record *rec = &ring[seq & KLOG_MASK];
+    uint32_t before = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    if (before != seq + 1)
+        return (before == 0 || before < seq + 1) ? 0 : -1;
+
+    *copy = *rec;
+
+    // A writer may have reused the slot while we copied it
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != before)
+        return -1;
+    return 1;
+}
+
+static void print_record(const struct klog_record *rec)
+{
+    static const unsigned char level_colors[] = {FB_RED, FB_LIGHT_BROWN, FB_WHITE, FB_LIGHT_GREY};
+    char prefix[24];
+    uint32_t rem;
+    uint64_t seconds = div64_u32(rec->timestamp_ns, 1000000000, &rem);
+
+    ksnprintf(prefix, sizeof(prefix), "[%5llu.%06u] ", seconds, rem / 1000);
+    fb_write_string(prefix, FB_DARK_GREY, FB_BLACK);
+    fb_write_string(rec->msg, level_colors[rec->level & 3], FB_BLACK);
+
+    // Every record starts on its own line, even if it was truncated
+    size_t len = strlen(rec->msg);
+    if (len == 0 || rec->msg[len - 1] != '\n')
+        fb_write_string("\n", FB_WHITE, FB_BLACK);
+}
+
+// Oldest record that can still be in the ring
+static uint32_t oldest_seq(uint32_t end)
+{
+    return end > KLOG_RECORD_COUNT ? end - KLOG_RECORD_COUNT : 0;
+}
+
+static void print_lost(uint32_t count)
+{
+    char line[48];
+    ksnprintf(line, sizeof(line), "[... %u log records lost ...]\n", count);
+    fb_write_string(line, FB_LIGHT_BROWN, FB_BLACK);
+}
+
+void klog_drain()
+{
+    struct klog_record rec;
+    uint32_t end = __atomic_load_n(&next_seq, __ATOMIC_ACQUIRE);
+
+    while (drain_seq != end)
+    {
+        uint32_t oldest = oldest_seq(end);
+        if (drain_seq < oldest)
+        {
+            print_lost(oldest - drain_seq);
+            drain_seq = oldest;
+            continue;
+        }
+
+        int status = read_record(drain_seq, &rec);
+        if (status == 0)
+            break; // A writer is still filling it in: finish on the next drain
+        if (status < 0)
+        {
+            end = __atomic_load_n(&next_seq, __ATOMIC_ACQUIRE); // Lapped while reading
+            continue;
+        }
+        if (rec.level <= console_level)
+            print_record(&rec);
+        drain_seq++;
+    }
+}
+
+void klog_set_console_level(int level)
+{
+    console_level = level;
+}
+
+void klog_dmesg()
+{
+    struct klog_record rec;
+    uint32_t end = __atomic_load_n(&next_seq, __ATOMIC_ACQUIRE);
+
+    for (uint32_t seq = oldest_seq(end); seq != end; seq++)
+    {
+        if (read_record(seq, &rec) == 1)
+            print_record(&rec);
+    }
+}
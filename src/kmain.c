@@ -5,30 +5,142 @@
 #include "gdt.h"
 #include "idt.h"
 #include "shell.h"
-// #include "multiboot.h" // Needed only if checking magic number
+#include "memmap.h"
+#include "pmm.h"
+#include "paging.h"
+#include "kheap.h"
+#include "initrd.h"
+#include "timer.h"
+#include "multiboot.h"
+#include "string.h"
+#include "serial.h"
+#include "klog.h"
+#include "keyboard.h"
+#include "apic.h"
+#include "smp.h"
+#include "thread.h"
+#include "bench.h"
+#include "boottime.h"
 
-unsigned long global_mb_info_addr = 0;
+// Boot messages go through the log ring like everything else, but are shown
+// right away so a hang points at the step that caused it
+static void boot_log(const char *msg)
+{
+    kprintf("%s\n", msg);
+    klog_drain();
+}
+
+// Non-zero if 'word' is one of the space-separated words of the kernel
+// command line (GRUB passes the kernel path first, then the arguments)
+static int cmdline_has(multiboot_info_t *mbi, const char *word)
+{
+    if (!(mbi->flags & MULTIBOOT_INFO_CMDLINE))
+        return 0;
+    size_t len = strlen(word);
+    const char *p = (const char *)mbi->cmdline;
+    while (*p)
+    {
+        while (*p == ' ')
+            p++;
+        const char *start = p;
+        while (*p && *p != ' ')
+            p++;
+        if ((size_t)(p - start) == len && strncmp(start, word, len) == 0)
+            return 1;
+    }
+    return 0;
+}
 
 void kmain(unsigned long multiboot_magic, unsigned long multiboot_info_addr)
 {
-    global_mb_info_addr = multiboot_info_addr;
     (void)multiboot_magic; // Mark as unused for now
 
     fb_clear();
-    fb_write_string("Little OS Booting...\n", FB_GREEN, FB_BLACK);
+    boot_phase("fb_clear");
+    if (serial_init() == 0) // COM1 mirror of all console output
+        fb_set_output_hook(serial_putc);
+    boot_log("Little OS Booting...");
+    boot_phase("serial");
+
+    string_init(); // memcpy/memset variants for this CPU (enables SSE2)
+    boot_phase("string");
 
-    gdt_init(); // Initialize GDT first
-    fb_write_string("GDT Initialized.\n", FB_WHITE, FB_BLACK);
+    gdt_init(); // Initialize GDT first (also sets up the boot CPU's %gs per-CPU segment)
+    boot_log("GDT Initialized.");
+    boot_phase("gdt");
+
+    keyboard_init(); // IRQ 1 handler, installed before interrupts are enabled
 
     idt_init(); // Initialize IDT and enable interrupts (sti)
-    fb_write_string("IDT Initialized.\n", FB_LIGHT_BLUE, FB_BLACK);
+    keyboard_rearm(); // pic_remap dropped any IRQ 1/4 edge raised before it
+    serial_rearm();
+    boot_log("IDT Initialized.");
+    boot_phase("idt");
+
+    memmap_init((multiboot_info_t *)multiboot_info_addr); // Sorted, merged region index of the memory map
+    boot_phase("memmap");
+
+    pmm_init((multiboot_info_t *)multiboot_info_addr); // Build the physical frame allocator
+    boot_log("Frame allocator Initialized.");
+    boot_phase("pmm");
+
+    paging_init(); // Page tables + enable paging
+    boot_log("Paging Enabled.");
+    boot_phase("paging");
+
+    kheap_init(); // Slab caches for kmalloc
+    boot_phase("kheap");
+
+    int files = initrd_init((multiboot_info_t *)multiboot_info_addr); // Index the GRUB module in place
+    if (files >= 0)
+        kprintf("initrd: %d files and directories.\n", files);
+    else if (files == INITRD_NO_MEMORY)
+        klog(KLOG_ERR, "initrd: out of memory for the index.\n");
+    else
+        kprintf("No initrd module loaded.\n");
+    boot_phase("initrd");
+
+    timer_init(TIMER_DEFAULT_HZ); // PIT tick + TSC calibration
+    boot_log("Timer Initialized.");
+    boot_phase("timer");
+
+    // Needs paging (MMIO mappings) and a calibrated clock (LAPIC timer)
+    if (apic_init() == 0)
+    {
+        lapic_timer_start(APIC_TIMER_DEFAULT_HZ, NULL); // Clock-event source, free for a scheduler to hook
+        kprintf("APIC Initialized: LAPIC id %u, 8259 masked, LAPIC timer %u kHz.\n", lapic_id(), lapic_timer_khz());
+        klog_drain();
+        boot_phase("apic");
+        kprintf("SMP: %d CPU(s) online.\n", smp_init());
+        boot_phase("smp");
+    }
+    else
+    {
+        kprintf("No usable APIC: staying on the 8259 PIC.\n");
+        boot_phase("apic");
+    }
+    klog_drain();
+
+    thread_init(); // This context becomes the shell thread; IRQ 0 now preempts
+    boot_log("Threads Initialized.");
+    boot_phase("threads");
+
+    if (cmdline_has((multiboot_info_t *)multiboot_info_addr, "bench"))
+        bench_boot_suite(); // Headless 'make bench' run; exits QEMU when done
+    if (cmdline_has((multiboot_info_t *)multiboot_info_addr, "memmap"))
+        memmap_report_exit(); // Headless 'make memmap' check; exits QEMU
 
     shell_init(); // Initialize shell state
-    fb_write_string("Starting Shell...\n", FB_LIGHT_BROWN, FB_BLACK);
+    boot_log("Starting Shell...");
+    boot_phase("shell");
+
+    if (cmdline_has((multiboot_info_t *)multiboot_info_addr, "boottime"))
+        boottime_report_exit(); // Headless 'make boottime' check; exits QEMU
     shell_run(); // Prints ">" and enters hlt loop (waiting for IRQs)
 
     // --- Should not be reached in this design ---
-    fb_write_string("Kernel: shell_run returned unexpectedly. Halting.\n", FB_RED, FB_BLACK);
+    klog(KLOG_ERR, "Kernel: shell_run returned unexpectedly. Halting.\n");
+    klog_drain();
     asm volatile("cli; hlt");
     while (1)
         ;
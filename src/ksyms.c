@@ -0,0 +1,35 @@
+// ksyms.c - Lookups in the kernel symbol table embedded at link time
+#include "ksyms.h"
+
+int ksym_find(uint32_t addr)
+{
+    if (ksym_count == 0 || addr < ksym_table[0].addr || addr >= ksym_table[ksym_count].addr)
+        return -1;
+
+    // Last entry with a start address <= addr
+    uint32_t lo = 0, hi = ksym_count - 1;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (ksym_table[mid].addr <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return (int)lo;
+}
+
+const char *ksym_name(int index)
+{
+    return &ksym_names[ksym_table[index].name];
+}
+
+const char *ksym_lookup(uint32_t addr, uint32_t *offset)
+{
+    int index = ksym_find(addr);
+    if (index < 0)
+        return NULL;
+    if (offset)
+        *offset = addr - ksym_table[index].addr;
+    return ksym_name(index);
+}
@@ -0,0 +1,274 @@
+// memmap.c - Physical memory region index built from the Multiboot map, meminfo table, headless report
+#include "memmap.h"
+#include "pmm.h"
+#include "serial.h"
+#include "bench.h"
+#include "fb.h"
+#include "klog.h"
+
+#define TYPE_COUNT (MULTIBOOT_MEMORY_BADRAM + 1)
+
+// One end of a raw map entry, for the sweep in memmap_init
+struct boundary
+{
+    uint64_t addr;
+    uint32_t type;
+    int opens; // 1 where the entry starts, 0 where it ends
+};
+
+static struct memmap_region regions[MEMMAP_MAX_REGIONS];
+static uint32_t region_count = 0;
+
+// mem_lower + mem_upper (KiB), shown by meminfo when there is no memory map
+static uint32_t basic_kb = 0;
+
+static uint32_t clean_type(uint32_t type)
+{
+    if (type < MULTIBOOT_MEMORY_AVAILABLE || type > MULTIBOOT_MEMORY_BADRAM)
+        return MULTIBOOT_MEMORY_RESERVED;
+    return type;
+}
+
+// Add [start, end) after the last region, merging with it if they touch
+static void append_region(uint64_t start, uint64_t end, uint32_t type)
+{
+    if (region_count > 0)
+    {
+        struct memmap_region *last = &regions[region_count - 1];
+        if (last->end == start && last->type == type)
+        {
+            last->end = end;
+            return;
+        }
+    }
+    regions[region_count].start = start;
+    regions[region_count].end = end;
+    regions[region_count].type = type;
+    region_count++;
+}
+
+void memmap_init(multiboot_info_t *mb_info)
+{
+    static struct boundary bounds[2 * MEMMAP_MAX_ENTRIES];
+    uint32_t bound_count = 0;
+    uint32_t dropped = 0;
+
+    region_count = 0;
+    basic_kb = 0;
+    if (mb_info != NULL && (mb_info->flags & MULTIBOOT_INFO_MEMORY))
+        basic_kb = mb_info->mem_lower + mb_info->mem_upper;
+    if (mb_info == NULL || !(mb_info->flags & MULTIBOOT_INFO_MEM_MAP))
+        return;
+
+    multiboot_memory_map_t *mmap = (multiboot_memory_map_t *)mb_info->mmap_addr;
+    while ((uint32_t)mmap < mb_info->mmap_addr + mb_info->mmap_length)
+    {
+        uint64_t start = mmap->addr;
+        uint64_t end = start + mmap->len;
+        if (end < start)
+            end = ~0ULL; // Length runs past the top of the address space
+        if (end > start && bound_count < 2 * MEMMAP_MAX_ENTRIES)
+        {
+            uint32_t type = clean_type(mmap->type);
+            bounds[bound_count++] = (struct boundary){start, type, 1};
+            bounds[bound_count++] = (struct boundary){end, type, 0};
+        }
+        else if (end > start)
+        {
+            dropped++;
+        }
+        mmap = (multiboot_memory_map_t *)((uint32_t)mmap + mmap->size + sizeof(mmap->size));
+    }
+
+    // Insertion sort: firmware maps have a few dozen entries at most
+    for (uint32_t i = 1; i < bound_count; i++)
+    {
+        struct boundary b = bounds[i];
+        uint32_t j = i;
+        while (j > 0 && bounds[j - 1].addr > b.addr)
+        {
+            bounds[j] = bounds[j - 1];
+            j--;
+        }
+        bounds[j] = b;
+    }
+
+    // Sweep the boundaries in address order, counting the open entries of
+    // each type. Between two boundaries the highest open type applies (bad >
+    // NVS > ACPI > reserved > available, as Linux resolves e820 overlaps);
+    // where nothing is open there is a hole.
+    uint32_t open[TYPE_COUNT] = {0};
+    uint32_t i = 0;
+    while (i < bound_count)
+    {
+        uint64_t addr = bounds[i].addr;
+        for (; i < bound_count && bounds[i].addr == addr; i++)
+        {
+            if (bounds[i].opens)
+                open[bounds[i].type]++;
+            else
+                open[bounds[i].type]--;
+        }
+        if (i == bound_count)
+            break;
+
+        uint32_t type = TYPE_COUNT - 1;
+        while (type > 0 && open[type] == 0)
+            type--;
+        if (type != 0)
+            append_region(addr, bounds[i].addr, type);
+    }
+
+    if (dropped)
+        klog(KLOG_WARN, "memmap: %u map entries past the first %u ignored\n", dropped, MEMMAP_MAX_ENTRIES);
+}
+
+uint32_t memmap_count()
+{
+    return region_count;
+}
+
+const struct memmap_region *memmap_get(uint32_t index)
+{
+    return index < region_count ? &regions[index] : NULL;
+}
+
+const struct memmap_region *memmap_find(uint64_t addr)
+{
+    // First region starting above 'addr'; the one before it is the candidate
+    uint32_t lo = 0, hi = region_count;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (regions[mid].start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0 || addr >= regions[lo - 1].end)
+        return NULL;
+    return &regions[lo - 1];
+}
+
+uint64_t memmap_total(uint32_t type, uint64_t start, uint64_t end)
+{
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < region_count; i++)
+    {
+        uint64_t lo = regions[i].start > start ? regions[i].start : start;
+        uint64_t hi = regions[i].end < end ? regions[i].end : end;
+        if (regions[i].type == type && hi > lo)
+            total += hi - lo;
+    }
+    return total;
+}
+
+const char *memmap_type_name(uint32_t type)
+{
+    switch (type)
+    {
+    case MULTIBOOT_MEMORY_AVAILABLE:
+        return "available";
+    case MULTIBOOT_MEMORY_ACPI_RECLAIMABLE:
+        return "ACPI";
+    case MULTIBOOT_MEMORY_NVS:
+        return "ACPI NVS";
+    case MULTIBOOT_MEMORY_BADRAM:
+        return "bad";
+    default:
+        return "reserved";
+    }
+}
+
+void memmap_print()
+{
+    char line[96];
+
+    if (region_count == 0 && basic_kb)
+    {
+        // Only the basic sizes: listed, but the frame allocator needs the map
+        ksnprintf(line, sizeof(line), "No memory map from the bootloader.\nBasic memory info (lower + upper): %u KB\n", basic_kb);
+        fb_write_string(line, FB_LIGHT_RED, FB_BLACK);
+        return;
+    }
+    if (region_count == 0)
+    {
+        fb_write_string("No memory map from the bootloader.\n", FB_RED, FB_BLACK);
+        return;
+    }
+
+    ksnprintf(line, sizeof(line), "Physical memory map (%u regions):\n", region_count);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("  start              end (inclusive)          size      type\n", FB_CYAN, FB_BLACK);
+    for (uint32_t i = 0; i < region_count; i++)
+    {
+        const struct memmap_region *r = &regions[i];
+        ksnprintf(line, sizeof(line), "  0x%016llx 0x%016llx %10llu KiB  %s\n", r->start, r->end - 1,
+                  (r->end - r->start) >> 10, memmap_type_name(r->type));
+        fb_write_string(line, r->type == MULTIBOOT_MEMORY_AVAILABLE ? FB_WHITE : FB_LIGHT_RED, FB_BLACK);
+    }
+
+    uint64_t low = memmap_total(MULTIBOOT_MEMORY_AVAILABLE, 0, MEMMAP_4GIB);
+    uint64_t high = memmap_total(MULTIBOOT_MEMORY_AVAILABLE, MEMMAP_4GIB, ~0ULL);
+    ksnprintf(line, sizeof(line), "Available: %llu KiB below 4 GiB", low >> 10);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    if (high)
+    {
+        ksnprintf(line, sizeof(line), ", %llu KiB above (unused: needs PAE)", high >> 10);
+        fb_write_string(line, FB_GREEN, FB_BLACK);
+    }
+    fb_write_string("\n", FB_GREEN, FB_BLACK);
+}
+
+// Sorted, disjoint, merged, every region found by lookup, and the frame
+// allocator holding no more than the available RAM below 4 GiB
+static int memmap_consistent()
+{
+    if (region_count == 0)
+        return 0;
+    for (uint32_t i = 0; i < region_count; i++)
+    {
+        const struct memmap_region *r = &regions[i];
+        if (r->start >= r->end || memmap_find(r->start) != r || memmap_find(r->end - 1) != r)
+            return 0;
+        if (i > 0 && (regions[i - 1].end > r->start ||
+                      (regions[i - 1].end == r->start && regions[i - 1].type == r->type)))
+            return 0;
+    }
+
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    return (uint64_t)stats.total_frames * PAGE_SIZE <= memmap_total(MULTIBOOT_MEMORY_AVAILABLE, 0, MEMMAP_4GIB);
+}
+
+void memmap_report_exit()
+{
+    char line[112];
+
+    fb_set_output_hook(NULL); // COM1 carries only the report
+    for (uint32_t i = 0; i < region_count; i++)
+    {
+        ksnprintf(line, sizeof(line), "MEMMAP-REGION start=0x%016llx end=0x%016llx type=%u\n", regions[i].start,
+                  regions[i].end, regions[i].type);
+        serial_write(line);
+    }
+
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    int ok = memmap_consistent();
+    ksnprintf(line, sizeof(line), "MEMMAP-TOTAL regions=%u available_kib=%llu high_kib=%llu pmm_kib=%u ok=%d\n",
+              region_count, memmap_total(MULTIBOOT_MEMORY_AVAILABLE, 0, ~0ULL) >> 10,
+              memmap_total(MULTIBOOT_MEMORY_AVAILABLE, MEMMAP_4GIB, ~0ULL) >> 10,
+              stats.total_frames * (PAGE_SIZE / 1024), ok);
+    serial_write(line);
+    bench_exit(!ok);
+}
+
+// --- Benchmarks ---
+
+BENCHMARK(memmap_find, "Region lookup of a physical address", 1000)
+{
+    volatile uint32_t found = 0; // Keeps the lookups from being optimized away
+    for (uint32_t i = 0; i < iterations; i++)
+        found += memmap_find((uint64_t)i << 22) != NULL;
+}
@@ -0,0 +1,258 @@
+// paging.c - Kernel page tables: 4 MiB global identity map plus 4 KiB map/unmap
+#include "paging.h"
+#include "pmm.h"
+#include "memmap.h"
+#include "cpu.h"
+#include "klog.h"
+#include "interrupts.h"
+#include "string.h"
+
+#define PDE_INDEX(addr) ((addr) >> 22)
+#define PTE_INDEX(addr) (((addr) >> 12) & 0x3FF)
+#define FRAME_MASK 0xFFFFF000
+#define PAGE_FAULT_VECTOR 14
+
+// Pending TLB invalidations. Above TLB_BATCH_MAX entries a full flush is cheaper.
+#define TLB_BATCH_MAX 32
+
+static uint32_t page_directory[1024] __attribute__((aligned(4096)));
+
+static uint32_t direct_map_end = 0;
+static int pse_enabled = 0;
+static int pge_enabled = 0;
+
+static uint32_t tlb_batch[TLB_BATCH_MAX];
+static int tlb_batch_count = 0;
+static int tlb_batch_overflow = 0;
+
+// --- TLB batching ---
+
+static void tlb_queue(uint32_t virt)
+{
+    if (tlb_batch_count < TLB_BATCH_MAX)
+        tlb_batch[tlb_batch_count++] = virt;
+    else
+        tlb_batch_overflow = 1;
+}
+
+static void tlb_flush_batch()
+{
+    if (tlb_batch_overflow)
+    {
+        // Reloading CR3 leaves global entries alone; toggling PGE drops them too
+        if (pge_enabled)
+        {
+            uint32_t cr4 = read_cr4();
+            write_cr4(cr4 & ~CR4_PGE);
+            write_cr4(cr4);
+        }
+        else
+        {
+            write_cr3(read_cr3());
+        }
+    }
+    else
+    {
+        for (int i = 0; i < tlb_batch_count; i++)
+            invlpg(tlb_batch[i]);
+    }
+    tlb_batch_count = 0;
+    tlb_batch_overflow = 0;
+}
+
+// --- Page table helpers ---
+
+// Page table covering 'virt', created (or split out of a 4 MiB page) on demand
+static uint32_t *get_page_table(uint32_t virt, int create)
+{
+    uint32_t pde = page_directory[PDE_INDEX(virt)];
+    if ((pde & PAGE_PRESENT) && !(pde & PAGE_LARGE))
+        return (uint32_t *)(pde & FRAME_MASK);
+    if (!create)
+        return NULL;
+
+    uint32_t table_phys = pmm_alloc_page();
+    if (table_phys == 0)
+        return NULL;
+    uint32_t *table = (uint32_t *)table_phys;
+
+    if (pde & PAGE_PRESENT)
+    {
+        // Split the large page into 1024 small ones with the same attributes
+        uint32_t base = pde & 0xFFC00000;
+        uint32_t flags = pde & (PAGE_WRITE | PAGE_USER | PAGE_WRITETHROUGH | PAGE_NOCACHE | PAGE_GLOBAL);
+        for (uint32_t i = 0; i < 1024; i++)
+            table[i] = (base + i * PAGE_SIZE) | flags | PAGE_PRESENT;
+        tlb_queue(virt & 0xFFC00000);
+    }
+    else
+    {
+        memset(table, 0, PAGE_SIZE);
+    }
+
+    page_directory[PDE_INDEX(virt)] = table_phys | PAGE_PRESENT | PAGE_WRITE;
+    return table;
+}
+
+static int map_one(uint32_t virt, uint32_t phys, uint32_t flags)
+{
+    uint32_t *table = get_page_table(virt, 1);
+    if (table == NULL)
+        return -1;
+    uint32_t old = table[PTE_INDEX(virt)];
+    table[PTE_INDEX(virt)] = (phys & FRAME_MASK) | (flags & 0xFFF) | PAGE_PRESENT;
+    // Not-present entries are never cached, so only replaced mappings need invalidating
+    if (old & PAGE_PRESENT)
+        tlb_queue(virt);
+    return 0;
+}
+
+static void unmap_one(uint32_t virt)
+{
+    uint32_t *table = get_page_table(virt, 0);
+    if (table == NULL || !(table[PTE_INDEX(virt)] & PAGE_PRESENT))
+        return;
+    table[PTE_INDEX(virt)] = 0;
+    tlb_queue(virt);
+}
+
+// --- Public map/unmap API ---
+
+int paging_map_page(uint32_t virt, uint32_t phys, uint32_t flags)
+{
+    int result = map_one(virt, phys, flags);
+    tlb_flush_batch();
+    return result;
+}
+
+void paging_unmap_page(uint32_t virt)
+{
+    unmap_one(virt);
+    tlb_flush_batch();
+}
+
+int paging_map_range(uint32_t virt, uint32_t phys, uint32_t size, uint32_t flags)
+{
+    int result = 0;
+    for (uint32_t off = 0; off < size; off += PAGE_SIZE)
+    {
+        if (map_one(virt + off, phys + off, flags) != 0)
+        {
+            result = -1;
+            break;
+        }
+    }
+    tlb_flush_batch();
+    return result;
+}
+
+void paging_unmap_range(uint32_t virt, uint32_t size)
+{
+    for (uint32_t off = 0; off < size; off += PAGE_SIZE)
+        unmap_one(virt + off);
+    tlb_flush_batch();
+}
+
+uint32_t paging_get_phys(uint32_t virt)
+{
+    uint32_t pde = page_directory[PDE_INDEX(virt)];
+    if (!(pde & PAGE_PRESENT))
+        return 0;
+    if (pde & PAGE_LARGE)
+        return (pde & 0xFFC00000) | (virt & 0x003FFFFF);
+    uint32_t pte = ((uint32_t *)(pde & FRAME_MASK))[PTE_INDEX(virt)];
+    if (!(pte & PAGE_PRESENT))
+        return 0;
+    return (pte & FRAME_MASK) | (virt & 0xFFF);
+}
+
+uint32_t paging_direct_map_end()
+{
+    return direct_map_end;
+}
+
+// --- Initialization ---
+
+// Highest end address of RAM-like regions (available, ACPI, NVS) below 4 GiB.
+// RAM above 4 GiB would need PAE and is left out.
+static uint32_t find_ram_top()
+{
+    uint64_t top = LARGE_PAGE_SIZE; // Always cover low memory and the kernel
+    for (uint32_t i = 0; i < memmap_count(); i++)
+    {
+        const struct memmap_region *region = memmap_get(i);
+        uint64_t end = region->end < MEMMAP_4GIB ? region->end : MEMMAP_4GIB;
+        if ((region->type == MULTIBOOT_MEMORY_AVAILABLE || region->type == MULTIBOOT_MEMORY_ACPI_RECLAIMABLE ||
+             region->type == MULTIBOOT_MEMORY_NVS) &&
+            region->start < MEMMAP_4GIB && end > top)
+            top = end;
+    }
+    // Round up to a whole large page, staying clear of the top-of-4 GiB device window
+    top = (top + LARGE_PAGE_SIZE - 1) & ~(uint64_t)(LARGE_PAGE_SIZE - 1);
+    if (top > 0xF0000000ULL)
+        top = 0xF0000000ULL;
+    return (uint32_t)top;
+}
+
+void paging_init()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    pse_enabled = (edx & CPUID_EDX_PSE) != 0;
+    pge_enabled = (edx & CPUID_EDX_PGE) != 0;
+
+    memset(page_directory, 0, sizeof(page_directory));
+    direct_map_end = find_ram_top();
+    register_exception_handler(PAGE_FAULT_VECTOR, page_fault_handler);
+
+    // Identity-map low memory, the kernel image and all RAM. Everything here is
+    // kernel-only and never changes, so it is marked global to survive CR3 reloads.
+    uint32_t global = pge_enabled ? PAGE_GLOBAL : 0;
+    for (uint32_t addr = 0; addr < direct_map_end; addr += LARGE_PAGE_SIZE)
+    {
+        if (pse_enabled)
+        {
+            page_directory[PDE_INDEX(addr)] = addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | global;
+        }
+        else
+        {
+            // No PSE: fall back to a 4 KiB page table per 4 MiB
+            uint32_t *table = get_page_table(addr, 1);
+            if (table == NULL)
+            {
+                direct_map_end = addr;
+                break;
+            }
+            for (uint32_t i = 0; i < 1024; i++)
+                table[i] = (addr + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE | global;
+        }
+    }
+
+    if (pse_enabled)
+        write_cr4(read_cr4() | CR4_PSE);
+    write_cr3((uint32_t)page_directory);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+    // Global pages may only be enabled once paging is on
+    if (pge_enabled)
+        write_cr4(read_cr4() | CR4_PGE);
+
+    tlb_batch_count = 0;
+    tlb_batch_overflow = 0;
+}
+
+// --- Page fault handling ---
+
+void page_fault_handler(registers_t *regs)
+{
+    uint32_t fault_addr = read_cr2();
+
+    klog(KLOG_ERR, "Page fault at address 0x%08x (%s, %s%s) EIP: 0x%08x\n", fault_addr,
+         (regs->err_code & 0x1) ? "protection violation" : "not present",
+         (regs->err_code & 0x2) ? "write" : "read",
+         (regs->err_code & 0x10) ? ", instruction fetch" : "", regs->eip);
+    klog(KLOG_ERR, "Halting system.\n");
+    klog_drain(); // Nothing else will run: show the log now
+    asm volatile("cli; hlt");
+    while (1)
+        ;
+}
@@ -0,0 +1,385 @@
+// pmm.c - Buddy allocator for physical page frames
+#include "pmm.h"
+#include "memmap.h"
+#include "cpu.h"
+#include "fb.h"
+#include "shell.h" // For fb_write_dec
+#include "string.h"
+#include "klog.h"
+#include "spinlock.h"
+
+// End of the kernel image (defined in link.ld)
+extern char kernel_end[];
+
+#define PMM_NONE 0xFFFFFFFF // "No frame" marker for list links
+#define FRAME_FREE 0x01     // Frame is the head of a free block
+
+#define LOW_MEMORY_END 0x00100000 // First 1 MiB: BIOS, VGA, real-mode structures
+#define MAX_RESERVED 8 // Fixed boot reservations, the initrd and the frame metadata
+
+// Per-frame metadata. Free-list links live here rather than inside the
+// frames themselves, so the allocator never touches the memory it hands out.
+struct pmm_frame
+{
+    uint32_t next;
+    uint32_t prev;
+    uint32_t owner; // Tag set by the user of an allocated block (e.g. the slab allocator)
+    uint8_t order;
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+struct pmm_range
+{
+    uint32_t start;
+    uint32_t end; // Exclusive
+};
+
+static struct pmm_frame *frames = NULL;
+static uint32_t frame_count = 0;
+static uint32_t free_lists[PMM_MAX_ORDER + 1];
+static struct pmm_stats stats;
+
+// Guards the free lists, the frame metadata and the counters once boot is
+// done: preempted threads, IRQ handlers and APs all allocate
+static struct spinlock lock;
+
+static struct pmm_range reserved[MAX_RESERVED];
+static int reserved_count = 0;
+
+static uint32_t align_up(uint32_t value)
+{
+    return (value + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// --- Free list helpers ---
+
+static void list_push(unsigned int order, uint32_t pfn)
+{
+    frames[pfn].prev = PMM_NONE;
+    frames[pfn].next = free_lists[order];
+    if (free_lists[order] != PMM_NONE)
+        frames[free_lists[order]].prev = pfn;
+    free_lists[order] = pfn;
+    frames[pfn].order = order;
+    frames[pfn].flags |= FRAME_FREE;
+    stats.free_blocks[order]++;
+}
+
+static void list_remove(unsigned int order, uint32_t pfn)
+{
+    if (frames[pfn].prev != PMM_NONE)
+        frames[frames[pfn].prev].next = frames[pfn].next;
+    else
+        free_lists[order] = frames[pfn].next;
+    if (frames[pfn].next != PMM_NONE)
+        frames[frames[pfn].next].prev = frames[pfn].prev;
+    frames[pfn].flags &= ~FRAME_FREE;
+    stats.free_blocks[order]--;
+}
+
+// Return a block to the free lists, merging with its buddy while possible
+static void free_block(uint32_t pfn, unsigned int order)
+{
+    stats.free_frames += 1u << order;
+    while (order < PMM_MAX_ORDER)
+    {
+        uint32_t buddy = pfn ^ (1u << order);
+        if (buddy >= frame_count || !(frames[buddy].flags & FRAME_FREE) || frames[buddy].order != order)
+            break;
+        list_remove(order, buddy);
+        pfn &= ~(1u << order);
+        order++;
+    }
+    list_push(order, pfn);
+}
+
+// --- Boot-time setup ---
+
+static void reserve_range(uint32_t start, uint32_t end)
+{
+    if (end <= start)
+        return;
+    if (reserved_count == MAX_RESERVED)
+    {
+        // Dropping it would hand memory still in use to the allocator
+        klog(KLOG_ERR, "pmm: no room to reserve 0x%08x-0x%08x\n", start, end);
+        return;
+    }
+    reserved[reserved_count].start = start & ~(PAGE_SIZE - 1);
+    reserved[reserved_count].end = align_up(end);
+    reserved_count++;
+}
+
+// Hand the frames in [start, end) to the allocator, skipping reserved ranges.
+// 'first' is the first reserved range that still has to be checked.
+static void add_free_range(uint32_t start, uint32_t end, int first)
+{
+    for (int i = first; i < reserved_count; i++)
+    {
+        if (reserved[i].start < end && reserved[i].end > start)
+        {
+            if (reserved[i].start > start)
+                add_free_range(start, reserved[i].start, i + 1);
+            if (reserved[i].end < end)
+                add_free_range(reserved[i].end, end, i + 1);
+            return;
+        }
+    }
+
+    uint32_t pfn = start >> PAGE_SHIFT;
+    uint32_t end_pfn = end >> PAGE_SHIFT;
+    while (pfn < end_pfn)
+    {
+        // Largest naturally aligned block that still fits in the range
+        unsigned int order = PMM_MAX_ORDER;
+        while (order > 0 && ((pfn & ((1u << order) - 1)) != 0 || pfn + (1u << order) > end_pfn))
+            order--;
+        free_block(pfn, order);
+        stats.total_frames += 1u << order;
+        pfn += 1u << order;
+    }
+}
+
+// Page-aligned part of available region 'index' below 4 GiB. Returns 0 if
+// the region is of another type or nothing is left.
+static int clip_region(uint32_t index, uint32_t *start, uint32_t *end)
+{
+    const struct memmap_region *region = memmap_get(index);
+    if (region->type != MULTIBOOT_MEMORY_AVAILABLE || region->start >= MEMMAP_4GIB)
+        return 0;
+    uint64_t base = region->start;
+    uint64_t limit = region->end < MEMMAP_4GIB ? region->end : MEMMAP_4GIB;
+    *start = align_up((uint32_t)base);
+    *end = (uint32_t)(limit & ~(uint64_t)(PAGE_SIZE - 1));
+    return *end > *start;
+}
+
+// Find room for the frame metadata inside available memory, above the kernel
+static uint32_t place_metadata(uint32_t size)
+{
+    for (uint32_t i = 0; i < memmap_count(); i++)
+    {
+        uint32_t start, end;
+        if (clip_region(i, &start, &end))
+        {
+            uint32_t candidate = start;
+            int moved = 1;
+            while (moved)
+            {
+                moved = 0;
+                for (int i = 0; i < reserved_count; i++)
+                {
+                    if (reserved[i].start < candidate + size && reserved[i].end > candidate)
+                    {
+                        candidate = reserved[i].end;
+                        moved = 1;
+                    }
+                }
+            }
+            if (candidate + size <= end && candidate + size > candidate)
+                return candidate;
+        }
+    }
+    return 0;
+}
+
+void pmm_init(multiboot_info_t *mb_info)
+{
+    for (int i = 0; i <= PMM_MAX_ORDER; i++)
+        free_lists[i] = PMM_NONE;
+    memset(&stats, 0, sizeof(stats));
+
+    if (mb_info == NULL || memmap_count() == 0)
+        return;
+
+    // Everything below the end of the kernel stays out of the allocator, as
+    // do the Multiboot information the kernel still reads and the first
+    // module (the initrd, read in place for as long as the kernel runs).
+    // Any further modules are unused, and their memory is simply free.
+    reserve_range(0, LOW_MEMORY_END);
+    reserve_range(LOW_MEMORY_END, (uint32_t)kernel_end);
+    reserve_range((uint32_t)mb_info, (uint32_t)mb_info + sizeof(multiboot_info_t));
+    reserve_range(mb_info->mmap_addr, mb_info->mmap_addr + mb_info->mmap_length);
+    if (mb_info->flags & MULTIBOOT_INFO_CMDLINE)
+        reserve_range(mb_info->cmdline, mb_info->cmdline + strlen((const char *)mb_info->cmdline) + 1);
+    if ((mb_info->flags & MULTIBOOT_INFO_MODS) && mb_info->mods_count > 0)
+    {
+        multiboot_module_t *mods = (multiboot_module_t *)mb_info->mods_addr;
+        reserve_range(mb_info->mods_addr, mb_info->mods_addr + sizeof(multiboot_module_t));
+        reserve_range(mods[0].mod_start, mods[0].mod_end);
+    }
+
+    // Size the metadata array by the highest available address
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < memmap_count(); i++)
+    {
+        uint32_t start, end;
+        if (clip_region(i, &start, &end) && end > top)
+            top = end;
+    }
+
+    uint32_t meta_size = align_up((top >> PAGE_SHIFT) * sizeof(struct pmm_frame));
+    uint32_t meta_addr = place_metadata(meta_size);
+    if (meta_addr == 0)
+        return;
+    frames = (struct pmm_frame *)meta_addr;
+    frame_count = top >> PAGE_SHIFT;
+    memset(frames, 0, meta_size);
+    reserve_range(meta_addr, meta_addr + meta_size);
+
+    // Feed every available region to the buddy lists. The region index has
+    // resolved overlaps, so no frame can be freed twice.
+    for (uint32_t i = 0; i < memmap_count(); i++)
+    {
+        uint32_t start, end;
+        if (clip_region(i, &start, &end))
+            add_free_range(start, end, 0);
+    }
+}
+
+// --- Allocation API ---
+
+static uint32_t alloc_block(unsigned int order)
+{
+    if (order > PMM_MAX_ORDER)
+    {
+        stats.failed_count++;
+        return 0;
+    }
+
+    // Smallest order with a free block
+    unsigned int k = order;
+    while (k <= PMM_MAX_ORDER && free_lists[k] == PMM_NONE)
+        k++;
+    if (k > PMM_MAX_ORDER)
+    {
+        stats.failed_count++;
+        return 0;
+    }
+
+    uint32_t pfn = free_lists[k];
+    list_remove(k, pfn);
+
+    // Split down to the requested size, returning the upper halves
+    while (k > order)
+    {
+        k--;
+        list_push(k, pfn + (1u << k));
+    }
+
+    frames[pfn].order = order;
+    stats.free_frames -= 1u << order;
+    stats.alloc_count++;
+    return pfn << PAGE_SHIFT;
+}
+
+uint32_t pmm_alloc_pages(unsigned int order)
+{
+    uint32_t flags = spin_lock_irqsave(&lock);
+    uint32_t addr = alloc_block(order);
+    spin_unlock_irqrestore(&lock, flags);
+    return addr;
+}
+
+void pmm_free_pages(uint32_t addr, unsigned int order)
+{
+    uint32_t pfn = addr >> PAGE_SHIFT;
+    uint32_t flags = spin_lock_irqsave(&lock);
+    if (addr == 0 || order > PMM_MAX_ORDER || pfn >= frame_count || (frames[pfn].flags & FRAME_FREE))
+    {
+        spin_unlock_irqrestore(&lock, flags);
+        return; // Ignore bogus addresses and obvious double frees
+    }
+    unsigned int allocated = frames[pfn].order;
+    if (allocated == order)
+    {
+        stats.free_count++;
+        free_block(pfn, order);
+    }
+    spin_unlock_irqrestore(&lock, flags);
+
+    // Merging at the wrong order would link frames still in use into the free lists
+    if (allocated != order)
+        klog(KLOG_ERR, "pmm: block 0x%08x freed as order %u but allocated as order %u\n", addr, order, allocated);
+}
+
+uint32_t pmm_alloc_page()
+{
+    return pmm_alloc_pages(0);
+}
+
+void pmm_free_page(uint32_t addr)
+{
+    pmm_free_pages(addr, 0);
+}
+
+void pmm_set_owner(uint32_t addr, unsigned int order, uint32_t owner)
+{
+    uint32_t pfn = addr >> PAGE_SHIFT;
+    for (uint32_t i = 0; i < (1u << order) && pfn + i < frame_count; i++)
+        frames[pfn + i].owner = owner;
+}
+
+uint32_t pmm_get_owner(uint32_t addr)
+{
+    uint32_t pfn = addr >> PAGE_SHIFT;
+    return pfn < frame_count ? frames[pfn].owner : 0;
+}
+
+void pmm_get_stats(struct pmm_stats *out)
+{
+    uint32_t flags = spin_lock_irqsave(&lock);
+    *out = stats;
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+// --- Benchmark ---
+
+#define BENCH_PAGES 1024
+
+static uint32_t bench_addrs[BENCH_PAGES];
+
+static void print_cycles(const char *label, uint32_t cycles, uint32_t ops)
+{
+    fb_write_string(label, FB_WHITE, FB_BLACK);
+    fb_write_dec(ops ? cycles / ops : 0);
+    fb_write_string(" cycles/op (", FB_WHITE, FB_BLACK);
+    fb_write_dec(ops);
+    fb_write_string(" ops)\n", FB_WHITE, FB_BLACK);
+}
+
+// Time a burst of allocations of one order followed by freeing them all
+static void bench_order(unsigned int order, const char *alloc_label, const char *free_label)
+{
+    uint32_t n = 0;
+    uint64_t t0 = rdtsc();
+    while (n < BENCH_PAGES)
+    {
+        uint32_t addr = pmm_alloc_pages(order);
+        if (addr == 0)
+            break;
+        bench_addrs[n++] = addr;
+    }
+    uint64_t t1 = rdtsc();
+    for (uint32_t i = 0; i < n; i++)
+        pmm_free_pages(bench_addrs[i], order);
+    uint64_t t2 = rdtsc();
+
+    print_cycles(alloc_label, (uint32_t)(t1 - t0), n);
+    print_cycles(free_label, (uint32_t)(t2 - t1), n);
+}
+
+void pmm_benchmark()
+{
+    fb_write_string("PMM benchmark (rdtsc):\n", FB_GREEN, FB_BLACK);
+    bench_order(0, "  alloc order 0: ", "  free  order 0: ");
+    bench_order(3, "  alloc order 3: ", "  free  order 3: ");
+
+    // Interleaved alloc/free pairs: the common case for short-lived buffers
+    uint64_t t0 = rdtsc();
+    for (uint32_t i = 0; i < BENCH_PAGES; i++)
+        pmm_free_page(pmm_alloc_page());
+    uint64_t t1 = rdtsc();
+    print_cycles("  alloc+free pair: ", (uint32_t)(t1 - t0), BENCH_PAGES);
+}
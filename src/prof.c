@@ -0,0 +1,395 @@
+// prof.c - Timer-driven sampling profiler: per-CPU stack samples, symbolized reports, folded stacks
+#include "prof.h"
+#include "ksyms.h"
+#include "percpu.h"
+#include "smp.h"
+#include "apic.h"
+#include "idt.h"
+#include "pmm.h"
+#include "kheap.h"
+#include "timer.h"
+#include "serial.h"
+#include "string.h"
+#include "div64.h"
+#include "fb.h"
+#include "klog.h"
+
+#define CACHE_LINE 64
+
+// Interrupted eip in pcs[0], then return addresses (innermost first)
+struct prof_sample
+{
+    uint32_t depth;
+    uint32_t pcs[PROF_MAX_DEPTH];
+};
+
+#define SAMPLES_PER_CPU ((PAGE_SIZE << PROF_BUFFER_ORDER) / sizeof(struct prof_sample))
+
+// One per CPU, only ever appended to by its owner from interrupt context.
+// 'count' is published after the sample it covers, so readers on other CPUs
+// see complete samples only.
+struct prof_buffer
+{
+    struct prof_sample *samples; // Allocated on the first 'prof start', then kept
+    volatile uint32_t count;
+    uint32_t dropped;  // Ticks lost because the buffer was full
+    volatile int kick; // Set by the boot CPU before the IPI that asks for a sample
+} __attribute__((aligned(CACHE_LINE)));
+
+static struct prof_buffer buffers[SMP_MAX_CPUS];
+static volatile int running = 0;
+static uint32_t cpu_count = 0;   // CPUs being sampled
+static uint32_t sample_irq = 0;  // IRQ slot that takes the boot CPU's samples
+static uint32_t sample_hz = 0;
+static uint64_t start_ns = 0;
+static uint64_t stop_ns = 0;
+
+// Follow the saved-%ebp chain from the interrupted frame. Only frames above
+// the interrupted stack pointer and within PROF_STACK_SPAN of it are trusted,
+// and each must be further up than the last, so a corrupt or foreign %ebp
+// ends the walk instead of faulting.
+static void record_sample(struct prof_buffer *buf, registers_t *regs)
+{
+    uint32_t n = buf->count;
+    if (n >= SAMPLES_PER_CPU)
+    {
+        buf->dropped++;
+        return;
+    }
+
+    struct prof_sample *sample = &buf->samples[n];
+    uint32_t low = (uint32_t)&regs->useresp; // No privilege change: the interrupted esp
+    uint32_t high = low + PROF_STACK_SPAN - 2 * sizeof(uint32_t);
+    uint32_t fp = regs->ebp;
+    uint32_t depth = 0;
+
+    sample->pcs[depth++] = regs->eip;
+    while (depth < PROF_MAX_DEPTH && fp >= low && fp <= high && (fp & 3) == 0)
+    {
+        const uint32_t *frame = (const uint32_t *)fp;
+        if (frame[1] == 0)
+            break;
+        sample->pcs[depth++] = frame[1];
+        if (frame[0] <= fp)
+            break;
+        fp = frame[0];
+    }
+    sample->depth = depth;
+    __atomic_store_n(&buf->count, n + 1, __ATOMIC_RELEASE);
+}
+
+void prof_interrupt(uint32_t irq, registers_t *regs)
+{
+    if (!running)
+        return;
+
+    uint32_t cpu = this_cpu_read(index);
+    if (cpu >= cpu_count)
+        return;
+
+    if (cpu == 0 && irq == sample_irq)
+    {
+        // Only the boot CPU runs a LAPIC timer: it samples the other CPUs by
+        // sending them the wakeup IPI, which they would otherwise ignore
+        record_sample(&buffers[0], regs);
+        for (uint32_t i = 1; i < cpu_count; i++)
+        {
+            buffers[i].kick = 1;
+            lapic_send_ipi(cpus[i].apic_id, APIC_IPI_FIXED | (IDT_IRQ_BASE + APIC_WAKE_IRQ));
+        }
+    }
+    else if (irq == APIC_WAKE_IRQ && __atomic_exchange_n(&buffers[cpu].kick, 0, __ATOMIC_ACQ_REL))
+    {
+        record_sample(&buffers[cpu], regs);
+    }
+}
+
+int prof_start(uint32_t hz)
+{
+    if (hz == 0)
+        hz = PROF_DEFAULT_HZ;
+    prof_stop();
+
+    uint32_t online = (uint32_t)smp_cpu_count();
+    for (uint32_t i = 0; i < online; i++)
+    {
+        if (buffers[i].samples == NULL)
+        {
+            uint32_t addr = pmm_alloc_pages(PROF_BUFFER_ORDER);
+            if (addr == 0)
+                return -1;
+            buffers[i].samples = (struct prof_sample *)addr;
+        }
+        buffers[i].count = 0;
+        buffers[i].dropped = 0;
+        buffers[i].kick = 0;
+    }
+    cpu_count = online;
+
+    if (apic_active() && lapic_timer_start(hz, NULL) == 0)
+    {
+        sample_irq = APIC_TIMER_IRQ;
+        sample_hz = hz;
+    }
+    else
+    {
+        sample_irq = 0; // PIT tick
+        sample_hz = timer_hz();
+    }
+
+    start_ns = clock_ns();
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void prof_stop()
+{
+    if (!running)
+        return;
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+    stop_ns = clock_ns();
+    if (sample_irq == APIC_TIMER_IRQ)
+        lapic_timer_start(APIC_TIMER_DEFAULT_HZ, NULL); // Back to the boot-time rate
+}
+
+int prof_running()
+{
+    return running;
+}
+
+// Address to symbolize for frame 'i': return addresses point past the call,
+// which may be the first byte of the next function
+static uint32_t frame_pc(const struct prof_sample *sample, uint32_t i)
+{
+    return i == 0 ? sample->pcs[0] : sample->pcs[i] - 1;
+}
+
+// Function start for symbolized frames, the address itself otherwise. Two
+// samples with the same keys fold into the same stack.
+static uint32_t frame_key(const struct prof_sample *sample, uint32_t i)
+{
+    uint32_t pc = frame_pc(sample, i);
+    int index = ksym_find(pc);
+    return index < 0 ? pc : ksym_table[index].addr;
+}
+
+static uint32_t total_samples()
+{
+    uint32_t total = 0;
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+        total += __atomic_load_n(&buffers[cpu].count, __ATOMIC_ACQUIRE);
+    return total;
+}
+
+static void print_percent(char *buf, size_t size, uint32_t samples, uint32_t total)
+{
+    uint32_t x10 = (uint32_t)div64_u32((uint64_t)samples * 1000, total, NULL);
+    ksnprintf(buf, size, "%3u.%u%%", x10 / 10, x10 % 10);
+}
+
+void prof_report(uint32_t top)
+{
+    char line[128];
+    char self_pct[16], total_pct[16];
+    uint32_t total = total_samples();
+
+    if (total == 0)
+    {
+        fb_write_string("No samples. Start the profiler with 'prof start'.\n", FB_RED, FB_BLACK);
+        return;
+    }
+
+    uint64_t elapsed_ms = div64_u32((running ? clock_ns() : stop_ns) - start_ns, 1000000, NULL);
+    ksnprintf(line, sizeof(line), "%u samples at %u Hz over %llu ms (%s)\n", total, sample_hz, elapsed_ms,
+              running ? "running" : "stopped");
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        ksnprintf(line, sizeof(line), "  CPU %u: %u samples, %u dropped\n", cpu, buffers[cpu].count,
+                  buffers[cpu].dropped);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+
+    // One counter per symbol plus one for addresses outside kernel text
+    uint32_t slots = ksym_count + 1;
+    uint32_t *self = kzalloc(slots * sizeof(uint32_t));
+    uint32_t *inclusive = kzalloc(slots * sizeof(uint32_t));
+    if (self == NULL || inclusive == NULL)
+    {
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+        kfree(self);
+        kfree(inclusive);
+        return;
+    }
+
+    // Samples taken since 'total' was read are left out, so percentages add up
+    for (uint32_t cpu = 0, counted = 0; cpu < cpu_count; cpu++)
+    {
+        uint32_t count = __atomic_load_n(&buffers[cpu].count, __ATOMIC_ACQUIRE);
+        for (uint32_t s = 0; s < count && counted < total; s++, counted++)
+        {
+            const struct prof_sample *sample = &buffers[cpu].samples[s];
+            uint32_t seen[PROF_MAX_DEPTH];
+            for (uint32_t i = 0; i < sample->depth; i++)
+            {
+                int index = ksym_find(frame_pc(sample, i));
+                seen[i] = index < 0 ? ksym_count : (uint32_t)index;
+                if (i == 0)
+                    self[seen[0]]++;
+
+                // Recursion: count each function once per sample
+                uint32_t j = 0;
+                while (j < i && seen[j] != seen[i])
+                    j++;
+                if (j == i)
+                    inclusive[seen[i]]++;
+            }
+        }
+    }
+
+    fb_write_string("     self             total            function\n", FB_WHITE, FB_BLACK);
+    for (uint32_t n = 0; n < top; n++)
+    {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < slots; i++)
+        {
+            if (self[i] > self[best])
+                best = i;
+        }
+        if (self[best] == 0)
+            break;
+
+        print_percent(self_pct, sizeof(self_pct), self[best], total);
+        print_percent(total_pct, sizeof(total_pct), inclusive[best], total);
+        ksnprintf(line, sizeof(line), "  %6u %s  %6u %s  %s\n", self[best], self_pct, inclusive[best], total_pct,
+                  best == ksym_count ? "[unknown]" : ksym_name((int)best));
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+        self[best] = 0;
+    }
+
+    kfree(self);
+    kfree(inclusive);
+}
+
+// --- Folded stacks ---
+
+struct folded_entry
+{
+    const struct prof_sample *sample; // First sample with this stack, NULL = empty slot
+    uint32_t count;
+};
+
+static uint32_t stack_hash(const struct prof_sample *sample)
+{
+    uint32_t hash = 2166136261u; // FNV-1a over the frame keys
+    for (uint32_t i = 0; i < sample->depth; i++)
+    {
+        hash ^= frame_key(sample, i);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int same_stack(const struct prof_sample *a, const struct prof_sample *b)
+{
+    if (a->depth != b->depth)
+        return 0;
+    for (uint32_t i = 0; i < a->depth; i++)
+    {
+        if (frame_key(a, i) != frame_key(b, i))
+            return 0;
+    }
+    return 1;
+}
+
+// Append 'str' to 'line' at *len, keeping room for the terminator
+static void append(char *line, size_t size, uint32_t *len, const char *str)
+{
+    while (*str && *len + 1 < size)
+        line[(*len)++] = *str++;
+    line[*len] = '\0';
+}
+
+static void write_folded(const struct folded_entry *entry)
+{
+    static char line[PROF_MAX_DEPTH * 48 + 16];
+    char frame[16];
+    uint32_t len = 0;
+    const struct prof_sample *sample = entry->sample;
+
+    line[0] = '\0';
+    for (uint32_t i = sample->depth; i-- > 0;)
+    {
+        uint32_t pc = frame_pc(sample, i);
+        const char *name = ksym_lookup(pc, NULL);
+        if (name == NULL)
+        {
+            ksnprintf(frame, sizeof(frame), "0x%08x", pc);
+            name = frame;
+        }
+        append(line, sizeof(line), &len, name);
+        append(line, sizeof(line), &len, i ? ";" : " ");
+    }
+    ksnprintf(frame, sizeof(frame), "%u\n", entry->count);
+    append(line, sizeof(line), &len, frame);
+    serial_write(line);
+}
+
+void prof_export_folded()
+{
+    char line[96];
+    uint32_t total = total_samples();
+
+    if (!serial_present())
+    {
+        fb_write_string("No serial port.\n", FB_RED, FB_BLACK);
+        return;
+    }
+    if (total == 0)
+    {
+        fb_write_string("No samples. Start the profiler with 'prof start'.\n", FB_RED, FB_BLACK);
+        return;
+    }
+
+    // Open addressing, at most half full
+    uint32_t size = 1;
+    while (size < total * 2)
+        size <<= 1;
+    struct folded_entry *table = kzalloc(size * sizeof(struct folded_entry));
+    if (table == NULL)
+    {
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+        return;
+    }
+
+    uint32_t stacks = 0, exported = 0;
+    for (uint32_t cpu = 0; cpu < cpu_count; cpu++)
+    {
+        uint32_t count = __atomic_load_n(&buffers[cpu].count, __ATOMIC_ACQUIRE);
+        for (uint32_t s = 0; s < count && exported < total; s++, exported++)
+        {
+            const struct prof_sample *sample = &buffers[cpu].samples[s];
+            uint32_t slot = stack_hash(sample) & (size - 1);
+            while (table[slot].sample != NULL && !same_stack(table[slot].sample, sample))
+                slot = (slot + 1) & (size - 1);
+            if (table[slot].sample == NULL)
+            {
+                table[slot].sample = sample;
+                stacks++;
+            }
+            table[slot].count++;
+        }
+    }
+
+    serial_write("PROF-BEGIN\n");
+    for (uint32_t slot = 0; slot < size; slot++)
+    {
+        if (table[slot].sample != NULL)
+            write_folded(&table[slot]);
+    }
+    serial_write("PROF-END\n");
+    kfree(table);
+
+    ksnprintf(line, sizeof(line), "Wrote %u stacks (%u samples) to COM1.\n", stacks, exported);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+}
@@ -0,0 +1,274 @@
+// serial.c - 16550 UART driver for COM1 (IRQ 4 drives both rings)
+#include "serial.h"
+#include "io.h"
+#include "cpu.h"
+#include "interrupts.h"
+
+// Register offsets from the base port
+#define UART_DATA 0        // RX buffer / TX holding register (DLAB=0)
+#define UART_IER 1         // Interrupt enable (DLAB=0)
+#define UART_DIVISOR_LO 0  // Baud divisor (DLAB=1)
+#define UART_DIVISOR_HI 1
+#define UART_IIR 2         // Interrupt identification (read)
+#define UART_FCR 2         // FIFO control (write)
+#define UART_LCR 3         // Line control
+#define UART_MCR 4         // Modem control
+#define UART_LSR 5         // Line status
+#define UART_MSR 6         // Modem status
+
+#define IER_RX_AVAILABLE 0x01
+#define IER_TX_EMPTY 0x02
+
+#define IIR_NONE_PENDING 0x01
+#define IIR_CAUSE_MASK 0x0E
+#define IIR_MODEM_STATUS 0x00
+#define IIR_TX_EMPTY 0x02
+#define IIR_RX_AVAILABLE 0x04
+#define IIR_LINE_STATUS 0x06
+#define IIR_RX_TIMEOUT 0x0C
+
+#define LCR_8N1 0x03
+#define LCR_DLAB 0x80
+#define FCR_ENABLE_CLEAR_14 0xC7 // Enable and clear both FIFOs, RX trigger at 14 bytes
+#define MCR_DTR_RTS_OUT2 0x0B    // OUT2 gates the UART interrupt line to the PIC
+#define MCR_LOOPBACK 0x1E
+#define LSR_DATA_READY 0x01
+#define LSR_THR_EMPTY 0x20
+#define LSR_TX_IDLE 0x40 // FIFO and shift register both empty
+
+#define UART_FIFO_SIZE 16
+#define UART_CLOCK 115200 // Divisor 1 gives this rate
+
+#define SERIAL_IRQ 4
+
+#define TX_MASK (SERIAL_TX_RING_SIZE - 1)
+#define RX_MASK (SERIAL_RX_RING_SIZE - 1)
+
+#define PORT(reg) (SERIAL_COM1_BASE + (reg))
+
+// TX: filled by serial_putc with interrupts off, drained by IRQ 4
+static volatile uint8_t tx_ring[SERIAL_TX_RING_SIZE];
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_tail = 0;
+
+// RX: filled by IRQ 4, drained by the shell loop
+static volatile uint8_t rx_ring[SERIAL_RX_RING_SIZE];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+static volatile uint32_t rx_dropped = 0;
+
+static int present = 0;
+static uint8_t ier = 0; // Shadow of the IER register
+
+// Move up to one FIFO's worth from the TX ring into the UART.
+// Interrupts must be off. Returns the number of bytes written.
+static int tx_fill_fifo()
+{
+    int sent = 0;
+    while (sent < UART_FIFO_SIZE && tx_tail != tx_head)
+    {
+        outb(PORT(UART_DATA), tx_ring[tx_tail & TX_MASK]);
+        tx_tail++;
+        sent++;
+    }
+    return sent;
+}
+
+static void set_ier(uint8_t value)
+{
+    if (value != ier)
+    {
+        ier = value;
+        outb(PORT(UART_IER), ier);
+    }
+}
+
+// Service every pending UART condition. Interrupts must be off.
+static void service()
+{
+    uint8_t iir;
+    while (!((iir = inb(PORT(UART_IIR))) & IIR_NONE_PENDING))
+    {
+        switch (iir & IIR_CAUSE_MASK)
+        {
+        case IIR_RX_AVAILABLE:
+        case IIR_RX_TIMEOUT:
+            while (inb(PORT(UART_LSR)) & LSR_DATA_READY)
+            {
+                uint8_t byte = inb(PORT(UART_DATA));
+                if (rx_head - rx_tail >= SERIAL_RX_RING_SIZE)
+                {
+                    rx_dropped++;
+                    continue;
+                }
+                rx_ring[rx_head & RX_MASK] = byte;
+                asm volatile("" ::: "memory"); // Publish the byte before the head
+                rx_head++;
+            }
+            break;
+        case IIR_TX_EMPTY:
+            // The FIFO is empty: refill it, or stop asking once the ring is drained
+            if (tx_fill_fifo() == 0)
+                set_ier(ier & ~IER_TX_EMPTY);
+            break;
+        case IIR_LINE_STATUS:
+            inb(PORT(UART_LSR)); // Reading LSR clears overrun/framing errors
+            break;
+        case IIR_MODEM_STATUS:
+            inb(PORT(UART_MSR));
+            break;
+        }
+    }
+}
+
+static void serial_irq(registers_t *regs)
+{
+    (void)regs;
+    service();
+}
+
+int serial_init()
+{
+    uint16_t divisor = UART_CLOCK / SERIAL_BAUD;
+
+    outb(PORT(UART_IER), 0); // No interrupts while programming
+    outb(PORT(UART_LCR), LCR_DLAB);
+    outb(PORT(UART_DIVISOR_LO), divisor & 0xFF);
+    outb(PORT(UART_DIVISOR_HI), (divisor >> 8) & 0xFF);
+    outb(PORT(UART_LCR), LCR_8N1);
+    outb(PORT(UART_FCR), FCR_ENABLE_CLEAR_14);
+
+    // Loopback test: a missing UART reads back 0xFF
+    outb(PORT(UART_MCR), MCR_LOOPBACK);
+    outb(PORT(UART_DATA), 0xAE);
+    if (inb(PORT(UART_DATA)) != 0xAE)
+        return -1;
+
+    outb(PORT(UART_MCR), MCR_DTR_RTS_OUT2);
+    ier = IER_RX_AVAILABLE; // TX-empty is only enabled while the ring has data
+    outb(PORT(UART_IER), ier);
+    present = 1;
+
+    register_irq_handler(SERIAL_IRQ, serial_irq);
+    return 0;
+}
+
+int serial_present()
+{
+    return present;
+}
+
+// Interrupts off: push bytes out by polling THR-empty
+static void tx_poll()
+{
+    while (!(inb(PORT(UART_LSR)) & LSR_THR_EMPTY))
+        asm volatile("pause");
+    tx_fill_fifo();
+}
+
+// Interrupts off: refill the FIFO at once if it is idle (full-ring fallback
+// in case IRQ 4 never comes)
+static int tx_kick()
+{
+    if (!(inb(PORT(UART_LSR)) & LSR_THR_EMPTY))
+        return 0;
+    return tx_fill_fifo();
+}
+
+static void tx_push(uint8_t byte)
+{
+    while (1)
+    {
+        uint32_t flags = irq_save();
+        if (tx_head - tx_tail < SERIAL_TX_RING_SIZE)
+        {
+            tx_ring[tx_head & TX_MASK] = byte;
+            tx_head++;
+            // Enabling the TX-empty interrupt raises it at once if the FIFO is idle
+            set_ier(ier | IER_TX_EMPTY);
+            irq_restore(flags);
+            return;
+        }
+
+        // Ring full: sleep until IRQ 4 drains some, or drain it ourselves
+        if (tx_kick() > 0)
+        {
+            irq_restore(flags);
+        }
+        else if (flags & 0x200)
+        {
+            irq_restore(flags);
+            asm volatile("hlt");
+        }
+        else
+        {
+            tx_poll();
+            irq_restore(flags);
+        }
+    }
+}
+
+void serial_rearm()
+{
+    if (!present)
+        return;
+    uint32_t flags = irq_save();
+    service();
+    // The UART only raises TX-empty again when THR is written or ETBEI goes
+    // from 0 to 1, so toggle it if the ring is still waiting on IRQ 4
+    if (ier & IER_TX_EMPTY)
+    {
+        outb(PORT(UART_IER), ier & ~IER_TX_EMPTY);
+        outb(PORT(UART_IER), ier);
+    }
+    irq_restore(flags);
+}
+
+void serial_putc(char c)
+{
+    if (!present)
+        return;
+    if (c == '\n')
+        tx_push('\r');
+    tx_push((uint8_t)c);
+}
+
+void serial_write(const char *str)
+{
+    while (*str)
+        serial_putc(*str++);
+}
+
+void serial_flush()
+{
+    if (!present)
+        return;
+    uint32_t flags = irq_save();
+    while (tx_tail != tx_head)
+        tx_poll();
+    while (!(inb(PORT(UART_LSR)) & LSR_TX_IDLE))
+        asm volatile("pause");
+    irq_restore(flags);
+}
+
+int serial_getchar()
+{
+    uint32_t tail = rx_tail;
+    if (tail == rx_head)
+        return -1;
+    asm volatile("" ::: "memory"); // Read the byte only after seeing the head
+    uint8_t byte = rx_ring[tail & RX_MASK];
+    asm volatile("" ::: "memory");
+    rx_tail = tail + 1;
+    return byte;
+}
+
+int serial_has_input()
+{
+    return rx_head != rx_tail;
+}
+
+uint32_t serial_rx_dropped()
+{
+    return rx_dropped;
+}
@@ -2,55 +2,47 @@
 
 #include "shell.h"
 #include "fb.h"
-#include "multiboot.h"
+#include "memmap.h"
 #include "common.h"
 #include "string.h"
-
-// Access the global MB info address (defined in kmain.c)
-extern unsigned long global_mb_info_addr;
+#include "pmm.h"
+#include "kheap.h"
+#include "timer.h"
+#include "div64.h"
+#include "keyboard.h"
+#include "interrupts.h"
+#include "serial.h"
+#include "klog.h"
+#include "apic.h"
+#include "smp.h"
+#include "thread.h"
+#include "workpool.h"
+#include "bench.h"
+#include "prof.h"
+#include "trace.h"
+#include "boottime.h"
+#include "command.h"
+#include "initrd.h"
 
 // --- Shell State ---
-char cmd_buffer[CMD_BUFFER_SIZE];
-int cmd_buffer_idx = 0;
+// Each virtual terminal has its own command line
+struct shell_line
+{
+    char buffer[CMD_BUFFER_SIZE];
+    int idx;
+    int started; // Prompt already shown on this terminal
+};
+
+static struct shell_line lines[FB_VT_COUNT];
 
 // --- Utility Functions ---
 
-// Function to clear the command buffer
+// Function to clear the command buffer of the active terminal
 void clear_cmd_buffer()
 {
-    memset(cmd_buffer, 0, CMD_BUFFER_SIZE);
-    cmd_buffer_idx = 0;
-}
-
-// Basic strcmp (compare two null-terminated strings)
-// Returns 0 if equal, <0 if s1 < s2, >0 if s1 > s2
-int simple_strcmp(const char *s1, const char *s2)
-{
-    while (*s1 && (*s1 == *s2))
-    {
-        s1++;
-        s2++;
-    }
-    return *(const unsigned char *)s1 - *(const unsigned char *)s2;
-}
-
-// Simplified strncmp (compare up to n characters)
-int simple_strncmp(const char *s1, const char *s2, size_t n)
-{
-    while (n && *s1 && (*s1 == *s2))
-    {
-        ++s1;
-        ++s2;
-        --n;
-    }
-    if (n == 0)
-    {
-        return 0;
-    }
-    else
-    {
-        return *(unsigned char *)s1 - *(unsigned char *)s2;
-    }
+    struct shell_line *line = &lines[fb_active_vt()];
+    line->buffer[0] = '\0'; // Input is terminated at line->idx before use, no need to clear the rest
+    line->idx = 0;
 }
 
 // Function to print an unsigned decimal integer to the framebuffer
@@ -58,7 +50,7 @@ void fb_write_dec(unsigned int n)
 {
     if (n == 0)
     {
-        fb_write_cell_at_cursor('0', FB_WHITE, FB_BLACK);
+        fb_write_string("0", FB_WHITE, FB_BLACK);
         return;
     }
 
@@ -81,119 +73,568 @@ void fb_write_dec(unsigned int n)
     fb_write_string(&buffer[i + 1], FB_WHITE, FB_BLACK);
 }
 
-// --- Command Execution ---
+// Parse a decimal number; returns 0 if 's' is not one
+static int parse_uint(const char *s, uint32_t *value)
+{
+    if (*s < '0' || *s > '9')
+        return 0;
+    *value = 0;
+    while (*s >= '0' && *s <= '9')
+        *value = *value * 10 + (*s++ - '0');
+    return *s == '\0';
+}
+
+static uint32_t cycle_avg(const struct irq_cycle_stats *stats)
+{
+    return stats->count ? (uint32_t)div64_u32(stats->total, stats->count, NULL) : 0;
+}
+
+static void print_histogram(const char *title, const struct irq_cycle_stats *stats)
+{
+    char line[96];
+    uint32_t peak = 0;
+    for (int b = 0; b < IRQ_HIST_BUCKETS; b++)
+        if (stats->histogram[b] > peak)
+            peak = stats->histogram[b];
+
+    ksnprintf(line, sizeof(line), "%s (%u samples):\n", title, stats->count);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    for (int b = 0; b < IRQ_HIST_BUCKETS; b++)
+    {
+        if (stats->histogram[b] == 0)
+            continue;
+        char bar[41];
+        int len = (int)div64_u32((uint64_t)stats->histogram[b] * 40, peak, NULL);
+        if (len == 0)
+            len = 1;
+        memset(bar, '#', len);
+        bar[len] = '\0';
+        ksnprintf(line, sizeof(line), "  %7u%s %8u %s\n", 1u << b,
+                  b == IRQ_HIST_BUCKETS - 1 ? "+ " : "..", stats->histogram[b], bar);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
+
+// Wrong arguments: repeat the command's usage line from the registry
+static void usage_error(char **argv)
+{
+    const struct command *cmd = command_find(argv[0]);
+    fb_write_string("Usage: ", FB_RED, FB_BLACK);
+    fb_write_string(argv[0], FB_RED, FB_BLACK);
+    fb_write_string(" ", FB_RED, FB_BLACK);
+    fb_write_string(cmd ? cmd->usage : "", FB_RED, FB_BLACK);
+    fb_write_string("\n", FB_RED, FB_BLACK);
+}
+
+// Report-style benchmarks that print their own tables
+static const struct
+{
+    const char *name;
+    void (*run)();
+} bench_reports[] = {
+    {"pmm", pmm_benchmark},
+    {"kmem", kheap_benchmark},
+    {"fb", fb_benchmark},
+    {"io", io_benchmark},
+    {"kbd", keyboard_benchmark},
+    {"mem", mem_benchmark},
+    {"irq", irq_benchmark},
+    {"ctxsw", thread_benchmark},
+    {"parfor", workpool_benchmark},
+    {"dispatch", command_benchmark},
+    {"initrd", initrd_benchmark},
+};
+
+#define BENCH_REPORT_COUNT (sizeof(bench_reports) / sizeof(bench_reports[0]))
+
+// --- Commands ---
+// Each COMMAND() registers itself through the 'commands' section; see command.h
+
+COMMAND(help, "[command]", "Show this list, or the arguments of one command")
+{
+    command_print_help(argc > 1 ? argv[1] : NULL);
+}
+
+COMMAND(cls, "", "Clear the screen")
+{
+    fb_clear();
+}
+
+COMMAND(echo, "[text...]", "Print the arguments, separated by single spaces")
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i > 1)
+            fb_write_string(" ", FB_LIGHT_BROWN, FB_BLACK);
+        fb_write_string(argv[i], FB_LIGHT_BROWN, FB_BLACK); // Use light brown (yellow)
+    }
+    fb_write_string("\n", FB_LIGHT_BROWN, FB_BLACK);
+}
+
+COMMAND(meminfo, "", "Show the physical memory map (from Multiboot) and frame allocator counters")
+{
+    memmap_print(); // Regions cached at boot: full 64-bit ranges, in hex
+
+    // Physical frame allocator counters
+    struct pmm_stats stats;
+    pmm_get_stats(&stats);
+    fb_write_string("\nFrame allocator: ", FB_GREEN, FB_BLACK);
+    fb_write_dec(stats.free_frames);
+    fb_write_string(" / ", FB_WHITE, FB_BLACK);
+    fb_write_dec(stats.total_frames);
+    fb_write_string(" frames free (", FB_WHITE, FB_BLACK);
+    fb_write_dec(stats.free_frames * (PAGE_SIZE / 1024));
+    fb_write_string(" KB)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  allocs: ", FB_WHITE, FB_BLACK);
+    fb_write_dec(stats.alloc_count);
+    fb_write_string("  frees: ", FB_WHITE, FB_BLACK);
+    fb_write_dec(stats.free_count);
+    fb_write_string("  failed: ", FB_WHITE, FB_BLACK);
+    fb_write_dec(stats.failed_count);
+    fb_write_string("\n  free blocks by order:", FB_WHITE, FB_BLACK);
+    for (int order = 0; order <= PMM_MAX_ORDER; order++)
+    {
+        fb_write_string(" ", FB_WHITE, FB_BLACK);
+        fb_write_dec(stats.free_blocks[order]);
+    }
+    fb_write_string("\n", FB_WHITE, FB_BLACK);
+}
+
+COMMAND(kmemstat, "", "Show kernel heap (slab cache) usage")
+{
+    fb_write_string("Kernel heap caches:\n", FB_GREEN, FB_BLACK);
+    fb_write_string("  size | pages/slab | slabs | in use / total | frag % | allocs | frees\n", FB_CYAN, FB_BLACK);
+    for (int i = 0; i < KHEAP_CACHE_COUNT; i++)
+    {
+        struct kheap_cache_stats cs;
+        kheap_get_cache_stats(i, &cs);
+
+        // Share of the cache's slab memory not holding live objects
+        uint32_t slab_bytes = cs.slabs * cs.slab_pages * PAGE_SIZE;
+        uint32_t used_bytes = cs.objects_in_use * cs.object_size;
+        uint32_t frag = slab_bytes ? (slab_bytes - used_bytes) * 100 / slab_bytes : 0;
+
+        fb_write_string("  ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.object_size);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.slab_pages);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.slabs);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.objects_in_use);
+        fb_write_string(" / ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.objects_total);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(frag);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.alloc_count);
+        fb_write_string(" | ", FB_WHITE, FB_BLACK);
+        fb_write_dec(cs.free_count);
+        fb_write_string("\n", FB_WHITE, FB_BLACK);
+    }
+
+    struct kheap_large_stats ls;
+    kheap_get_large_stats(&ls);
+    fb_write_string("  large objects: ", FB_GREEN, FB_BLACK);
+    fb_write_dec(ls.pages_in_use);
+    fb_write_string(" pages in use, ", FB_WHITE, FB_BLACK);
+    fb_write_dec(ls.alloc_count);
+    fb_write_string(" allocs, ", FB_WHITE, FB_BLACK);
+    fb_write_dec(ls.free_count);
+    fb_write_string(" frees\n", FB_WHITE, FB_BLACK);
+}
+
+COMMAND(uptime, "", "Show time since boot")
+{
+    uint32_t rem_ns;
+    uint32_t seconds = (uint32_t)div64_u32(clock_ns(), 1000000000, &rem_ns);
+    uint32_t millis = rem_ns / 1000000;
+
+    fb_write_string("Uptime: ", FB_GREEN, FB_BLACK);
+    fb_write_dec(seconds);
+    fb_write_string(".", FB_WHITE, FB_BLACK);
+    if (millis < 100)
+        fb_write_string("0", FB_WHITE, FB_BLACK);
+    if (millis < 10)
+        fb_write_string("0", FB_WHITE, FB_BLACK);
+    fb_write_dec(millis);
+    fb_write_string(" s (", FB_WHITE, FB_BLACK);
+    fb_write_dec((uint32_t)ticks());
+    fb_write_string(" ticks at ", FB_WHITE, FB_BLACK);
+    fb_write_dec(timer_hz());
+    fb_write_string(" Hz, TSC ", FB_WHITE, FB_BLACK);
+    fb_write_dec(tsc_khz() / 1000);
+    fb_write_string(" MHz)\n", FB_WHITE, FB_BLACK);
+}
+
+COMMAND(boottime, "", "Show how long each boot phase took")
+{
+    boottime_print();
+}
+
+COMMAND(kbdstat, "[reset]", "Show keyboard ring and IRQ latency stats")
+{
+    fb_write_string("Keyboard: ", FB_GREEN, FB_BLACK);
+    fb_write_dec(keyboard_received_count());
+    fb_write_string(" scancodes queued, ", FB_WHITE, FB_BLACK);
+    fb_write_dec(keyboard_dropped_count());
+    fb_write_string(" dropped (ring of ", FB_WHITE, FB_BLACK);
+    fb_write_dec(KBD_RING_SIZE);
+    fb_write_string(")\nLongest IRQ handler run (interrupts off): ", FB_WHITE, FB_BLACK);
+    fb_write_dec(irq_max_disabled_cycles());
+    fb_write_string(" cycles\n", FB_WHITE, FB_BLACK);
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+        irq_reset_max_disabled_cycles();
+}
 
-// Function to execute commands
-void run_shell_command(const char *command)
+COMMAND(irqstat, "[fast|slow|timing on|timing off|reset|hist <vector>]",
+        "Show IRQ counts and cycles, or change the entry path")
 {
-    if (simple_strcmp(command, "help") == 0)
+    char line[96];
+    uint32_t vector;
+    struct irq_cycle_stats entry, body;
+
+    if (argc == 2 && (strcmp(argv[1], "fast") == 0 || strcmp(argv[1], "slow") == 0))
     {
-        fb_write_string("Available commands:\n", FB_GREEN, FB_BLACK);
-        fb_write_string("  help    - Show this help message\n", FB_WHITE, FB_BLACK);
-        fb_write_string("  cls     - Clear the screen\n", FB_WHITE, FB_BLACK);
-        fb_write_string("  echo    - Print text after command\n", FB_WHITE, FB_BLACK);
-        fb_write_string("  meminfo - Show basic memory info (from Multiboot)\n", FB_WHITE, FB_BLACK);
+        irq_set_fast_entry(argv[1][0] == 'f');
     }
-    else if (simple_strcmp(command, "cls") == 0)
+    else if (argc == 3 && strcmp(argv[1], "timing") == 0 && (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0))
     {
-        fb_clear();
+        irq_set_timing(argv[2][1] == 'n');
     }
-    else if (simple_strncmp(command, "echo ", 5) == 0)
-    {                                                            // Check for "echo " prefix
-        const char *text_to_echo = command + 5;                  // Get pointer to text after "echo "
-        fb_write_string(text_to_echo, FB_LIGHT_BROWN, FB_BLACK); // Use light brown (yellow)
-        fb_write_string("\n", FB_LIGHT_BROWN, FB_BLACK);
+    else if (argc == 2 && strcmp(argv[1], "reset") == 0)
+    {
+        irq_reset_timing();
     }
-    else if (simple_strcmp(command, "meminfo") == 0)
+    else if (argc == 3 && strcmp(argv[1], "hist") == 0 && parse_uint(argv[2], &vector) && vector < INTERRUPT_VECTORS)
     {
-        if (global_mb_info_addr == 0)
+        irq_get_timing(vector, &entry, &body);
+        print_histogram("Stub entry to EOI, cycles", &entry);
+        print_histogram("Handler body, cycles", &body);
+        return;
+    }
+    else if (argc > 1)
+    {
+        usage_error(argv);
+        return;
+    }
+
+    ksnprintf(line, sizeof(line), "Entry path: %s, cycle accounting: %s\n",
+              irq_fast_entry_enabled() ? "fast" : "slow", irq_timing_enabled() ? "on" : "off");
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("Vec Source            Count  entry min/avg/max   body min/avg/max\n", FB_GREEN, FB_BLACK);
+    for (int v = 0; v < INTERRUPT_VECTORS; v++)
+    {
+        uint32_t count = interrupt_hits(v);
+        if (count == 0)
+            continue;
+        irq_get_timing(v, &entry, &body);
+        if (entry.count)
+            ksnprintf(line, sizeof(line), "%3d %-14s %9u %6u/%6u/%7u %6u/%6u/%7u\n", v, interrupt_name(v), count,
+                      entry.min, cycle_avg(&entry), entry.max, body.min, cycle_avg(&body), body.max);
+        else
+            ksnprintf(line, sizeof(line), "%3d %-14s %9u\n", v, interrupt_name(v), count);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+    ksnprintf(line, sizeof(line), "Spurious IRQ 7/15: %u\n", irq_spurious_count());
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
+
+COMMAND(dmesg, "", "Replay the kernel log ring")
+{
+    klog_dmesg();
+}
+
+COMMAND(apic, "", "Show local/I/O APIC routing and LAPIC timer state")
+{
+    apic_print_info();
+}
+
+COMMAND(cpus, "", "List processors, their APIC IDs and per-CPU IRQ counts")
+{
+    smp_print_cpus();
+}
+
+COMMAND(ps, "", "List kernel threads with state, priority and CPU time")
+{
+    thread_print_list();
+}
+
+// The whole suite, one registered benchmark or one report
+COMMAND(bench, "[list|<name>]", "Run the benchmark suite, one benchmark or one report")
+{
+    const char *name = argc > 1 ? argv[1] : "";
+
+    if (strcmp(name, "list") == 0)
+    {
+        fb_write_string("Benchmarks (median/p99 of rdtsc samples):\n", FB_GREEN, FB_BLACK);
+        bench_list();
+        fb_write_string("Reports:\n ", FB_GREEN, FB_BLACK);
+        for (unsigned int i = 0; i < BENCH_REPORT_COUNT; i++)
         {
-            fb_write_string("Error: Multiboot info address not available.\n", FB_RED, FB_BLACK);
+            fb_write_string(" ", FB_WHITE, FB_BLACK);
+            fb_write_string(bench_reports[i].name, FB_WHITE, FB_BLACK);
+        }
+        fb_write_string("\n", FB_WHITE, FB_BLACK);
+        return;
+    }
+    for (unsigned int i = 0; i < BENCH_REPORT_COUNT; i++)
+    {
+        if (strcmp(name, bench_reports[i].name) == 0)
+        {
+            bench_reports[i].run();
             return;
         }
-        multiboot_info_t *mb_info = (multiboot_info_t *)global_mb_info_addr;
-        fb_write_string("Memory Info (from Multiboot):\n", FB_GREEN, FB_BLACK);
+    }
+    if (bench_run(name) != 0)
+    {
+        fb_write_string("Unknown benchmark: '", FB_RED, FB_BLACK);
+        fb_write_string(name, FB_RED, FB_BLACK);
+        fb_write_string("' (see 'bench list')\n", FB_RED, FB_BLACK);
+    }
+}
 
-        // Check if memory map is available (preferred)
-        if (mb_info->flags & MULTIBOOT_INFO_MEM_MAP)
+COMMAND(prof, "start [hz] | stop | report [n] | folded", "Sampling profiler")
+{
+    uint32_t value = 0;
+    const char *op = argc > 1 ? argv[1] : "";
+
+    if (strcmp(op, "start") == 0 && (argc == 2 || (argc == 3 && parse_uint(argv[2], &value))))
+    {
+        if (prof_start(value) != 0)
         {
-            multiboot_memory_map_t *mmap = (multiboot_memory_map_t *)mb_info->mmap_addr;
-            unsigned long total_mem_kb = 0;
-            unsigned int entry_count = 0;
-            fb_write_string(" Type | Start Addr (low) | Length (KB)\n", FB_CYAN, FB_BLACK);
-            fb_write_string("------|------------------|-------------\n", FB_CYAN, FB_BLACK);
-
-            // Iterate through the memory map entries
-            while ((unsigned long)mmap < mb_info->mmap_addr + mb_info->mmap_length)
-            {
-                entry_count++;
-                unsigned long len_kb = mmap->len / 1024; // Calculate length in KB
+            fb_write_string("Out of memory for the sample buffers.\n", FB_RED, FB_BLACK);
+            return;
+        }
+        fb_write_string("Profiling started.\n", FB_GREEN, FB_BLACK);
+    }
+    else if (strcmp(op, "stop") == 0 && argc == 2)
+    {
+        prof_stop();
+        fb_write_string("Profiling stopped.\n", FB_GREEN, FB_BLACK);
+    }
+    else if (strcmp(op, "report") == 0 && argc == 2)
+    {
+        prof_report(PROF_DEFAULT_TOP);
+    }
+    else if (strcmp(op, "report") == 0 && argc == 3 && parse_uint(argv[2], &value))
+    {
+        prof_report(value);
+    }
+    else if (strcmp(op, "folded") == 0 && argc == 2)
+    {
+        prof_export_folded();
+    }
+    else
+    {
+        usage_error(argv);
+    }
+}
 
-                // Print type
-                if (mmap->type == MULTIBOOT_MEMORY_AVAILABLE)
-                {
-                    fb_write_string(" Avail| ", FB_WHITE, FB_BLACK);
-                    total_mem_kb += len_kb; // Add to total available memory
-                }
-                else
-                {
-                    fb_write_string(" Reserv| ", FB_LIGHT_RED, FB_BLACK);
-                }
+COMMAND(trace, "[on|off|clear|dump]", "Event tracing")
+{
+    const char *op = argc > 1 ? argv[1] : "";
 
-                // Print start address (low 32 bits)
-                fb_write_dec((unsigned int)(mmap->addr & 0xFFFFFFFF));
-                fb_write_string(" | ", FB_WHITE, FB_BLACK);
+    if (argc == 1)
+    {
+        trace_print_status();
+    }
+    else if (strcmp(op, "on") == 0)
+    {
+        if (trace_enable() != 0)
+            fb_write_string("Out of memory for the trace buffers.\n", FB_RED, FB_BLACK);
+    }
+    else if (strcmp(op, "off") == 0)
+    {
+        trace_disable();
+    }
+    else if (strcmp(op, "clear") == 0)
+    {
+        trace_clear();
+    }
+    else if (strcmp(op, "dump") == 0)
+    {
+        trace_dump();
+    }
+    else
+    {
+        usage_error(argv);
+    }
+}
 
-                // Print length in KB
-                fb_write_dec(len_kb);
-                fb_write_string("\n", FB_WHITE, FB_BLACK);
+// --- Command Execution ---
 
-                // Move to the next memory map entry
-                mmap = (multiboot_memory_map_t *)((unsigned long)mmap + mmap->size + sizeof(mmap->size));
-            }
-            fb_write_string("\nTotal Available RAM (from map): ", FB_GREEN, FB_BLACK);
-            fb_write_dec(total_mem_kb);
-            fb_write_string(" KB (", FB_GREEN, FB_BLACK);
-            fb_write_dec(entry_count);
-            fb_write_string(" entries)\n", FB_GREEN, FB_BLACK);
-        }
-        else if (mb_info->flags & MULTIBOOT_INFO_MEMORY)
+// Function to execute commands; the line is split into words in place
+void run_shell_command(char *command)
+{
+    char *argv[COMMAND_MAX_ARGS];
+    // Measured before the tokenizer writes NULs into it; only TRACE reads it
+    uint32_t len __attribute__((unused)) = strlen(command);
+
+    TRACE(TRACE_SHELL_BEGIN, len);
+    int argc = command_tokenize(command, argv, COMMAND_MAX_ARGS);
+    if (argc > 0)
+    {
+        const struct command *cmd = command_find(argv[0]);
+        if (cmd != NULL)
         {
-            // Fallback to simple mem_lower/mem_upper if map not present
-            unsigned long total_kb = mb_info->mem_lower + mb_info->mem_upper;
-            fb_write_string("Basic Memory Info (lower + upper):\n", FB_WHITE, FB_BLACK);
-            fb_write_dec(total_kb);
-            fb_write_string(" KB Total\n", FB_WHITE, FB_BLACK);
+            cmd->fn(argc, argv);
         }
         else
         {
-            fb_write_string("No detailed memory info available from bootloader.\n", FB_RED, FB_BLACK);
+            fb_write_string("Unknown command: '", FB_RED, FB_BLACK);
+            fb_write_string(argv[0], FB_RED, FB_BLACK);
+            fb_write_string("'\n", FB_RED, FB_BLACK);
+        }
+    }
+    TRACE(TRACE_SHELL_END, len);
+}
+
+// --- Line Editing ---
+
+// Handle one input character: echo it, edit the buffer, run the command on Enter
+void shell_input_char(char c)
+{
+    struct shell_line *line = &lines[fb_active_vt()];
+    TRACE(TRACE_SHELL_INPUT, (uint8_t)c);
+
+    if (c == '\n')
+    {
+        fb_write_cell_at_cursor('\n', FB_WHITE, FB_BLACK); // Echo newline
+        line->buffer[line->idx] = '\0';                    // Null-terminate
+        if (line->idx > 0)
+        { // Only run if command is not empty
+            run_shell_command(line->buffer);
+        }
+        clear_cmd_buffer();
+        fb_write_string("> ", FB_CYAN, FB_BLACK); // Show prompt again
+    }
+    else if (c == '\b')
+    { // Handle backspace
+        if (line->idx > 0)
+        {
+            line->idx--;
+            // Erase character on screen
+            unsigned short current_col = fb_get_cursor_col();
+            unsigned short current_row = fb_get_cursor_row();
+            if (current_col == 0)
+            {
+                if (current_row > 0)
+                {
+                    current_row--;
+                    current_col = FB_COLS - 1;
+                } // else, already at 0,0, can't backspace further visually
+            }
+            else
+            {
+                current_col--;
+            }
+            // Blank the cell in place (not mirrored), then erase on the serial side
+            fb_write_cell(current_row * FB_COLS + current_col, ' ', FB_WHITE, FB_BLACK);
+            fb_move_cursor(current_row, current_col);
+            serial_write("\b \b");
         }
     }
     else
     {
-        fb_write_string("Unknown command: '", FB_RED, FB_BLACK);
-        fb_write_string(command, FB_RED, FB_BLACK);
-        fb_write_string("'\n", FB_RED, FB_BLACK);
+        // Add character to buffer if space available
+        if (line->idx < CMD_BUFFER_SIZE - 1)
+        {
+            line->buffer[line->idx++] = c;
+            fb_write_cell_at_cursor(c, FB_WHITE, FB_BLACK); // Echo character to screen
+        }
     }
 }
 
+// Handle one decoded key: characters go to the line editor, Shift+PgUp/PgDn
+// scroll through the history and Alt+F1..F4 switch virtual terminals
+void shell_input_key(int key)
+{
+    if (key < 0x80)
+    {
+        shell_input_char((char)key);
+    }
+    else if (key == (KEY_MOD_SHIFT | KEY_PGUP))
+    {
+        fb_scroll_view(FB_ROWS - 1);
+    }
+    else if (key == (KEY_MOD_SHIFT | KEY_PGDN))
+    {
+        fb_scroll_view(-(FB_ROWS - 1));
+    }
+    else if (key >= (KEY_MOD_ALT | KEY_F1) && key < (KEY_MOD_ALT | KEY_F1) + FB_VT_COUNT)
+    {
+        unsigned int index = key - (KEY_MOD_ALT | KEY_F1);
+        fb_switch_vt(index);
+        if (!lines[index].started)
+        {
+            lines[index].started = 1;
+            fb_write_string("> ", FB_CYAN, FB_BLACK);
+        }
+    }
+}
+
+// Handle one byte from the serial console: terminals send CR for Enter
+// (possibly followed by LF) and DEL for Backspace
+static void shell_input_serial(int c)
+{
+    static int last_was_cr = 0;
+
+    if (c == '\n' && last_was_cr)
+    {
+        last_was_cr = 0;
+        return; // Second half of CRLF
+    }
+    last_was_cr = (c == '\r');
+
+    if (c == '\r')
+        c = '\n';
+    else if (c == 0x7F)
+        c = '\b';
+    else if (c < ' ' && c != '\n' && c != '\b')
+        return; // Other control characters and escape sequences are ignored
+    if (c >= 0x80)
+        return;
+    shell_input_char((char)c);
+}
+
 // --- Shell Initialization and Running ---
 
 // Initialize shell state
 void shell_init()
 {
-    clear_cmd_buffer();
+    memset(lines, 0, sizeof(lines));
+    command_init();
 }
 
-// Start the shell (display prompt and wait for interrupts)
+// Start the shell (display prompt, then process input as it arrives)
 void shell_run()
 {
+    lines[fb_active_vt()].started = 1;
     fb_write_string("> ", FB_CYAN, FB_BLACK); // Show initial prompt
-    // The main processing loop is now driven by keyboard interrupts.
-    // The kernel can idle here using 'hlt'.
+    // The keyboard and serial IRQs only queue bytes; decoding, echo and
+    // command execution all happen here, with interrupts enabled.
     while (1)
     {
-        asm volatile("hlt"); // Halt CPU until the next interrupt occurs
+        int c;
+        while ((c = keyboard_getchar()) >= 0)
+        {
+            shell_input_key(c);
+        }
+        while ((c = serial_getchar()) >= 0)
+        {
+            shell_input_serial(c);
+        }
+        klog_drain(); // Log records queued by IRQs and commands since the last pass
+        fb_flush();   // Echoed characters reach the screen once per batch
+
+        // Re-check with interrupts off so input arriving right now can't be
+        // missed; waiting enables interrupts (and halts or runs other
+        // threads) without a gap.
+        asm volatile("cli");
+        if (keyboard_has_input() || serial_has_input())
+            asm volatile("sti");
+        else
+            thread_wait_interrupt();
     }
 }
\ No newline at end of file
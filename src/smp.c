@@ -0,0 +1,170 @@
+// smp.c - Application processor bring-up through a real-mode trampoline
+#include "smp.h"
+#include "apic.h"
+#include "idt.h"
+#include "gdt.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "timer.h"
+#include "string.h"
+#include "klog.h"
+#include "fb.h"
+#include "workpool.h"
+
+#define SIPI_VECTOR (SMP_TRAMPOLINE_BASE >> 12)
+#define INIT_DELAY_US 10000   // INIT to first SIPI
+#define SIPI_TIMEOUT_US 200   // First SIPI to the retry
+#define AP_START_TIMEOUT_US 100000
+
+// Filled in before each SIPI (layout matches trampoline_params in trampoline.s)
+struct trampoline_params
+{
+    uint32_t cr0;
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+};
+
+// Real-mode blob and its parameter block (trampoline.s)
+extern char trampoline_start[];
+extern char trampoline_end[];
+extern char trampoline_params[];
+
+struct cpu cpus[SMP_MAX_CPUS];
+static int cpu_count = 1; // Entries of cpus[] in use
+static volatile uint32_t online_count = 1;
+
+static void delay_us(uint32_t us)
+{
+    uint64_t end = clock_ns() + (uint64_t)us * 1000;
+    while (clock_ns() < end)
+        asm volatile("pause");
+}
+
+// Wait up to 'us' microseconds for 'cpu' to report in
+static int wait_online(struct cpu *cpu, uint32_t us)
+{
+    uint64_t end = clock_ns() + (uint64_t)us * 1000;
+    while (!__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE))
+    {
+        if (clock_ns() >= end)
+            return 0;
+        asm volatile("pause");
+    }
+    return 1;
+}
+
+// First C code on an application processor, on its own stack
+static void ap_entry(struct cpu *cpu)
+{
+    gdt_load_cpu(cpu->gdt, &cpu->gdt_ptr, &cpu->tss, (uint32_t)cpu, sizeof(*cpu), cpu->stack_top);
+    idt_load_cpu();
+    lapic_init_ap();
+
+    __atomic_fetch_add(&online_count, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+    klog(KLOG_INFO, "CPU %u online (APIC id %u)\n", this_cpu_read(index), lapic_id());
+
+    // Device interrupts all go to the boot CPU: this one only runs pool work
+    workpool_ap_main();
+}
+
+static int start_ap(struct cpu *cpu, struct trampoline_params *params)
+{
+    uint32_t stack = pmm_alloc_pages(SMP_AP_STACK_ORDER);
+    if (stack == 0)
+        return -1;
+    cpu->stack_top = stack + (PAGE_SIZE << SMP_AP_STACK_ORDER);
+
+    params->stack = cpu->stack_top;
+    params->entry = (uint32_t)ap_entry;
+    params->cpu = (uint32_t)cpu;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Parameters visible before the IPIs
+
+    // The AP already got its INIT (smp_init); the second SIPI is only needed
+    // if the first one was lost
+    lapic_send_ipi(cpu->apic_id, APIC_IPI_STARTUP | SIPI_VECTOR);
+    if (!wait_online(cpu, SIPI_TIMEOUT_US))
+    {
+        lapic_send_ipi(cpu->apic_id, APIC_IPI_STARTUP | SIPI_VECTOR);
+        if (!wait_online(cpu, AP_START_TIMEOUT_US))
+            return -1; // The stack stays allocated: a slow AP may still be on its way to it
+    }
+    return 0;
+}
+
+int smp_init()
+{
+    const struct acpi_madt_info *madt = apic_madt();
+    cpus[0].apic_id = lapic_id();
+    if (madt == NULL)
+        return 1;
+
+    // Low memory is reserved by the frame allocator, so the page is free to reuse
+    memcpy((void *)SMP_TRAMPOLINE_BASE, trampoline_start, trampoline_end - trampoline_start);
+    struct trampoline_params *params =
+        (struct trampoline_params *)(SMP_TRAMPOLINE_BASE + (trampoline_params - trampoline_start));
+    params->cr0 = read_cr0();
+    params->cr3 = read_cr3();
+    params->cr4 = read_cr4();
+
+    // INIT resets every AP into wait-for-SIPI. Sending them all first means
+    // one INIT delay for the whole machine instead of one per CPU.
+    int inits = 0;
+    for (int i = 0; i < madt->cpu_count && inits < SMP_MAX_CPUS - 1; i++)
+    {
+        if (madt->cpu_apic_ids[i] == cpus[0].apic_id)
+            continue;
+        lapic_send_ipi(madt->cpu_apic_ids[i], APIC_IPI_INIT);
+        inits++;
+    }
+    if (inits == 0)
+        return online_count;
+    delay_us(INIT_DELAY_US);
+
+    // One AP at a time: they all share the trampoline's parameter block
+    for (int i = 0; i < madt->cpu_count && cpu_count < SMP_MAX_CPUS; i++)
+    {
+        uint8_t apic_id = madt->cpu_apic_ids[i];
+        if (apic_id == cpus[0].apic_id)
+            continue;
+
+        struct cpu *cpu = &cpus[cpu_count];
+        memset(cpu, 0, sizeof(*cpu));
+        cpu->self = cpu;
+        cpu->index = cpu_count;
+        cpu->apic_id = apic_id;
+        cpu_count++;
+        if (start_ap(cpu, params) != 0)
+        {
+            // The AP may still come up late, on this slot and the parameters
+            // it was given, so neither is reused. Bringing up the rest would
+            // leave a gap: the work pool and the profiler take cpus[0] to
+            // cpus[online - 1] as the online CPUs.
+            klog(KLOG_WARN, "CPU with APIC id %u did not start; not starting the remaining CPUs\n", apic_id);
+            break;
+        }
+    }
+    return online_count;
+}
+
+int smp_cpu_count()
+{
+    return online_count;
+}
+
+void smp_print_cpus()
+{
+    char line[96];
+    uint32_t current = this_cpu_read(index);
+    for (int i = 0; i < cpu_count; i++)
+    {
+        struct cpu *cpu = &cpus[i];
+        ksnprintf(line, sizeof(line), "CPU %u: APIC id %2u  %s  stack top 0x%08x  %u IRQs%s%s\n", cpu->index,
+                  cpu->apic_id, cpu->online ? "online " : "offline", cpu->stack_top, cpu->irq_count,
+                  i == 0 ? "  [boot]" : "", cpu->index == current ? "  [this CPU]" : "");
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
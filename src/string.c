@@ -1,18 +1,425 @@
-// string.c - Basic string/memory function implementations
+// string.c - Freestanding string and memory functions (rep movsd/stosd, optional SSE2)
 #include "string.h"
+#include "cpu.h"
+#include "fb.h"
+#include "kheap.h"
+#include "div64.h"
+#include "shell.h" // For fb_write_dec
+#include "bench.h"
 
-// Set 'n' bytes of memory starting at 's' to value 'c'
-void *memset(void *s, int c, size_t n)
+// Copies/fills at least this large bypass the cache with non-temporal stores
+#define MEM_NT_THRESHOLD (256 * 1024)
+
+// SSE2 paths run with interrupts off (the kernel does not save XMM state on
+// interrupts), one chunk at a time so IRQ latency stays bounded
+#define MEM_SSE2_CHUNK 4096
+
+// Dword view of memory that is allowed to alias any other type
+typedef uint32_t __attribute__((may_alias)) alias_u32;
+
+static int have_sse2 = 0;
+
+void string_init()
 {
-    unsigned char *p = (unsigned char *)s;
-    unsigned char value = (unsigned char)c;
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t needed = CPUID_EDX_FXSR | CPUID_EDX_SSE | CPUID_EDX_SSE2;
+    if ((edx & needed) != needed)
+        return;
+
+    // No x87 emulation, FXSAVE/SSE enabled, SIMD exceptions reported as #XM
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    have_sse2 = 1;
+}
+
+int string_have_sse2()
+{
+    return have_sse2;
+}
+
+// --- Byte loops (reference, used by the benchmark only) ---
+
+static void *memcpy_bytes(void *dest, const void *src, size_t n)
+{
+    unsigned char *d = (unsigned char *)dest;
+    const unsigned char *s = (const unsigned char *)src;
+    for (size_t i = 0; i < n; i++)
+    {
+        d[i] = s[i];
+    }
+    return dest;
+}
 
+static void *memset_bytes(void *s, int c, size_t n)
+{
+    unsigned char *p = (unsigned char *)s;
     for (size_t i = 0; i < n; i++)
     {
-        p[i] = value;
+        p[i] = (unsigned char)c;
+    }
+    return s;
+}
+
+// --- rep movsd / rep stosd ---
+
+static void *memcpy_rep(void *dest, const void *src, size_t n)
+{
+    void *d = dest;
+    const void *s = src;
+
+    // Align the destination first so the dword stores never straddle lines
+    size_t head = (0u - (uint32_t)dest) & 3;
+    if (head > n)
+        head = n;
+    size_t dwords = (n - head) >> 2;
+    size_t tail = (n - head) & 3;
+
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(head) : : "memory");
+    asm volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(dwords) : : "memory");
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(tail) : : "memory");
+    return dest;
+}
+
+static void *memset_rep(void *s, int c, size_t n)
+{
+    void *d = s;
+    uint32_t pattern = (unsigned char)c * 0x01010101u;
+
+    size_t head = (0u - (uint32_t)s) & 3;
+    if (head > n)
+        head = n;
+    size_t dwords = (n - head) >> 2;
+    size_t tail = (n - head) & 3;
+
+    asm volatile("rep stosb" : "+D"(d), "+c"(head) : "a"(pattern) : "memory");
+    asm volatile("rep stosl" : "+D"(d), "+c"(dwords) : "a"(pattern) : "memory");
+    asm volatile("rep stosb" : "+D"(d), "+c"(tail) : "a"(pattern) : "memory");
+    return s;
+}
+
+// --- SSE2 ---
+
+// Defined in mem_sse2.s. 'n' is a non-zero multiple of 64 and 'dest' is
+// 16-byte aligned; non_temporal selects movntdq stores (plus sfence).
+extern void sse2_copy_block(void *dest, const void *src, size_t n, int non_temporal);
+extern void sse2_set_block(void *dest, uint32_t pattern, size_t n, int non_temporal);
+
+static void *memcpy_sse2(void *dest, const void *src, size_t n)
+{
+    char *d = (char *)dest;
+    const char *s = (const char *)src;
+    int non_temporal = n >= MEM_NT_THRESHOLD;
+
+    size_t head = (0u - (uint32_t)d) & 15;
+    if (head + 64 > n)
+        return memcpy_rep(dest, src, n);
+    memcpy_rep(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t body = n & ~63u;
+    while (body)
+    {
+        size_t chunk = body < MEM_SSE2_CHUNK ? body : MEM_SSE2_CHUNK;
+        uint32_t flags = irq_save();
+        sse2_copy_block(d, s, chunk, non_temporal);
+        irq_restore(flags);
+        d += chunk;
+        s += chunk;
+        body -= chunk;
+    }
+    memcpy_rep(d, s, n & 63);
+    return dest;
+}
+
+static void *memset_sse2(void *s, int c, size_t n)
+{
+    char *d = (char *)s;
+    uint32_t pattern = (unsigned char)c * 0x01010101u;
+    int non_temporal = n >= MEM_NT_THRESHOLD;
+
+    size_t head = (0u - (uint32_t)d) & 15;
+    if (head + 64 > n)
+        return memset_rep(s, c, n);
+    memset_rep(d, c, head);
+    d += head;
+    n -= head;
+
+    size_t body = n & ~63u;
+    while (body)
+    {
+        size_t chunk = body < MEM_SSE2_CHUNK ? body : MEM_SSE2_CHUNK;
+        uint32_t flags = irq_save();
+        sse2_set_block(d, pattern, chunk, non_temporal);
+        irq_restore(flags);
+        d += chunk;
+        body -= chunk;
+    }
+    memset_rep(d, c, n & 63);
+    return s;
+}
+
+// --- Public memory functions ---
+
+void *memset(void *s, int c, size_t n)
+{
+    if (have_sse2 && n >= MEM_SSE2_THRESHOLD)
+        return memset_sse2(s, c, n);
+    return memset_rep(s, c, n);
+}
+
+void *memcpy(void *dest, const void *src, size_t n)
+{
+    if (have_sse2 && n >= MEM_SSE2_THRESHOLD)
+        return memcpy_sse2(dest, src, n);
+    return memcpy_rep(dest, src, n);
+}
+
+void *memmove(void *dest, const void *src, size_t n)
+{
+    uint32_t d = (uint32_t)dest;
+    uint32_t s = (uint32_t)src;
+    if (d == s || n == 0)
+        return dest;
+
+    // Disjoint: any memcpy variant will do
+    if (d + n <= s || s + n <= d)
+        return memcpy(dest, src, n);
+
+    // Overlapping, destination below the source: a forward rep copy reads
+    // every byte before it can be overwritten
+    if (d < s)
+        return memcpy_rep(dest, src, n);
+
+    // Overlapping, destination above the source: copy backwards, dwords
+    // from the top first, then the leftover bytes at the bottom
+    size_t dwords = n >> 2;
+    size_t tail = n & 3;
+    void *dp = (char *)dest + n - 4;
+    const void *sp = (const char *)src + n - 4;
+    asm volatile("std\n\t"
+                 "rep movsl\n\t"
+                 "cld"
+                 : "+D"(dp), "+S"(sp), "+c"(dwords)
+                 :
+                 : "memory");
+    unsigned char *db = (unsigned char *)dest;
+    const unsigned char *sb = (const unsigned char *)src;
+    while (tail--)
+    {
+        db[tail] = sb[tail];
+    }
+    return dest;
+}
+
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+    const unsigned char *a = (const unsigned char *)s1;
+    const unsigned char *b = (const unsigned char *)s2;
+
+    // Skip equal dwords, then find the first differing byte
+    while (n >= 4 && *(const alias_u32 *)a == *(const alias_u32 *)b)
+    {
+        a += 4;
+        b += 4;
+        n -= 4;
     }
+    while (n && *a == *b)
+    {
+        a++;
+        b++;
+        n--;
+    }
+    return n ? *a - *b : 0;
+}
+
+void *memsetw(void *s, uint16_t value, size_t count)
+{
+    void *d = s;
+    uint32_t pattern = ((uint32_t)value << 16) | value;
+    size_t dwords = count >> 1;
+    size_t tail = count & 1;
+
+    asm volatile("rep stosl" : "+D"(d), "+c"(dwords) : "a"(pattern) : "memory");
+    asm volatile("rep stosw" : "+D"(d), "+c"(tail) : "a"(pattern) : "memory");
     return s;
 }
 
-// Implement strcmp, strncmp here if you want them centrally
-// (Currently implemented in shell.c as simple_strcmp/simple_strncmp)
\ No newline at end of file
+// --- Strings ---
+
+size_t strlen(const char *s)
+{
+    const char *p = s;
+    while (*p)
+        p++;
+    return p - s;
+}
+
+// Returns 0 if equal, <0 if s1 < s2, >0 if s1 > s2
+int strcmp(const char *s1, const char *s2)
+{
+    while (*s1 && (*s1 == *s2))
+    {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char *)s1 - *(const unsigned char *)s2;
+}
+
+// Compare at most n characters
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+    while (n && *s1 && (*s1 == *s2))
+    {
+        s1++;
+        s2++;
+        n--;
+    }
+    if (n == 0)
+        return 0;
+    return *(const unsigned char *)s1 - *(const unsigned char *)s2;
+}
+
+// --- Benchmark ---
+
+#define BENCH_MIN_SIZE 8
+#define BENCH_MAX_SIZE (1024 * 1024)
+#define BENCH_BYTES_PER_RUN (4 * 1024 * 1024) // Bytes moved per size and variant
+
+struct mem_variant
+{
+    const char *name;
+    void *(*copy)(void *, const void *, size_t);
+    void *(*set)(void *, int, size_t);
+    int needs_sse2;
+};
+
+static const struct mem_variant variants[] = {
+    {"byte ", memcpy_bytes, memset_bytes, 0},
+    {"rep  ", memcpy_rep, memset_rep, 0},
+    {"sse2 ", memcpy_sse2, memset_sse2, 1},
+};
+
+#define VARIANT_COUNT (sizeof(variants) / sizeof(variants[0]))
+
+// Print bytes/cycle with two decimals
+static void bench_rate(uint32_t bytes, uint64_t cycles)
+{
+    uint64_t scaled = (uint64_t)bytes * 100;
+    while (cycles >> 32)
+    {
+        cycles >>= 1;
+        scaled >>= 1;
+    }
+    uint32_t rate = cycles ? (uint32_t)div64_u32(scaled, (uint32_t)cycles, NULL) : 0;
+
+    fb_write_dec(rate / 100);
+    fb_write_string(rate % 100 < 10 ? ".0" : ".", FB_WHITE, FB_BLACK);
+    fb_write_dec(rate % 100);
+    fb_write_string(" ", FB_WHITE, FB_BLACK);
+}
+
+static void bench_size_label(uint32_t size)
+{
+    if (size >= 1024 * 1024)
+    {
+        fb_write_dec(size >> 20);
+        fb_write_string(" MiB", FB_WHITE, FB_BLACK);
+    }
+    else if (size >= 1024)
+    {
+        fb_write_dec(size >> 10);
+        fb_write_string(" KiB", FB_WHITE, FB_BLACK);
+    }
+    else
+    {
+        fb_write_dec(size);
+        fb_write_string(" B", FB_WHITE, FB_BLACK);
+    }
+}
+
+void mem_benchmark()
+{
+    // 64 spare bytes so the copies can read from a misaligned source
+    char *src = kmalloc(BENCH_MAX_SIZE + 64);
+    char *dst = kmalloc(BENCH_MAX_SIZE + 64);
+    if (src == NULL || dst == NULL)
+    {
+        fb_write_string("bench mem: out of memory\n", FB_RED, FB_BLACK);
+        kfree(src);
+        kfree(dst);
+        return;
+    }
+    memset_rep(src, 0x5A, BENCH_MAX_SIZE + 64);
+
+    fb_write_string("memcpy / memset, bytes per cycle", FB_GREEN, FB_BLACK);
+    fb_write_string(have_sse2 ? ":\n" : " (no SSE2):\n", FB_GREEN, FB_BLACK);
+    fb_write_string("  size      cpy: byte rep sse2 | set: byte rep sse2\n", FB_WHITE, FB_BLACK);
+
+    for (uint32_t size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size <<= 3)
+    {
+        uint32_t runs = BENCH_BYTES_PER_RUN / size;
+        if (runs == 0)
+            runs = 1;
+
+        fb_write_string("  ", FB_WHITE, FB_BLACK);
+        bench_size_label(size);
+        fb_write_string(":  ", FB_WHITE, FB_BLACK);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (unsigned int v = 0; v < VARIANT_COUNT; v++)
+            {
+                if (variants[v].needs_sse2 && !have_sse2)
+                {
+                    fb_write_string("- ", FB_WHITE, FB_BLACK);
+                    continue;
+                }
+                uint64_t start = rdtsc();
+                for (uint32_t r = 0; r < runs; r++)
+                {
+                    if (pass == 0)
+                        variants[v].copy(dst, src + 4, size); // Misaligned source, as in real copies
+                    else
+                        variants[v].set(dst, r, size);
+                }
+                bench_rate(runs * size, rdtsc() - start);
+            }
+            if (pass == 0)
+                fb_write_string("| ", FB_WHITE, FB_BLACK);
+        }
+        fb_write_string("\n", FB_WHITE, FB_BLACK);
+
+        // 8 -> 64 -> ... -> 256 KiB, then finish exactly on 1 MiB
+        if (size < BENCH_MAX_SIZE && (size << 3) > BENCH_MAX_SIZE)
+            size = BENCH_MAX_SIZE >> 3;
+    }
+
+    kfree(src);
+    kfree(dst);
+}
+
+// Registered memset benchmarks: small, page-sized and cache-sized fills
+#define BENCH_FILL_SIZE (64 * 1024)
+
+static uint8_t bench_fill_buffer[BENCH_FILL_SIZE] __attribute__((aligned(64)));
+
+BENCHMARK(memset_64, "memset of 64 bytes", 1024)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+        memset(bench_fill_buffer, (int)i, 64);
+}
+
+BENCHMARK(memset_4k, "memset of 4 KiB", 64)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+        memset(bench_fill_buffer, (int)i, 4096);
+}
+
+BENCHMARK(memset_64k, "memset of 64 KiB", 4)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+        memset(bench_fill_buffer, (int)i, BENCH_FILL_SIZE);
+}
+
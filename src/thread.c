@@ -0,0 +1,426 @@
+// thread.c - Kernel threads, O(1) priority-bitmap run queue and IRQ 0 preemption
+#include "thread.h"
+#include "cpu.h"
+#include "kheap.h"
+#include "pmm.h"
+#include "timer.h"
+#include "string.h"
+#include "percpu.h"
+#include "div64.h"
+#include "fb.h"
+#include "klog.h"
+#include "trace.h"
+
+#define KERNEL_CODE_SELECTOR 0x08
+#define KERNEL_DATA_SELECTOR 0x10
+#define EFLAGS_IF 0x202 // Interrupts enabled (bit 1 is always set)
+
+#define THREAD_BENCH_ROUNDS 10000
+
+// Stack switch (switch.s) and the tail of irq_common_stub (idt_asm.s)
+extern void context_switch(uint32_t *old_esp, uint32_t new_esp);
+extern char irq_return[];
+
+// All scheduler state is touched with interrupts off, on the boot CPU only
+static struct thread *current = NULL;
+static struct thread *idle_thread = NULL;
+static struct thread *all_threads = NULL;
+static struct thread boot_thread;
+
+// Bit p of ready_bitmap is set while ready_head[p] is non-empty, so the
+// most urgent ready thread is one bsf away regardless of thread count
+static uint32_t ready_bitmap = 0;
+static struct thread *ready_head[THREAD_PRIORITIES];
+static struct thread *ready_tail[THREAD_PRIORITIES];
+
+static struct thread *sleep_list = NULL; // Sorted by wake_tick
+static struct thread *irq_waiters = NULL;
+
+static volatile int need_resched = 0;
+static uint32_t slice_left = THREAD_TIMESLICE_TICKS;
+static uint64_t switch_tsc = 0; // When 'current' was switched in
+static uint32_t next_tid = 0;
+
+static const char *const state_names[] = {"ready", "running", "sleeping", "blocked", "wait-irq", "dead"};
+
+// --- Run queue ---
+
+static void enqueue(struct thread *t)
+{
+    uint32_t p = t->priority;
+    t->next = NULL;
+    if (ready_tail[p])
+        ready_tail[p]->next = t;
+    else
+        ready_head[p] = t;
+    ready_tail[p] = t;
+    ready_bitmap |= 1u << p;
+}
+
+static struct thread *dequeue()
+{
+    if (ready_bitmap == 0)
+        return idle_thread;
+    uint32_t p = __builtin_ctz(ready_bitmap);
+    struct thread *t = ready_head[p];
+    ready_head[p] = t->next;
+    if (ready_head[p] == NULL)
+    {
+        ready_tail[p] = NULL;
+        ready_bitmap &= ~(1u << p);
+    }
+    t->next = NULL;
+    return t;
+}
+
+// Highest priority (lowest number) with a ready thread, THREAD_PRIORITIES if none
+static uint32_t best_ready_priority()
+{
+    return ready_bitmap ? (uint32_t)__builtin_ctz(ready_bitmap) : THREAD_PRIORITIES;
+}
+
+static void make_ready(struct thread *t)
+{
+    t->state = THREAD_READY;
+    enqueue(t);
+    if (current == idle_thread || t->priority < current->priority)
+        need_resched = 1;
+}
+
+// Switch to the most urgent ready thread. Interrupts must be off. A running
+// caller goes back on its queue (behind its equals); a blocking caller has
+// already changed its state.
+static void schedule()
+{
+    struct thread *prev = current;
+    if (prev->state == THREAD_RUNNING && prev != idle_thread)
+    {
+        prev->state = THREAD_READY;
+        enqueue(prev);
+    }
+
+    struct thread *next = dequeue();
+    need_resched = 0;
+    slice_left = THREAD_TIMESLICE_TICKS;
+    next->state = THREAD_RUNNING;
+    if (next == prev)
+        return;
+
+    uint64_t now = rdtsc();
+    prev->cycles += now - switch_tsc;
+    switch_tsc = now;
+    next->switches++;
+    current = next;
+    TRACE(TRACE_SCHED_SWITCH, next->tid);
+    context_switch(&prev->esp, next->esp);
+}
+
+// --- Thread lifetime ---
+
+static void thread_exit()
+{
+    asm volatile("cli");
+    current->state = THREAD_DEAD;
+    if (current->joiner)
+        make_ready(current->joiner);
+    schedule();
+    while (1) // Never switched back to
+        ;
+}
+
+// First code of every new thread, entered by iret from irq_return
+static void thread_start()
+{
+    current->entry(current->arg);
+    thread_exit();
+}
+
+static void idle_loop(void *arg)
+{
+    (void)arg;
+    while (1)
+        asm volatile("sti; hlt");
+}
+
+static struct thread *thread_alloc(const char *name, uint32_t priority)
+{
+    struct thread *t = kzalloc(sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->priority = priority < THREAD_PRIORITIES ? priority : THREAD_PRIORITIES - 1;
+    size_t len = strlen(name);
+    if (len >= THREAD_NAME_LEN)
+        len = THREAD_NAME_LEN - 1;
+    memcpy(t->name, name, len);
+    return t;
+}
+
+static struct thread *thread_spawn(const char *name, void (*entry)(void *arg), void *arg, uint32_t priority)
+{
+    struct thread *t = thread_alloc(name, priority);
+    if (t == NULL)
+        return NULL;
+    t->stack = pmm_alloc_pages(THREAD_STACK_ORDER);
+    if (t->stack == 0)
+    {
+        kfree(t);
+        return NULL;
+    }
+    t->entry = entry;
+    t->arg = arg;
+
+    // The same frame an interrupted thread leaves behind: an IRQ frame
+    // (registers_t) under context_switch's saved registers, returning to
+    // irq_return. useresp/ss are never popped by a ring 0 iret.
+    uint32_t top = t->stack + (PAGE_SIZE << THREAD_STACK_ORDER);
+    registers_t *frame = (registers_t *)(top - sizeof(registers_t));
+    memset(frame, 0, sizeof(*frame));
+    frame->ds = KERNEL_DATA_SELECTOR;
+    frame->eip = (uint32_t)thread_start;
+    frame->cs = KERNEL_CODE_SELECTOR;
+    frame->eflags = EFLAGS_IF;
+
+    uint32_t *sp = (uint32_t *)frame;
+    *--sp = (uint32_t)irq_return;
+    *--sp = 0; // ebp
+    *--sp = 0; // ebx
+    *--sp = 0; // esi
+    *--sp = 0; // edi
+    t->esp = (uint32_t)sp;
+
+    uint32_t flags = irq_save();
+    t->tid = next_tid++;
+    t->all_next = all_threads;
+    all_threads = t;
+    irq_restore(flags);
+    return t;
+}
+
+void thread_init()
+{
+    // The boot stack becomes the shell thread; it is never freed
+    memset(&boot_thread, 0, sizeof(boot_thread));
+    memcpy(boot_thread.name, "shell", 6);
+    boot_thread.priority = THREAD_PRIORITY_DEFAULT;
+    boot_thread.state = THREAD_RUNNING;
+    boot_thread.tid = next_tid++;
+    all_threads = &boot_thread;
+
+    idle_thread = thread_spawn("idle", idle_loop, NULL, THREAD_PRIORITIES - 1);
+    if (idle_thread == NULL)
+    {
+        klog(KLOG_ERR, "thread_init: no memory for the idle thread\n");
+        return;
+    }
+    idle_thread->state = THREAD_READY; // Picked only when the run queue is empty
+
+    switch_tsc = rdtsc();
+    current = &boot_thread; // From here on the tick may preempt
+}
+
+struct thread *thread_create(const char *name, void (*entry)(void *arg), void *arg, uint32_t priority)
+{
+    if (current == NULL)
+        return NULL;
+    struct thread *t = thread_spawn(name, entry, arg, priority);
+    if (t == NULL)
+        return NULL;
+
+    uint32_t flags = irq_save();
+    make_ready(t);
+    if (need_resched)
+        schedule(); // More urgent than the creator: run it now
+    irq_restore(flags);
+    return t;
+}
+
+void thread_yield()
+{
+    uint32_t flags = irq_save();
+    schedule();
+    irq_restore(flags);
+}
+
+void thread_sleep(uint32_t ms)
+{
+    uint64_t delay = div64_u32((uint64_t)ms * timer_hz() + 999, 1000, NULL);
+    if (delay == 0)
+        delay = 1;
+
+    uint32_t flags = irq_save();
+    current->wake_tick = ticks() + delay;
+    current->state = THREAD_SLEEPING;
+
+    struct thread **link = &sleep_list;
+    while (*link && (*link)->wake_tick <= current->wake_tick)
+        link = &(*link)->next;
+    current->next = *link;
+    *link = current;
+
+    schedule();
+    irq_restore(flags);
+}
+
+int thread_join(struct thread *t)
+{
+    if (t == NULL || t == current || t == &boot_thread)
+        return -1;
+
+    uint32_t flags = irq_save();
+    if (t->joiner != NULL && t->joiner != current)
+    {
+        irq_restore(flags);
+        return -1;
+    }
+    while (t->state != THREAD_DEAD)
+    {
+        t->joiner = current;
+        current->state = THREAD_BLOCKED;
+        schedule();
+    }
+
+    struct thread **link = &all_threads;
+    while (*link != t)
+        link = &(*link)->all_next;
+    *link = t->all_next;
+    irq_restore(flags);
+
+    // Dead threads never run again, so their stack is free
+    pmm_free_pages(t->stack, THREAD_STACK_ORDER);
+    kfree(t);
+    return 0;
+}
+
+struct thread *thread_current()
+{
+    return current;
+}
+
+void thread_wait_interrupt()
+{
+    if (current == NULL || ready_bitmap == 0)
+    {
+        asm volatile("sti; hlt");
+        return;
+    }
+
+    current->state = THREAD_WAIT_IRQ;
+    current->next = irq_waiters;
+    irq_waiters = current;
+    schedule();
+    asm volatile("sti");
+}
+
+// --- Scheduler hooks ---
+
+void thread_tick()
+{
+    if (current == NULL)
+        return;
+
+    uint64_t now = ticks();
+    while (sleep_list && sleep_list->wake_tick <= now)
+    {
+        struct thread *t = sleep_list;
+        sleep_list = t->next;
+        make_ready(t);
+    }
+
+    if (slice_left > 0)
+        slice_left--;
+    if (slice_left == 0 && best_ready_priority() <= current->priority)
+        need_resched = 1;
+}
+
+void thread_irq_exit()
+{
+    // Threads only run on the boot CPU
+    if (current == NULL || this_cpu_read(index) != 0)
+        return;
+
+    while (irq_waiters)
+    {
+        struct thread *t = irq_waiters;
+        irq_waiters = t->next;
+        make_ready(t);
+    }
+    if (need_resched)
+        schedule();
+}
+
+// --- Reporting ---
+
+void thread_print_list()
+{
+    char line[96];
+    uint32_t khz = tsc_khz();
+
+    fb_write_string(" TID NAME             STATE    PRIO  SWITCHES   CPU ms\n", FB_GREEN, FB_BLACK);
+    uint32_t flags = irq_save();
+    for (struct thread *t = all_threads; t; t = t->all_next)
+    {
+        uint64_t cycles = t->cycles;
+        if (t == current)
+            cycles += rdtsc() - switch_tsc;
+        uint32_t ms = khz ? (uint32_t)div64_u32(cycles, khz, NULL) : 0;
+        ksnprintf(line, sizeof(line), "%4u %-16s %-8s %4u %9u %8u\n", t->tid, t->name, state_names[t->state],
+                  t->priority, t->switches, ms);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+    irq_restore(flags);
+}
+
+// --- Context switch benchmark ---
+
+static volatile uint64_t bench_start;
+static volatile uint64_t bench_end;
+static volatile int bench_cancelled; // Set when the partner thread could not be created
+
+static void bench_yielder(void *arg)
+{
+    (void)arg;
+    if (bench_cancelled)
+        return;
+    if (bench_start == 0)
+        bench_start = rdtsc();
+    for (int i = 0; i < THREAD_BENCH_ROUNDS; i++)
+        thread_yield();
+    bench_end = rdtsc();
+}
+
+void thread_benchmark()
+{
+    if (current == NULL)
+    {
+        fb_write_string("Threads are not initialized.\n", FB_RED, FB_BLACK);
+        return;
+    }
+
+    // Two threads just below the shell: neither runs until the shell blocks
+    // in thread_join, then every yield switches from one to the other
+    bench_start = 0;
+    bench_end = 0;
+    bench_cancelled = 0;
+    struct thread *a = thread_create("bench-a", bench_yielder, NULL, THREAD_PRIORITY_DEFAULT + 1);
+    struct thread *b = thread_create("bench-b", bench_yielder, NULL, THREAD_PRIORITY_DEFAULT + 1);
+    if (a == NULL || b == NULL)
+    {
+        // The one that was created has not run yet: let it exit at once
+        bench_cancelled = 1;
+        if (a)
+            thread_join(a);
+        if (b)
+            thread_join(b);
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+        return;
+    }
+    thread_join(a);
+    thread_join(b);
+
+    // Each round is one yield per thread: two switches
+    uint32_t per_switch = (uint32_t)div64_u32(bench_end - bench_start, 2 * THREAD_BENCH_ROUNDS, NULL);
+    char line[80];
+    fb_write_string("Context switch (thread_yield between two threads):\n", FB_GREEN, FB_BLACK);
+    ksnprintf(line, sizeof(line), "  %u switches, %u cycles per switch\n", 2 * THREAD_BENCH_ROUNDS, per_switch);
+    fb_write_string(line, FB_WHITE, FB_BLACK);
+}
@@ -0,0 +1,162 @@
+// timer.c - 8253/8254 PIT tick source and TSC-based monotonic clock
+#include "timer.h"
+#include "io.h"
+#include "cpu.h"
+#include "div64.h"
+#include "interrupts.h"
+#include "thread.h"
+
+// PIT ports and input clock
+#define PIT_CHANNEL0_PORT 0x40
+#define PIT_CHANNEL2_PORT 0x42
+#define PIT_COMMAND_PORT 0x43
+#define PIT_GATE_PORT 0x61 // Channel 2 gate (bit 0) and output (bit 5)
+#define PIT_FREQUENCY 1193182
+#define PIT_IRQ 0
+
+#define PIT_CMD_CH0_RATE 0x34   // Channel 0, lobyte/hibyte, mode 2 (rate generator)
+#define PIT_CMD_CH2_ONESHOT 0xB0 // Channel 2, lobyte/hibyte, mode 0 (one-shot)
+
+// TSC calibration: best of up to three 10 ms windows timed by PIT channel 2
+#define CALIBRATE_MS 10
+#define CALIBRATE_RUNS 3
+
+// Fixed-point shift for the cycles -> nanoseconds multiplier
+#define NS_SHIFT 24
+
+static volatile uint64_t tick_count = 0;
+static uint32_t tick_hz = 0;
+static uint32_t tick_ns = 0; // Length of one tick
+
+static uint64_t tsc_base = 0;
+static uint32_t tsc_freq_khz = 0;
+static uint32_t ns_mult = 0; // (ns per cycle) << NS_SHIFT
+
+// Count TSC cycles across one PIT channel 2 countdown of CALIBRATE_MS
+static uint64_t measure_tsc_window()
+{
+    uint32_t latch = PIT_FREQUENCY / (1000 / CALIBRATE_MS);
+
+    // Gate high, speaker off, then load a one-shot count
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    outb(PIT_COMMAND_PORT, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CHANNEL2_PORT, latch & 0xFF);
+    outb(PIT_CHANNEL2_PORT, (latch >> 8) & 0xFF);
+
+    uint64_t start = rdtsc();
+    while ((inb(PIT_GATE_PORT) & 0x20) == 0)
+        ;
+    return rdtsc() - start;
+}
+
+static void calibrate_tsc()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_TSC))
+        return;
+
+    // Shortest window is the one least disturbed by emulation or SMIs. Two
+    // consecutive windows within 1/1024 of each other were both undisturbed,
+    // so the remaining runs would only add boot time.
+    uint64_t best = ~0ULL;
+    uint64_t previous = 0;
+    for (int i = 0; i < CALIBRATE_RUNS; i++)
+    {
+        uint64_t cycles = measure_tsc_window();
+        if (cycles < best)
+            best = cycles;
+        uint64_t diff = cycles > previous ? cycles - previous : previous - cycles;
+        if (previous && diff <= (previous >> 10))
+            break;
+        previous = cycles;
+    }
+    if (best == 0)
+        return;
+
+    // cycles over CALIBRATE_MS milliseconds -> kHz
+    tsc_freq_khz = (uint32_t)div64_u32(best, CALIBRATE_MS, NULL);
+    if (tsc_freq_khz == 0)
+        return;
+    ns_mult = (uint32_t)div64_u32(1000000ULL << NS_SHIFT, tsc_freq_khz, NULL);
+}
+
+// IRQ 0
+static void timer_tick(registers_t *regs)
+{
+    (void)regs;
+    tick_count++;
+    thread_tick(); // Wake sleepers, expire the time slice
+}
+
+void timer_init(uint32_t hz)
+{
+    if (hz == 0)
+        hz = TIMER_DEFAULT_HZ;
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    if (divisor == 0)
+        divisor = 1;
+    if (divisor > 0xFFFF)
+        divisor = 0xFFFF;
+
+    calibrate_tsc();
+
+    tick_hz = PIT_FREQUENCY / divisor;
+    tick_ns = (uint32_t)div64_u32((uint64_t)divisor * 1000000000ULL, PIT_FREQUENCY, NULL);
+    tick_count = 0;
+    tsc_base = tsc_freq_khz ? rdtsc() : 0;
+
+    outb(PIT_COMMAND_PORT, PIT_CMD_CH0_RATE);
+    outb(PIT_CHANNEL0_PORT, divisor & 0xFF);
+    outb(PIT_CHANNEL0_PORT, (divisor >> 8) & 0xFF);
+    register_irq_handler(PIT_IRQ, timer_tick);
+}
+
+uint64_t ticks()
+{
+    // A 64-bit load is two 32-bit loads; retry if an IRQ carried between them
+    uint64_t a, b;
+    do
+    {
+        a = tick_count;
+        b = tick_count;
+    } while (a != b);
+    return a;
+}
+
+uint64_t clock_ns()
+{
+    if (ns_mult == 0)
+        return ticks() * tick_ns;
+
+    // cycles * ns_mult >> NS_SHIFT, split so the product never overflows 64 bits
+    uint64_t cycles = rdtsc() - tsc_base;
+    uint32_t high = (uint32_t)(cycles >> 32);
+    uint32_t low = (uint32_t)cycles;
+    return (((uint64_t)high * ns_mult) << (32 - NS_SHIFT)) + (((uint64_t)low * ns_mult) >> NS_SHIFT);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    uint64_t deadline = clock_ns() + (uint64_t)ms * 1000000;
+    uint32_t eflags;
+    asm volatile("pushf; pop %0" : "=r"(eflags));
+
+    while (clock_ns() < deadline)
+    {
+        if (eflags & 0x200)
+            asm volatile("hlt"); // Sleep until the next tick (or any other IRQ)
+        else
+            asm volatile("pause"); // Interrupts off: nothing would wake us from hlt
+    }
+}
+
+uint32_t timer_hz()
+{
+    return tick_hz;
+}
+
+uint32_t tsc_khz()
+{
+    return tsc_freq_khz;
+}
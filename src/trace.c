@@ -0,0 +1,214 @@
+// trace.c - Per-CPU trace rings, gcc function-entry hooks and the serial dump
+//
+// Built without -finstrument-functions even in 'make trace' builds (see the
+// Makefile): everything here runs inside the hooks.
+#include "trace.h"
+#include "percpu.h"
+#include "smp.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "timer.h"
+#include "serial.h"
+#include "fb.h"
+#include "klog.h"
+
+#define CACHE_LINE 64
+#define RING_EVENTS ((PAGE_SIZE << TRACE_BUFFER_ORDER) / sizeof(struct trace_record))
+#define RING_MASK (RING_EVENTS - 1)
+
+// One per CPU and only written by its owner. 'head' counts every event ever
+// reserved, so head - RING_EVENTS events have been overwritten.
+struct trace_ring
+{
+    struct trace_record *records; // Allocated by the first trace_enable, then kept
+    volatile uint32_t head;
+} __attribute__((aligned(CACHE_LINE)));
+
+volatile int trace_active = 0;
+
+static struct trace_ring rings[SMP_MAX_CPUS];
+static uint32_t ring_count = 0; // CPUs with a ring
+
+// Names and argument formats, written into the dump header so the decoder
+// needs no copy of enum trace_event_id
+static const struct
+{
+    const char *name;
+    const char *arg; // hex, dec, char or sym
+} events[TRACE_EVENT_COUNT] = {
+    [TRACE_NONE] = {"none", "hex"},
+    [TRACE_FUNC_ENTER] = {"func_enter", "sym"},
+    [TRACE_FUNC_EXIT] = {"func_exit", "sym"},
+    [TRACE_IRQ_ENTER] = {"irq_enter", "dec"},
+    [TRACE_IRQ_EXIT] = {"irq_exit", "dec"},
+    [TRACE_KBD_SCANCODE] = {"kbd_scancode", "hex"},
+    [TRACE_SHELL_INPUT] = {"shell_input", "char"},
+    [TRACE_FB_PUTC] = {"fb_putc", "char"},
+    [TRACE_SCHED_SWITCH] = {"sched_switch", "dec"},
+    [TRACE_SHELL_BEGIN] = {"shell_begin", "dec"},
+    [TRACE_SHELL_END] = {"shell_end", "dec"},
+};
+
+__attribute__((no_instrument_function)) void trace_record_event(uint32_t event, uint32_t arg)
+{
+    uint32_t cpu = this_cpu_read(index);
+    if (cpu >= ring_count)
+        return;
+
+    // Reserve a slot. xadd without lock is enough: only this CPU writes its
+    // ring, and an interrupt cannot split one instruction.
+    struct trace_ring *ring = &rings[cpu];
+    uint32_t slot = 1;
+    asm volatile("xaddl %0, %1" : "+r"(slot), "+m"(ring->head) : : "memory");
+
+    struct trace_record *record = &ring->records[slot & RING_MASK];
+    record->tsc = rdtsc();
+    record->event = (uint16_t)event;
+    record->cpu = (uint16_t)cpu;
+    record->arg = arg;
+}
+
+#ifdef TRACE_FUNCTIONS
+// Called by gcc -finstrument-functions code on every function entry and exit
+__attribute__((no_instrument_function)) void __cyg_profile_func_enter(void *fn, void *call_site)
+{
+    (void)call_site;
+    if (trace_active)
+        trace_record_event(TRACE_FUNC_ENTER, (uint32_t)fn);
+}
+
+__attribute__((no_instrument_function)) void __cyg_profile_func_exit(void *fn, void *call_site)
+{
+    (void)call_site;
+    if (trace_active)
+        trace_record_event(TRACE_FUNC_EXIT, (uint32_t)fn);
+}
+#endif
+
+int trace_enable()
+{
+    trace_disable();
+
+    uint32_t online = (uint32_t)smp_cpu_count();
+    for (uint32_t i = 0; i < online; i++)
+    {
+        if (rings[i].records == NULL)
+        {
+            uint32_t addr = pmm_alloc_pages(TRACE_BUFFER_ORDER);
+            if (addr == 0)
+                return -1;
+            rings[i].records = (struct trace_record *)addr;
+        }
+        rings[i].head = 0;
+    }
+    ring_count = online;
+
+    __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void trace_disable()
+{
+    __atomic_store_n(&trace_active, 0, __ATOMIC_RELEASE);
+}
+
+void trace_clear()
+{
+    int was_active = trace_active;
+    trace_disable();
+    for (uint32_t i = 0; i < ring_count; i++)
+        rings[i].head = 0;
+    if (was_active)
+        __atomic_store_n(&trace_active, 1, __ATOMIC_RELEASE);
+}
+
+// Events still in the ring and events lost to wrap-around
+static uint32_t ring_events(const struct trace_ring *ring, uint32_t *overwritten)
+{
+    uint32_t head = ring->head;
+    uint32_t kept = head < RING_EVENTS ? head : RING_EVENTS;
+    if (overwritten)
+        *overwritten = head - kept;
+    return kept;
+}
+
+void trace_print_status()
+{
+    char line[96];
+
+#ifdef TRACE_FUNCTIONS
+    const char *functions = "built in";
+#else
+    const char *functions = "not built (make trace)";
+#endif
+    ksnprintf(line, sizeof(line), "Tracing: %s, function entry/exit: %s\n", trace_active ? "on" : "off", functions);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    for (uint32_t cpu = 0; cpu < ring_count; cpu++)
+    {
+        uint32_t overwritten;
+        uint32_t kept = ring_events(&rings[cpu], &overwritten);
+        ksnprintf(line, sizeof(line), "  CPU %u: %u events buffered, %u overwritten\n", cpu, kept, overwritten);
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+}
+
+// "T " and the record's bytes in memory order as hex
+static void write_record(const struct trace_record *record)
+{
+    static const char digits[] = "0123456789abcdef";
+    char line[2 + 2 * sizeof(struct trace_record) + 2];
+    const uint8_t *bytes = (const uint8_t *)record;
+    uint32_t len = 0;
+
+    line[len++] = 'T';
+    line[len++] = ' ';
+    for (uint32_t i = 0; i < sizeof(struct trace_record); i++)
+    {
+        line[len++] = digits[bytes[i] >> 4];
+        line[len++] = digits[bytes[i] & 0xF];
+    }
+    line[len++] = '\n';
+    line[len] = '\0';
+    serial_write(line);
+}
+
+void trace_dump()
+{
+    char line[96];
+    uint32_t total = 0;
+
+    if (!serial_present())
+    {
+        fb_write_string("No serial port.\n", FB_RED, FB_BLACK);
+        return;
+    }
+    trace_disable(); // Writers finish within a few instructions; the rings stay put from here
+
+    ksnprintf(line, sizeof(line), "TRACE-BEGIN tsc_khz=%u cpus=%u record_size=%u\n", tsc_khz(), ring_count,
+              (uint32_t)sizeof(struct trace_record));
+    serial_write(line);
+    for (uint32_t id = 0; id < TRACE_EVENT_COUNT; id++)
+    {
+        ksnprintf(line, sizeof(line), "TRACE-NAME id=%u name=%s arg=%s\n", id, events[id].name, events[id].arg);
+        serial_write(line);
+    }
+
+    for (uint32_t cpu = 0; cpu < ring_count; cpu++)
+    {
+        const struct trace_ring *ring = &rings[cpu];
+        uint32_t overwritten;
+        uint32_t kept = ring_events(ring, &overwritten);
+        ksnprintf(line, sizeof(line), "TRACE-CPU cpu=%u events=%u overwritten=%u\n", cpu, kept, overwritten);
+        serial_write(line);
+        // Oldest first
+        for (uint32_t i = ring->head - kept; i != ring->head; i++)
+            write_record(&ring->records[i & RING_MASK]);
+        total += kept;
+    }
+
+    ksnprintf(line, sizeof(line), "TRACE-END events=%u\n", total);
+    serial_write(line);
+
+    ksnprintf(line, sizeof(line), "Tracing stopped; wrote %u events to COM1.\n", total);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+}
@@ -0,0 +1,313 @@
+// workpool.c - Chase-Lev work-stealing deques and parallel_for over all CPUs
+#include "workpool.h"
+#include "percpu.h"
+#include "smp.h"
+#include "apic.h"
+#include "idt.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "string.h"
+#include "div64.h"
+#include "fb.h"
+#include "klog.h"
+
+#define DEQUE_MASK (WORKPOOL_DEQUE_SIZE - 1)
+#define CACHE_LINE 64
+
+#define BENCH_ORDER 10             // 4 MiB buffer for the benchmark workloads
+#define BENCH_GRAIN (64 * 1024)    // Bytes per zeroing piece
+#define BENCH_WORD_GRAIN 16384     // Words per checksum piece
+#define BENCH_RUNS 3
+
+struct task
+{
+    uint32_t begin;
+    uint32_t end;
+};
+
+// One per CPU. 'bottom' is only written by the owner, 'top' is advanced by
+// whoever takes the oldest task (owner on the last one, or a thief) with a CAS.
+struct worker
+{
+    volatile int32_t top;
+    volatile int32_t bottom;
+    uint32_t seed; // xorshift state for picking victims
+    struct task tasks[WORKPOOL_DEQUE_SIZE];
+} __attribute__((aligned(CACHE_LINE)));
+
+static struct worker workers[SMP_MAX_CPUS];
+
+// The loop being run. Published before its first task is pushed.
+static parallel_fn_t job_fn;
+static void *job_arg;
+static uint32_t job_grain;
+static volatile uint32_t job_remaining = 0; // Indices not yet processed
+static volatile uint32_t job_active = 0;
+
+static uint32_t worker_limit = 0; // 0 = all online CPUs
+
+// --- Chase-Lev deque ---
+
+static int deque_push(struct worker *w, struct task task)
+{
+    int32_t b = w->bottom;
+    int32_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    if (b - t >= WORKPOOL_DEQUE_SIZE)
+        return -1;
+    w->tasks[b & DEQUE_MASK] = task;
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELEASE); // Task visible before the new bottom
+    return 0;
+}
+
+// Owner end: newest task first (depth-first, cache-warm)
+static int deque_pop(struct worker *w, struct task *task)
+{
+    int32_t b = w->bottom - 1;
+    w->bottom = b;
+    // The bottom store must be visible before top is read (store-load order needs a fence on x86)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int32_t t = w->top;
+
+    if (t > b)
+    {
+        w->bottom = b + 1; // Empty
+        return 0;
+    }
+    *task = w->tasks[b & DEQUE_MASK];
+    if (t == b)
+    {
+        // Last task: race the thieves for it through top
+        int won = __atomic_compare_exchange_n(&w->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        w->bottom = b + 1;
+        return won;
+    }
+    return 1;
+}
+
+// Thief end: oldest task, which is also the largest range
+static int deque_steal(struct worker *w, struct task *task)
+{
+    int32_t t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+    int32_t b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return 0;
+    *task = w->tasks[t & DEQUE_MASK];
+    return __atomic_compare_exchange_n(&w->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// --- Workers ---
+
+static uint32_t active_workers()
+{
+    uint32_t online = smp_cpu_count();
+    return (worker_limit && worker_limit < online) ? worker_limit : online;
+}
+
+// Split off the upper halves for thieves until the piece fits the grain, then run it
+static void run_task(struct worker *w, struct task task)
+{
+    while (task.end - task.begin > job_grain)
+    {
+        uint32_t mid = task.begin + (task.end - task.begin) / 2;
+        struct task upper = {mid, task.end};
+        if (deque_push(w, upper) != 0)
+            break; // Deque full: just do the rest here
+        task.end = mid;
+    }
+    job_fn(task.begin, task.end, job_arg);
+    __atomic_fetch_sub(&job_remaining, task.end - task.begin, __ATOMIC_RELEASE);
+}
+
+static uint32_t next_random(struct worker *w)
+{
+    uint32_t x = w->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    w->seed = x;
+    return x;
+}
+
+// Work until every index of the current loop has been processed
+static void worker_run(uint32_t self, uint32_t count)
+{
+    struct worker *w = &workers[self];
+    struct task task;
+
+    while (__atomic_load_n(&job_remaining, __ATOMIC_ACQUIRE) != 0)
+    {
+        if (deque_pop(w, &task))
+        {
+            run_task(w, task);
+            continue;
+        }
+        if (count > 1)
+        {
+            uint32_t victim = next_random(w) % count;
+            if (victim != self && deque_steal(&workers[victim], &task))
+            {
+                run_task(w, task);
+                continue;
+            }
+        }
+        asm volatile("pause");
+    }
+}
+
+void workpool_ap_main()
+{
+    uint32_t self = this_cpu_read(index);
+    workers[self].seed = 0x9E3779B9u * (self + 1);
+
+    while (1)
+    {
+        // Same no-lost-wakeup pattern as the shell: check with interrupts off,
+        // then 'sti; hlt' so the wakeup IPI cannot slip in between
+        asm volatile("cli");
+        if (__atomic_load_n(&job_active, __ATOMIC_ACQUIRE) && self < active_workers())
+        {
+            asm volatile("sti");
+            worker_run(self, active_workers());
+        }
+        else
+        {
+            asm volatile("sti; hlt");
+        }
+    }
+}
+
+void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, parallel_fn_t fn, void *arg)
+{
+    if (end <= begin)
+        return;
+    if (grain == 0)
+        grain = 1;
+
+    uint32_t count = active_workers();
+    // Nested loops, a single CPU or a single piece: nothing to share
+    if (count <= 1 || end - begin <= grain || this_cpu_read(index) != 0 ||
+        __atomic_exchange_n(&job_active, 1, __ATOMIC_ACQUIRE))
+    {
+        fn(begin, end, arg);
+        return;
+    }
+
+    struct worker *w = &workers[0];
+    if (w->seed == 0)
+        w->seed = 0x9E3779B9u;
+    job_fn = fn;
+    job_arg = arg;
+    job_grain = grain;
+    __atomic_store_n(&job_remaining, end - begin, __ATOMIC_RELEASE);
+    struct task all = {begin, end};
+    deque_push(w, all);
+
+    // Wake the sleeping workers; ones still spinning from the last loop see job_remaining
+    for (uint32_t i = 1; i < count; i++)
+        lapic_send_ipi(cpus[i].apic_id, APIC_IPI_FIXED | (IDT_IRQ_BASE + APIC_WAKE_IRQ));
+
+    worker_run(0, count);
+    __atomic_store_n(&job_active, 0, __ATOMIC_RELEASE);
+}
+
+void workpool_set_workers(uint32_t count)
+{
+    worker_limit = count;
+}
+
+uint32_t workpool_workers()
+{
+    return active_workers();
+}
+
+// --- Benchmark ---
+
+struct bench_buffer
+{
+    uint8_t *bytes;
+    volatile uint32_t sum;
+};
+
+static void bench_zero(uint32_t begin, uint32_t end, void *arg)
+{
+    struct bench_buffer *buf = arg;
+    memset(buf->bytes + begin, 0, end - begin);
+}
+
+static void bench_checksum(uint32_t begin, uint32_t end, void *arg)
+{
+    struct bench_buffer *buf = arg;
+    const uint32_t *words = (const uint32_t *)buf->bytes;
+    uint32_t sum = 0;
+    for (uint32_t i = begin; i < end; i++)
+        sum += words[i] ^ i;
+    __atomic_fetch_add(&buf->sum, sum, __ATOMIC_RELAXED);
+}
+
+static uint32_t bench_best(uint32_t size, uint32_t grain, parallel_fn_t fn, struct bench_buffer *buf)
+{
+    uint64_t best = ~0ULL;
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        buf->sum = 0;
+        uint64_t start = rdtsc();
+        parallel_for(0, size, grain, fn, buf);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best)
+            best = cycles;
+    }
+    return (uint32_t)best;
+}
+
+void workpool_benchmark()
+{
+    uint32_t bytes = PAGE_SIZE << BENCH_ORDER;
+    uint32_t words = bytes / sizeof(uint32_t);
+    struct bench_buffer buf;
+    buf.bytes = (uint8_t *)pmm_alloc_pages(BENCH_ORDER);
+    if (buf.bytes == NULL)
+    {
+        fb_write_string("Out of memory.\n", FB_RED, FB_BLACK);
+        return;
+    }
+    for (uint32_t i = 0; i < words; i++)
+        ((uint32_t *)buf.bytes)[i] = i * 2654435761u;
+
+    // Reference checksum, computed inline
+    buf.sum = 0;
+    bench_checksum(0, words, &buf);
+    uint32_t expected = buf.sum;
+
+    uint32_t saved_limit = worker_limit;
+    uint32_t online = smp_cpu_count();
+    uint32_t zero_base = 0, sum_base = 0;
+    char line[96];
+
+    ksnprintf(line, sizeof(line), "parallel_for over %u KiB (%u CPU(s) online):\n", bytes / 1024, online);
+    fb_write_string(line, FB_GREEN, FB_BLACK);
+    fb_write_string("  workers   zero cycles  speedup   checksum cycles  speedup\n", FB_WHITE, FB_BLACK);
+    for (uint32_t n = 1; n <= online; n++)
+    {
+        worker_limit = n;
+        uint32_t sum_cycles = bench_best(words, BENCH_WORD_GRAIN, bench_checksum, &buf);
+        int sum_ok = buf.sum == expected;
+        uint32_t zero_cycles = bench_best(bytes, BENCH_GRAIN, bench_zero, &buf);
+        // Refill so the next checksum round reads the same data
+        for (uint32_t i = 0; i < words; i++)
+            ((uint32_t *)buf.bytes)[i] = i * 2654435761u;
+
+        if (n == 1)
+        {
+            zero_base = zero_cycles;
+            sum_base = sum_cycles;
+        }
+        uint32_t zero_x100 = (uint32_t)div64_u32((uint64_t)zero_base * 100, zero_cycles ? zero_cycles : 1, NULL);
+        uint32_t sum_x100 = (uint32_t)div64_u32((uint64_t)sum_base * 100, sum_cycles ? sum_cycles : 1, NULL);
+        ksnprintf(line, sizeof(line), "  %7u %13u  %3u.%02ux %17u  %3u.%02ux%s\n", n, zero_cycles, zero_x100 / 100,
+                  zero_x100 % 100, sum_cycles, sum_x100 / 100, sum_x100 % 100, sum_ok ? "" : "  CHECKSUM MISMATCH");
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    }
+
+    worker_limit = saved_limit;
+    pmm_free_pages((uint32_t)buf.bytes, BENCH_ORDER);
+}
@@ -0,0 +1,47 @@
+# ksyms.awk - Turn 'nm -n kernel.elf' output into the embedded symbol table (include/ksyms.h)
+#
+# Input lines are "<address> <type> <name>", sorted by address. Only text
+# symbols are kept, aliases collapse to their first name, and the
+# linker-defined kernel_text_end closes the last function. Without input the
+# table is empty, which is what the first link pass uses.
+
+BEGIN {
+    count = 0
+    text_end = "ffffffff"
+}
+
+$2 ~ /^[TtWw]$/ && NF == 3 {
+    if ($3 == "kernel_text_end")
+    {
+        text_end = $1
+        next
+    }
+    if (count > 0 && $1 == addr[count - 1])
+        next
+    addr[count] = $1
+    name[count] = $3
+    count++
+}
+
+END {
+    print "// ksyms_table.c - Kernel symbol table, generated from 'nm -n' by tools/ksyms.awk (do not edit)"
+    print "#include \"ksyms.h\""
+    print ""
+    print "#define KSYMS __attribute__((section(\".ksyms\")))"
+    print ""
+    printf "const uint32_t ksym_count KSYMS = %d;\n\n", count
+    print "const struct ksym ksym_table[] KSYMS = {"
+    offset = 0
+    for (i = 0; i < count; i++)
+    {
+        printf "    {0x%s, %d},\n", addr[i], offset
+        offset += length(name[i]) + 1
+    }
+    printf "    {0x%s, %d}, // End of .text\n", text_end, offset
+    print "};"
+    print ""
+    print "const char ksym_names[] KSYMS ="
+    for (i = 0; i < count; i++)
+        printf "    \"%s\\0\"\n", name[i]
+    print "    \"\";"
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# trace_decode.py - Turn a 'trace dump' captured from COM1 into a timeline
+#
+# Usage: trace_decode.py [serial.log] [--elf kernel.elf] [--cpu N]
+#                        [--latency FROM TO]
+#
+# Reads the last TRACE-BEGIN ... TRACE-END block (stdin without a file),
+# merges the per-CPU rings by timestamp and prints one line per event:
+# microseconds since the first event, microseconds since the previous one,
+# CPU, event and argument. Function entry/exit events (make trace builds)
+# are indented by call depth and named from --elf, which should be the
+# kernel that produced the dump. --latency prints, for every FROM event,
+# the time until the next TO event, e.g. '--latency kbd_scancode fb_putc'.
+
+import argparse
+import bisect
+import struct
+import subprocess
+import sys
+
+RECORD = struct.Struct("<QHHI")  # struct trace_record in include/trace.h
+
+
+def fields(line):
+    """'KEY a=1 b=x' -> {'a': '1', 'b': 'x'}"""
+    return dict(item.split("=", 1) for item in line.split()[1:] if "=" in item)
+
+
+def parse_dump(lines):
+    block = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TRACE-BEGIN"):
+            block = {"header": fields(line), "names": {}, "cpus": [], "records": []}
+        elif block is None:
+            continue
+        elif line.startswith("TRACE-NAME"):
+            f = fields(line)
+            block["names"][int(f["id"])] = (f["name"], f["arg"])
+        elif line.startswith("TRACE-CPU"):
+            block["cpus"].append({k: int(v) for k, v in fields(line).items()})
+        elif line.startswith("T "):
+            data = bytes.fromhex(line[2:])
+            if len(data) == RECORD.size:
+                block["records"].append(RECORD.unpack(data))
+        elif line.startswith("TRACE-END"):
+            yield block
+            block = None
+
+
+class Symbols:
+    def __init__(self, elf):
+        self.addrs, self.names = [], []
+        if elf is None:
+            return
+        out = subprocess.run(["nm", "-n", elf], check=True, capture_output=True, text=True).stdout
+        for line in out.splitlines():
+            parts = line.split()
+            if len(parts) == 3 and parts[1] in "TtWw":
+                self.addrs.append(int(parts[0], 16))
+                self.names.append(parts[2])
+
+    def lookup(self, addr):
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        if i < 0:
+            return "0x%08x" % addr
+        offset = addr - self.addrs[i]
+        return self.names[i] if offset == 0 else "%s+0x%x" % (self.names[i], offset)
+
+
+def format_arg(kind, value, symbols):
+    if kind == "dec":
+        return str(value)
+    if kind == "char":
+        return repr(chr(value)) if 32 <= value < 127 else "0x%02x" % value
+    if kind == "sym":
+        return symbols.lookup(value)
+    return "0x%x" % value
+
+
+def print_timeline(block, records, symbols, us):
+    names = block["names"]
+    depth = {}
+    start = records[0][0]
+    previous = start
+    print("%12s %10s %3s  %s" % ("time_us", "delta_us", "cpu", "event"))
+    for tsc, event, cpu, arg in records:
+        name, kind = names.get(event, ("event%d" % event, "hex"))
+        level = depth.get(cpu, 0)
+        if name == "func_exit":
+            level = max(level - 1, 0)
+            depth[cpu] = level
+        indent = "  " * level
+        print("%12.3f %10.3f %3d  %s%s %s" % (us(tsc - start), us(tsc - previous), cpu, indent, name,
+                                             format_arg(kind, arg, symbols)))
+        if name == "func_enter":
+            depth[cpu] = level + 1
+        previous = tsc
+
+
+def print_latency(block, records, first, second, us):
+    ids = {name: id for id, (name, _) in block["names"].items()}
+    for name in (first, second):
+        if name not in ids:
+            sys.exit("unknown event '%s' (known: %s)" % (name, ", ".join(sorted(ids))))
+    pending, samples = [], []
+    for tsc, event, _cpu, _arg in records:
+        if event == ids[first]:
+            pending.append(tsc)
+        elif event == ids[second] and pending:
+            samples.extend(us(tsc - t) for t in pending)
+            pending = []
+    if not samples:
+        print("no %s followed by %s" % (first, second))
+        return
+    samples.sort()
+    print("%s -> %s: %d pairs, min %.3f us, median %.3f us, max %.3f us, avg %.3f us" % (
+        first, second, len(samples), samples[0], samples[len(samples) // 2], samples[-1],
+        sum(samples) / len(samples)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a trace dump captured from COM1")
+    parser.add_argument("log", nargs="?", help="serial capture (default: stdin)")
+    parser.add_argument("--elf", help="kernel.elf for function names")
+    parser.add_argument("--cpu", type=int, help="only events from this CPU")
+    parser.add_argument("--latency", nargs=2, metavar=("FROM", "TO"), help="FROM-to-next-TO delays")
+    args = parser.parse_args()
+
+    source = open(args.log, errors="replace") if args.log else sys.stdin
+    blocks = list(parse_dump(source))
+    if not blocks:
+        sys.exit("no TRACE-BEGIN ... TRACE-END block found")
+    block = blocks[-1]
+
+    for cpu in block["cpus"]:
+        if cpu["overwritten"]:
+            print("# CPU %d: %d older events were overwritten" % (cpu["cpu"], cpu["overwritten"]))
+
+    khz = int(block["header"]["tsc_khz"]) or 1
+    us = lambda cycles: cycles * 1000.0 / khz
+    records = sorted(block["records"])
+    if args.cpu is not None:
+        records = [r for r in records if r[2] == args.cpu]
+    if not records:
+        sys.exit("no events")
+
+    if args.latency:
+        print_latency(block, records, args.latency[0], args.latency[1], us)
+    else:
+        print_timeline(block, records, Symbols(args.elf), us)
+
+
+if __name__ == "__main__":
+    main()